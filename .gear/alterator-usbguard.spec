@@ -40,6 +40,7 @@ Alterator Module to control USB devices via USBGuard.
 %_altdata_dir/help/ru_RU/usbguard.html
 %_usr/lib/alterator/backend3/usbguard
 %_sysconfdir/usbguard/android_vidpid.json
+%_sysconfdir/usbguard/android_vidpid.bin
 %lang(ru)  %_datadir/locale/ru/LC_MESSAGES/alterator-usbguard.mo
 
 
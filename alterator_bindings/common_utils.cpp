@@ -1,6 +1,9 @@
 #include "common_utils.hpp"
 #include "log.hpp"
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <filesystem>
 #include <iostream>
@@ -14,43 +17,118 @@ namespace common_utils {
 
 std::string UnUtf8(const std::string &str) noexcept {
   std::string res;
-  std::runtime_error ex_bad_string("Invalid characters in string");
   try {
-    const uint kMaxIter = 1'000'000;
-    uint iter_counter = 0;
-    size_t ind = 0;
-    while (ind < str.size()) {
-      ++iter_counter;
-      if (iter_counter > kMaxIter)
-        throw std::runtime_error("Maximal number of iterations was reached");
-      // 1 byte char - skip quotes
-      if ((str.at(ind) & 0b10000000) == 0) {
-        if (str.at(ind) != '\"' && str.at(ind) != '\'')
-          res += str.at(ind);
-        ++ind;
-        continue;
+    res.reserve(str.size());
+    Utf8Filter filter;
+    if (filter.Append(str, res))
+      filter.Finish();
+  } catch (const std::exception &ex) {
+    Log::Error() << ex.what();
+  }
+  return res;
+}
+
+namespace {
+
+constexpr uint64_t kOnes = 0x0101010101010101ULL;
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+
+/// @brief true if any byte of the word is the byte
+constexpr bool HasByte(uint64_t word, unsigned char byte) noexcept {
+  const uint64_t diff = word ^ (kOnes * byte);
+  return ((diff - kOnes) & ~diff & kHighBits) != 0;
+}
+
+/// @brief true if 16 bytes are ASCII and not quotes
+inline bool PlainAscii16(const char *data) noexcept {
+  uint64_t first = 0;
+  uint64_t second = 0;
+  std::memcpy(&first, data, sizeof(first));
+  std::memcpy(&second, data + sizeof(first), sizeof(second));
+  return ((first | second) & kHighBits) == 0 && !HasByte(first, '\"') &&
+         !HasByte(second, '\"') && !HasByte(first, '\'') &&
+         !HasByte(second, '\'');
+}
+
+} // namespace
+
+Utf8Filter::Utf8Filter(Sink sink) noexcept : sink_(std::move(sink)) {}
+
+bool Utf8Filter::Write(std::string_view chunk) {
+  buf_.clear();
+  buf_.reserve(chunk.size());
+  Append(chunk, buf_);
+  if (!buf_.empty() && sink_)
+    sink_(buf_);
+  return good_;
+}
+
+bool Utf8Filter::Append(std::string_view chunk, std::string &out) {
+  constexpr size_t kRun = 16;
+  if (!good_)
+    return false;
+  size_t ind = 0;
+  while (ind < chunk.size()) {
+    if (need_ == 0) {
+      while (chunk.size() - ind >= kRun && PlainAscii16(chunk.data() + ind)) {
+        out.append(chunk.data() + ind, kRun);
+        ind += kRun;
       }
-      // 2 bytes - skip
-      if ((str.at(ind) & 0b11100000) == 0b11000000 && ind < str.size() - 1) {
-        ind += 2;
+    }
+    // byte by byte up to the end of the run
+    const size_t end = std::min(chunk.size(), ind + kRun);
+    for (; ind < end; ++ind) {
+      const auto symbol = static_cast<unsigned char>(chunk[ind]);
+      if (need_ != 0) {
+        if (symbol < lower_ || symbol > upper_) {
+          good_ = false;
+          break;
+        }
+        lower_ = 0x80;
+        upper_ = 0xBF;
+        --need_;
         continue;
       }
-      // 3 bytes - skip
-      if ((str.at(ind) & 0b11110000) == 0b11100000 && ind < str.size() - 2) {
-        ind += 3;
+      // 1 byte char - skip quotes
+      if (symbol < 0x80) {
+        if (symbol != '\"' && symbol != '\'')
+          out.push_back(static_cast<char>(symbol));
         continue;
       }
-      // 4 bytes - skip
-      if ((str.at(ind) & 0b11111000) == 0b11110000) {
-        ind += 4;
-        continue;
+      // 2,3,4 bytes - validate and skip
+      if (symbol >= 0xC2 && symbol <= 0xDF) {
+        need_ = 1;
+      } else if (symbol >= 0xE0 && symbol <= 0xEF) {
+        need_ = 2;
+        if (symbol == 0xE0)
+          lower_ = 0xA0; // overlong
+        else if (symbol == 0xED)
+          upper_ = 0x9F; // surrogates
+      } else if (symbol >= 0xF0 && symbol <= 0xF4) {
+        need_ = 3;
+        if (symbol == 0xF0)
+          lower_ = 0x90; // overlong
+        else if (symbol == 0xF4)
+          upper_ = 0x8F; // > U+10FFFF
+      } else {
+        good_ = false;
+        break;
       }
-      throw std::runtime_error("Bad utf-8 string");
     }
-  } catch (const std::exception &ex) {
-    Log::Error() << ex.what();
+    if (!good_) {
+      Log::Error() << "Bad utf-8 string";
+      break;
+    }
   }
-  return res;
+  return good_;
+}
+
+bool Utf8Filter::Finish() {
+  if (good_ && need_ != 0) {
+    Log::Error() << "Bad utf-8 string";
+    good_ = false;
+  }
+  return good_;
 }
 
 std::string WrapWithQuotes(const std::string &str) noexcept {
@@ -4,15 +4,63 @@
 #include <boost/algorithm/string.hpp>
 #include <chrono>
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 namespace common_utils {
 
+/**
+ * @brief Remove quotes and multibyte characters from a utf-8 string
+ * @return The filtered string, the part before an error for a bad string
+ */
 std::string UnUtf8(const std::string &str) noexcept;
 
+/**
+ * @class Utf8Filter
+ * @brief Streaming version of UnUtf8
+ * @details Keeps one-byte characters except quotes, validates and skips
+ * multibyte characters (RFC 3629: no overlong forms, no surrogates, up to
+ * U+10FFFF). A character may be split between chunks. Runs of ASCII
+ * without quotes are copied by 16 bytes.
+ */
+class Utf8Filter {
+public:
+  using Sink = std::function<void(std::string_view)>;
+
+  explicit Utf8Filter(Sink sink = nullptr) noexcept;
+
+  /**
+   * @brief Filter the next chunk, the filtered text is passed to the sink
+   * @return false if the input is not a valid utf-8 string, the rest of
+   * the input is ignored
+   */
+  bool Write(std::string_view chunk);
+
+  /**
+   * @brief Filter the next chunk, the filtered text is appended to out
+   * @return false if the input is not a valid utf-8 string
+   */
+  bool Append(std::string_view chunk, std::string &out);
+
+  /// @brief End of the input
+  /// @return false if the input is bad or ends inside a character
+  bool Finish();
+
+  inline bool good() const noexcept { return good_; }
+
+private:
+  Sink sink_;
+  std::string buf_;
+  size_t need_ = 0; /// continuation bytes left of a multibyte character
+  unsigned char lower_ = 0x80; /// the range of the next continuation byte
+  unsigned char upper_ = 0xBF;
+  bool good_ = true;
+};
+
 /// @brief Wrap string with esape coutes
 /// @param str String to wrap
 /// @return New wrapped string
@@ -192,23 +192,96 @@
 (define (filter-lists lst field)
   (filter (lambda (sublist) (member field sublist)) lst))
 
+; the uploaded file is sent by chunks of this size
+(define upload-chunk-size 262144)
+(define upload-max-retries 3)
+
+; send one chunk of the uploaded file, #f if the message failed
+(define (send-upload-chunk upload-id offset chunk)
+    (catch #t
+        (lambda ()
+            (removeFirstElement (woo-read "/usbguard/rules_upload_chunk"
+                'upload_id upload-id 'offset (number->string offset) 'chunk chunk)))
+        (lambda args #f))
+)
+
+; send the file by chunks and parse it, an interrupted upload is resumed
+; from the position received by the backend
+(define (upload-rules-chunked blob)
+    (let ((upload-id (get-value 'upload_id (removeFirstElement (woo-read "/usbguard/rules_upload_begin")))))
+        (let loop ((offset 0) (retries 0))
+            (if (>= offset (string-length blob))
+                (removeFirstElement (woo-read "/usbguard/rules_upload_commit"
+                    'upload_id upload-id 'size (number->string (string-length blob))))
+                (let ((response (send-upload-chunk upload-id offset
+                        (substring blob offset (min (string-length blob) (+ offset upload-chunk-size))))))
+                    (cond
+                        ((and response (string=? "OK" (get-value 'status response)))
+                            (loop (string->number (get-value 'received response)) 0))
+                        ((>= retries upload-max-retries)
+                            '((status "BAD")))
+                        ((and response (string=? "BAD_OFFSET" (get-value 'status response)))
+                            (loop (string->number (get-value 'received response)) (+ retries 1)))
+                        (response
+                            '((status "BAD")))
+                        (else
+                            (let ((status (removeFirstElement (woo-read "/usbguard/rules_upload_status" 'upload_id upload-id))))
+                                (if (string=? "OK" (get-value 'status status))
+                                    (loop (string->number (get-value 'received status)) (+ retries 1))
+                                    '((status "BAD")))))
+                    )
+                )
+            )
+        )
+    )
+)
+
 (define (upload_rules_callback)
-    (let ((
-        response  (removeFirstElement (woo-read "/usbguard/rules_upload" 'upload_rules (form-blob "file_input"))) 
-         ))  
+    (let* ((blob (form-blob "file_input"))
+           (response (if (string-null? blob)
+                         '((status "ERROR_EMPTY"))
+                         (upload-rules-chunked blob))))
        (if  (string=? "OK" (get-value 'status response))
             (js "AddRulesFromFile" (get-value 'response_json response) )
             (begin
                 (js "ClearFileInput")
-                (if (string=? "ERROR_EMPTY" (get-value 'status response))
-                    (js "alert" (_ "An empty csv file. Parsed 0 rules."))
-                    (js "alert" (_ "An error occured while parsing csv file"))
-                )                
+                (cond
+                    ((string=? "ERROR_EMPTY" (get-value 'status response))
+                        (js "alert" (_ "An empty csv file. Parsed 0 rules.")))
+                    ((string=? "BAD_ROWS" (get-value 'status response))
+                        (js "ShowCsvRowErrors" (get-value 'rows_errors response)))
+                    (else
+                        (js "alert" (_ "An error occured while parsing csv file")))
+                )
             )            
        ) 
     ) ; let
 )
 
+; save the current rules as a csv file
+(define (export_rules_callback)
+    (let ((response (removeFirstElement (woo-read "/usbguard/rules_export" 'format "csv"))))
+        (if (string=? "OK" (get-value 'status response))
+            (begin
+                (js "SaveExportedRules" (get-value 'data response))
+                ; rules with attributes out of the csv columns are not exported
+                (if (not (string=? "0" (get-value 'skipped response)))
+                    (js "alert" (string-append
+                        (_ "Some rules can't be saved as csv. Not exported: ")
+                        (get-value 'skipped response)))))
+            (js "alert" (_ "An error occured while exporting rules")))
+    )
+)
+
+; find rules that never fire or contradict earlier rules
+(define (analyze_rules_callback)
+    (let ((response (removeFirstElement (woo-read "/usbguard/rules_analysis"))))
+        (if (string=? "OK" (get-value 'status response))
+            (js "ShowRulesAnalysis" (get-value 'analysis_json response))
+            (js "alert" (_ "An error occured while analyzing rules")))
+    )
+)
+
 ; validation finished signal from js
 (define (validation_finished)
     (form-update-activity "save_rules"  #t)
@@ -256,4 +329,6 @@
   (form-bind "hidden_manual_changes_data" "rules_json_ready" save_rules_handler) ;save changes event
   (form-bind "hidden_manual_changes_response" "rules_applied" update_after_rulles_applied)  
   (form-bind-upload "load_file_button" "data_ready" "file_input" upload_rules_callback )
+  (form-bind "export_rules_button" "click" export_rules_callback)
+  (form-bind "analyze_rules_button" "click" analyze_rules_callback)
 )
\ No newline at end of file
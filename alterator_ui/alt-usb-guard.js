@@ -148,7 +148,7 @@ $(document).ready(function () {
  $("#load_file_button").bind('click',function(){
   const fileInput = document.getElementById('file_input');
   if (fileInput.files.length > 0) {
-    if(fileInput.files[0].size >1024000 ){
+    if(fileInput.files[0].size >16384000 ){
         alert($("#alert_huge_file").text());
         fileInput.value="";
     }
@@ -326,6 +326,54 @@ function ClearFileInput(){
   fileInput.value="";
 }
 
+// show the rows of a csv file, which were not converted to rules
+function ShowCsvRowErrors (data) {
+  const max_shown = 20;
+  const errors = JSON.parse(data);
+  let text = $("#alert_csv_row_errors").text();
+  errors.slice(0, max_shown).forEach(function(error){
+    text += "\nline " + (error["line"] + 1) + ", column " +
+            (error["column"] + 1) + ": " + error["message"];
+  });
+  if (errors.length > max_shown){
+    text += "\n...";
+  }
+  alert(text);
+}
+
+// save the exported rules as a file
+function SaveExportedRules (data) {
+  const blob = new Blob([data], {type: "text/csv"});
+  const link = document.createElement("a");
+  link.href = URL.createObjectURL(blob);
+  link.download = "usbguard_rules.csv";
+  document.body.appendChild(link);
+  link.click();
+  document.body.removeChild(link);
+  URL.revokeObjectURL(link.href);
+}
+
+// show rules that never fire or contradict earlier rules
+function ShowRulesAnalysis (data) {
+  const max_shown = 20;
+  const analysis = JSON.parse(data);
+  let text = "";
+  ["duplicates", "shadowed", "contradictions"].forEach(function(kind){
+    const findings = analysis[kind];
+    if (!Array.isArray(findings) || findings.length === 0){
+      return;
+    }
+    text += (text ? "\n\n" : "") + $("#alert_analysis_" + kind).text();
+    findings.slice(0, max_shown).forEach(function(finding){
+      text += "\n#" + finding["rule"] + " (#" + finding["by"] + ")";
+    });
+    if (findings.length > max_shown){
+      text += "\n...";
+    }
+  });
+  alert(text ? text : $("#alert_analysis_clean").text());
+}
+
 function AddRulesFromFile (data) {
   const rules_json=JSON.parse(data);
   //set policy ratiobuttons
@@ -6,83 +6,77 @@ The output data will be printed to standart output
 The data expected is
 https://github.com/M0Rf30/android-udev-rules/blob/main/51-android.rules
 
+Usage: vid_parser [--input=FILE|-] [--format=json|bin]
+  --input  read a local rules file ("-" for stdin) instead of downloading
+  json - [{"vid":"xxxx","pid":"xxxx"},...] (default)
+  bin  - the binary table, see common/vidpid_table.hpp
+
 */
 #include "curl_wrapper.hpp"
-#include <boost/algorithm/string.hpp>
+#include "udev_vidpid_parser.hpp"
+#include "vidpid_table.hpp"
 #include <boost/json.hpp>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <sstream>
 #include <string>
 
-int main(int argc, const char *argv[]) {
-  CurlWrapper curl;
-
-  const std::string url = "https://raw.githubusercontent.com/M0Rf30/"
-                          "android-udev-rules/main/51-android.rules";
-  std::string buffer = curl.perfomReq(url);
-  boost::json::array result;
+namespace vidpid_table = common_utils::vidpid_table;
 
-  // split buffer by vendor
-  std::list<boost::iterator_range<std::string::iterator>> it_all_vendords;
-  boost::find_all(it_all_vendords, buffer, "{idVendor}");
-  // TODO loop
-  int counter = 0;
-  int counter_pid = 0;
-  while (!it_all_vendords.empty()) {
-    auto first = it_all_vendords.begin()->begin();
-    it_all_vendords.pop_front();
-    std::string::iterator second;
-    if (!it_all_vendords.empty())
-      second = it_all_vendords.begin()->begin();
-    else
-      second = buffer.end();
-    // std::cerr<<"Distance = "<< std::distance(first,second)<<std::endl;
-    std::string token_vid(first, second);
-    size_t vid_start = token_vid.find('\"');
-    size_t vid_second = token_vid.find('\"', vid_start + 1);
-    std::string vid =
-        token_vid.substr(vid_start + 1, vid_second - vid_start - 1);
-    // std::cerr << "========================="<<std::endl;
-    // std::cerr << "VID = "<<vid<<std::endl;
-    ++counter;
-    // find all pids
-    std::list<boost::iterator_range<std::string::iterator>> it_all_pids;
-    boost::find_all(it_all_pids, token_vid, "{idProduct}");
-    if (it_all_pids.empty()) {
-      boost::json::object obj;
-      obj["vid"] = vid;
-      obj["pid"] = "*";
-      result.emplace_back(std::move(obj));
+int main(int argc, const char *argv[]) {
+  bool binary = false;
+  std::optional<std::string> input_path;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--format=bin") {
+      binary = true;
+    } else if (arg.rfind("--input=", 0) == 0) {
+      input_path = arg.substr(sizeof("--input=") - 1);
+    } else if (arg != "--format=json") {
+      std::cerr << "Unknown argument " << arg << std::endl;
+      return 1;
     }
-    while (!it_all_pids.empty()) {
-      auto pid_first = it_all_pids.begin()->begin();
-      it_all_pids.pop_front();
-      std::string::iterator pid_second;
-      if (!it_all_pids.empty())
-        pid_second = it_all_pids.begin()->begin();
-      else
-        pid_second = token_vid.end();
-      std::string token_pid(pid_first, pid_second);
-      // std::cerr << token_pid<<std::endl;
-      size_t pos_start = token_pid.find('\"');
-      size_t pos_second = token_pid.find('\"', pos_start + 1);
-      std::string pid =
-          token_pid.substr(pos_start + 1, pos_second - pos_start - 1);
-      // skip ill-formed PIDs
-      if (pid.size() != 4 || pid.find('?') != std::string::npos)
-        continue;
-      // std::cerr <<" PID = "<< pid;
-      boost::json::object obj;
-      obj["vid"] = vid;
-      obj["pid"] = pid;
-      result.emplace_back(std::move(obj));
-      ++counter_pid;
+  }
+
+  UdevVidPidParser parser;
+  if (!input_path) {
+    CurlWrapper curl;
+    const std::string url = "https://raw.githubusercontent.com/M0Rf30/"
+                            "android-udev-rules/main/51-android.rules";
+    std::istringstream buffer(curl.perfomReq(url));
+    parser.Parse(buffer);
+  } else if (*input_path == "-") {
+    parser.Parse(std::cin);
+  } else {
+    std::ifstream file(*input_path);
+    if (!file.is_open()) {
+      std::cerr << "Can't open " << *input_path << std::endl;
+      return 1;
     }
-    std::cerr << std::endl;
+    parser.Parse(file);
   }
 
-  std::cerr << "VIDs =" << counter << " "
-            << "PIDs = " << counter_pid << std::endl;
-  std::cout << result;
+  const UdevParseStats &stats = parser.stats();
+  std::cerr << "lines = " << stats.lines << " malformed = " << stats.malformed
+            << "\nVIDs = " << stats.vendors << " PIDs = " << stats.pairs
+            << " any PID = " << stats.any_pid
+            << "\nduplicates = " << stats.duplicates
+            << " skipped = " << stats.skipped << std::endl;
 
+  if (binary) {
+    const std::string table = vidpid_table::Serialize(parser.entries());
+    std::cout.write(table.data(), table.size());
+    return 0;
+  }
+  boost::json::array result;
+  result.reserve(parser.entries().size());
+  for (const vidpid_table::Entry &entry : parser.entries()) {
+    boost::json::object obj;
+    obj["vid"] = vidpid_table::ToHex(entry.vid);
+    obj["pid"] = entry.any_pid ? "*" : vidpid_table::ToHex(entry.pid);
+    result.emplace_back(std::move(obj));
+  }
+  std::cout << result;
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,154 @@
+#include "udev_vidpid_parser.hpp"
+#include <cctype>
+#include <optional>
+
+namespace vidpid_table = common_utils::vidpid_table;
+
+void UdevVidPidParser::Parse(std::istream &input) {
+  std::string line;
+  while (std::getline(input, line))
+    FeedLine(line);
+  Finish();
+}
+
+void UdevVidPidParser::FeedLine(std::string_view line) {
+  if (!line.empty() && line.back() == '\r')
+    line.remove_suffix(1);
+  if (!line.empty() && line.back() == '\\') {
+    line.remove_suffix(1);
+    pending_.append(line);
+    return;
+  }
+  if (pending_.empty()) {
+    ProcessLine(line);
+    return;
+  }
+  pending_.append(line);
+  ProcessLine(pending_);
+  pending_.clear();
+}
+
+void UdevVidPidParser::Finish() {
+  if (!pending_.empty()) {
+    ProcessLine(pending_);
+    pending_.clear();
+  }
+  CloseVendor();
+}
+
+bool UdevVidPidParser::Tokenize(std::string_view line,
+                                std::vector<UdevToken> &tokens) {
+  tokens.clear();
+  size_t pos = 0;
+  auto skip_spaces = [&line, &pos](bool commas) {
+    while (pos < line.size() &&
+           (std::isspace(static_cast<unsigned char>(line[pos])) != 0 ||
+            (commas && line[pos] == ',')))
+      ++pos;
+  };
+  while (true) {
+    skip_spaces(true);
+    if (pos == line.size() || line[pos] == '#')
+      return true;
+    UdevToken token;
+    // key
+    const size_t key_begin = pos;
+    while (pos < line.size() &&
+           (std::isalnum(static_cast<unsigned char>(line[pos])) != 0 ||
+            line[pos] == '_'))
+      ++pos;
+    if (pos == key_begin)
+      return false;
+    token.key = line.substr(key_begin, pos - key_begin);
+    // {attr}
+    if (pos < line.size() && line[pos] == '{') {
+      const size_t attr_end = line.find('}', pos);
+      if (attr_end == std::string_view::npos)
+        return false;
+      token.attr = line.substr(pos + 1, attr_end - pos - 1);
+      pos = attr_end + 1;
+    }
+    skip_spaces(false);
+    // operator
+    const size_t op_begin = pos;
+    while (pos < line.size() && pos - op_begin < 2 &&
+           std::string_view("=!+-:").find(line[pos]) != std::string_view::npos)
+      ++pos;
+    token.op = line.substr(op_begin, pos - op_begin);
+    if (token.op != "==" && token.op != "!=" && token.op != "=" &&
+        token.op != "+=" && token.op != "-=" && token.op != ":=")
+      return false;
+    skip_spaces(false);
+    // "value"
+    if (pos == line.size() || line[pos] != '"')
+      return false;
+    ++pos;
+    while (pos < line.size() && line[pos] != '"') {
+      if (line[pos] == '\\' && pos + 1 < line.size())
+        ++pos;
+      token.value.push_back(line[pos]);
+      ++pos;
+    }
+    if (pos == line.size())
+      return false;
+    ++pos;
+    tokens.push_back(std::move(token));
+  }
+}
+
+void UdevVidPidParser::ProcessLine(std::string_view line) {
+  ++stats_.lines;
+  std::vector<UdevToken> tokens;
+  if (!Tokenize(line, tokens))
+    ++stats_.malformed;
+  for (const UdevToken &token : tokens) {
+    if (token.attr == "idVendor") {
+      StartVendor(token.value);
+    } else if (token.attr == "idProduct" && !vendor_.empty()) {
+      vendor_has_products_ = true;
+      const std::optional<uint16_t> vid = vidpid_table::ParseHex(vendor_);
+      const std::optional<uint16_t> pid = vidpid_table::ParseHex(token.value);
+      if (vid && pid)
+        AddEntry({*vid, *pid, false});
+      else
+        ++stats_.skipped;
+    } else if (token.key == "LABEL") {
+      CloseVendor();
+    }
+  }
+}
+
+void UdevVidPidParser::StartVendor(const std::string &vid) {
+  // the same vendor can be repeated in the rules of the block
+  if (vid == vendor_)
+    return;
+  CloseVendor();
+  vendor_ = vid;
+  if (seen_vendors_.insert(vid).second)
+    ++stats_.vendors;
+}
+
+void UdevVidPidParser::CloseVendor() {
+  if (!vendor_.empty() && !vendor_has_products_) {
+    const std::optional<uint16_t> vid = vidpid_table::ParseHex(vendor_);
+    if (vid)
+      AddEntry({*vid, 0, true});
+    else
+      ++stats_.skipped;
+  }
+  vendor_.clear();
+  vendor_has_products_ = false;
+}
+
+void UdevVidPidParser::AddEntry(const Entry &entry) {
+  const uint32_t key = (static_cast<uint32_t>(entry.vid) << 16) | entry.pid;
+  if (!seen_entries_.emplace(key, entry.any_pid).second) {
+    ++stats_.duplicates;
+    return;
+  }
+  entries_.push_back(entry);
+  if (entry.any_pid)
+    ++stats_.any_pid;
+  else
+    ++stats_.pairs;
+}
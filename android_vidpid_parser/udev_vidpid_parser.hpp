@@ -0,0 +1,76 @@
+#pragma once
+#include "vidpid_table.hpp"
+#include <cstddef>
+#include <istream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// @brief One "KEY{attr}op"value"" token of a udev rule
+struct UdevToken {
+  std::string key;  /// ATTR, ENV, GOTO, LABEL ...
+  std::string attr; /// idVendor, empty if no {attr}
+  std::string op;   /// ==, !=, =, +=, -=, :=
+  std::string value;
+};
+
+/// @brief Counters of a parse pass
+struct UdevParseStats {
+  size_t lines = 0;     /// logical lines (continuations are joined)
+  size_t malformed = 0; /// lines with tokenizer errors
+  size_t vendors = 0;   /// distinct vendor blocks
+  size_t pairs = 0;     /// unique vid:pid pairs
+  size_t any_pid = 0;   /// vendors without products (vid:*)
+  size_t duplicates = 0;
+  size_t skipped = 0; /// ids which are not 4 hex digits, like "4ee?"
+};
+
+/**
+ * @class UdevVidPidParser
+ * @brief Single pass parser for 51-android.rules
+ * @details A vendor block starts with any token with the {idVendor}
+ * attribute and lasts until the next vendor or LABEL. Each {idProduct}
+ * token in the block gives a vid:pid pair, a block without products gives
+ * vid:*. Pairs are deduplicated, the first-seen order is kept.
+ */
+class UdevVidPidParser {
+public:
+  using Entry = common_utils::vidpid_table::Entry;
+
+  /// @brief Parse the whole stream line by line
+  void Parse(std::istream &input);
+
+  /// @brief Feed one physical line, lines ending with '\' are joined
+  void FeedLine(std::string_view line);
+
+  /// @brief Close the last vendor block, must be called after the input
+  void Finish();
+
+  /**
+   * @brief Split a logical udev rule line to tokens
+   * @return false if the line is malformed, tokens contain the tokens
+   * parsed before the error
+   */
+  static bool Tokenize(std::string_view line, std::vector<UdevToken> &tokens);
+
+  inline const std::vector<Entry> &entries() const noexcept {
+    return entries_;
+  }
+  inline const UdevParseStats &stats() const noexcept { return stats_; }
+
+private:
+  void ProcessLine(std::string_view line);
+  void StartVendor(const std::string &vid);
+  void CloseVendor();
+  void AddEntry(const Entry &entry);
+
+  std::string pending_; /// a line with a continuation
+  std::string vendor_;  /// current vendor, empty outside of a block
+  bool vendor_has_products_ = false;
+  std::set<std::string> seen_vendors_;
+  std::set<std::pair<uint32_t, bool>> seen_entries_;
+  std::vector<Entry> entries_;
+  UdevParseStats stats_;
+};
@@ -0,0 +1,105 @@
+#include "android_vidpid.hpp"
+#include "common_utils.hpp"
+#include "log.hpp"
+#include <boost/json.hpp>
+#include <exception>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace guard {
+
+using common_utils::Log;
+namespace vidpid_table = common_utils::vidpid_table;
+
+AndroidVidPid::AndroidVidPid(std::string bin_path,
+                             std::string json_path) noexcept
+    : bin_path_(std::move(bin_path)), json_path_(std::move(json_path)) {}
+
+std::vector<AndroidVidPid::Entry> AndroidVidPid::Load() const {
+  std::optional<std::vector<Entry>> res = LoadBinary(bin_path_);
+  if (!res || res->empty()) {
+    Log::Info() << "[AndroidVidPid] Using " << json_path_;
+    res = LoadJson(json_path_);
+  }
+  if (!res) {
+    throw std::runtime_error("android_vidpid file is missing");
+  }
+  if (res->empty()) {
+    throw std::runtime_error("An empty android_vidpid file");
+  }
+  return std::move(*res);
+}
+
+std::optional<std::vector<AndroidVidPid::Entry>>
+AndroidVidPid::LoadBinary(const std::string &path) noexcept {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  std::optional<std::vector<Entry>> res;
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    const size_t size = file_stat.st_size;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      res = vidpid_table::Parse(static_cast<const unsigned char *>(data),
+                                size);
+      munmap(data, size);
+    }
+  }
+  close(fd);
+  if (!res) {
+    Log::Warning() << "[AndroidVidPid] Bad binary table " << path;
+  }
+  return res;
+}
+
+std::optional<std::vector<AndroidVidPid::Entry>>
+AndroidVidPid::LoadJson(const std::string &path) noexcept {
+  try {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+      Log::Error() << "[AndroidVidPid] Can't open file " << path;
+      return std::nullopt;
+    }
+    std::stringstream buf;
+    buf << file.rdbuf();
+    const boost::json::value json = boost::json::parse(buf.str());
+    const boost::json::array *ptr_arr = json.if_array();
+    if (ptr_arr == nullptr) {
+      Log::Error() << "[AndroidVidPid] Not a JSON array " << path;
+      return std::nullopt;
+    }
+    std::vector<Entry> res;
+    res.reserve(ptr_arr->size());
+    for (const auto &element : *ptr_arr) {
+      const boost::json::object *ptr_obj = element.if_object();
+      if (ptr_obj == nullptr || !ptr_obj->contains("vid") ||
+          !ptr_obj->contains("pid"))
+        continue;
+      const std::string vid =
+          common_utils::UnQuote(ptr_obj->at("vid").as_string().c_str());
+      const std::string pid =
+          common_utils::UnQuote(ptr_obj->at("pid").as_string().c_str());
+      const std::optional<uint16_t> num_vid = vidpid_table::ParseHex(vid);
+      const std::optional<uint16_t> num_pid = vidpid_table::ParseHex(pid);
+      if (!num_vid || (!num_pid && pid != "*")) {
+        Log::Warning() << "[AndroidVidPid] Bad id " << vid << ':' << pid;
+        continue;
+      }
+      res.push_back({*num_vid, num_pid.value_or(0), !num_pid});
+    }
+    return res;
+  } catch (const std::exception &ex) {
+    Log::Error() << "[AndroidVidPid] Can't parse " << path;
+    Log::Error() << ex.what();
+  }
+  return std::nullopt;
+}
+
+} // namespace guard
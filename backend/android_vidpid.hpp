@@ -0,0 +1,48 @@
+#pragma once
+#include "vidpid_table.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace guard {
+
+/**
+ * @class AndroidVidPid
+ * @brief The list of vid:pid pairs of Android devices
+ * @details The list is built by vid_parser. The binary table is mapped to
+ * memory and decoded without any parsing, the JSON file is used only if
+ * the binary table is missing or broken.
+ */
+class AndroidVidPid {
+public:
+  using Entry = common_utils::vidpid_table::Entry;
+
+  /// @param bin_path The binary table
+  /// @param json_path The JSON list, a fallback
+  explicit AndroidVidPid(std::string bin_path = kBinPath,
+                         std::string json_path = kJsonPath) noexcept;
+
+  /**
+   * @brief Load the table
+   * @return Non-empty vector of entries
+   * @throws std::runtime_error if neither file can be read
+   */
+  std::vector<Entry> Load() const;
+
+  /// @brief Read the binary table via mmap
+  static std::optional<std::vector<Entry>>
+  LoadBinary(const std::string &path) noexcept;
+
+  /// @brief Read [{"vid":"xxxx","pid":"xxxx"},...], pid may be "*"
+  static std::optional<std::vector<Entry>>
+  LoadJson(const std::string &path) noexcept;
+
+  static constexpr const char *kBinPath = "/etc/usbguard/android_vidpid.bin";
+  static constexpr const char *kJsonPath = "/etc/usbguard/android_vidpid.json";
+
+private:
+  std::string bin_path_;
+  std::string json_path_;
+};
+
+} // namespace guard
@@ -0,0 +1,265 @@
+#include "base64_stream.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASE64_STREAM_X86
+#endif
+
+namespace guard::utils {
+
+namespace {
+
+constexpr int8_t kPad = -2;
+constexpr int8_t kBad = -1;
+
+/// @brief The vector decoders store up to 8 bytes after the decoded ones
+constexpr size_t kOutputSlack = 8;
+
+constexpr std::array<int8_t, 256> BuildDecodeTable() {
+  std::array<int8_t, 256> res{};
+  for (auto &val : res)
+    val = kBad;
+  const char *alphabet =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  for (int8_t i = 0; i < 64; ++i)
+    res[static_cast<unsigned char>(alphabet[i])] = i;
+  res['='] = kPad;
+  return res;
+}
+
+constexpr std::array<int8_t, 256> kDecodeTable = BuildDecodeTable();
+
+/**
+ * @brief Decode whole groups of alphabet symbols
+ * @param size A multiple of 4
+ * @return The number of decoded symbols, decoding stops at a group with
+ * a symbol out of the alphabet
+ */
+using GroupsDecoder = size_t (*)(const char *input, size_t size, char *out);
+
+size_t DecodeGroupsScalar(const char *input, size_t size, char *out) {
+  size_t pos = 0;
+  for (; pos + 4 <= size; pos += 4, out += 3) {
+    const int8_t val0 = kDecodeTable[static_cast<unsigned char>(input[pos])];
+    const int8_t val1 =
+        kDecodeTable[static_cast<unsigned char>(input[pos + 1])];
+    const int8_t val2 =
+        kDecodeTable[static_cast<unsigned char>(input[pos + 2])];
+    const int8_t val3 =
+        kDecodeTable[static_cast<unsigned char>(input[pos + 3])];
+    // kBad and kPad are negative
+    if ((val0 | val1 | val2 | val3) < 0)
+      break;
+    out[0] = static_cast<char>((val0 << 2) | (val1 >> 4));
+    out[1] = static_cast<char>(((val1 & 0xF) << 4) | (val2 >> 2));
+    out[2] = static_cast<char>(((val2 & 0x3) << 6) | val3);
+  }
+  return pos;
+}
+
+#ifdef BASE64_STREAM_X86
+
+// The vector decoders follow W. Mula and D. Lemire, "Faster Base64 Encoding
+// and Decoding Using AVX2 Instructions". The high and the low nibbles of
+// each symbol select bit masks, a non-zero "and" of them marks a symbol out
+// of the alphabet. The high nibble selects the offset from ASCII to the
+// 6-bit value, '/' is the only symbol which needs a special offset. The
+// 6-bit values are packed by multiply-add and shuffled to 3-byte groups.
+
+__attribute__((target("ssse3"))) size_t
+DecodeGroupsSsse3(const char *input, size_t size, char *out) {
+  const __m128i lut_lo =
+      _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                    0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi =
+      _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0,
+                                         0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2F);
+  const __m128i pack =
+      _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  size_t pos = 0;
+  for (; pos + 16 <= size; pos += 16, out += 12) {
+    __m128i str =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + pos));
+    const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+    const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+    const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+                                         _mm_setzero_si128())) != 0)
+      break;
+    const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+    str = _mm_add_epi8(
+        str, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles)));
+    const __m128i merged =
+        _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+    const __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     _mm_shuffle_epi8(packed, pack));
+  }
+  return pos + DecodeGroupsScalar(input + pos, size - pos, out);
+}
+
+__attribute__((target("avx2"))) size_t
+DecodeGroupsAvx2(const char *input, size_t size, char *out) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+      0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lut_hi = _mm256_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll =
+      _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0,
+                       0, 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0,
+                       0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+  const __m256i pack = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5,
+      4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+  size_t pos = 0;
+  for (; pos + 32 <= size; pos += 32, out += 24) {
+    __m256i str =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + pos));
+    const __m256i hi_nibbles =
+        _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+    const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+    const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    if (!_mm256_testz_si256(lo, hi))
+      break;
+    const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+    str = _mm256_add_epi8(
+        str,
+        _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles)));
+    const __m256i merged =
+        _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+    const __m256i packed =
+        _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(out),
+        _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(packed, pack), lanes));
+  }
+  return pos + DecodeGroupsSsse3(input + pos, size - pos, out);
+}
+
+#endif // BASE64_STREAM_X86
+
+/// @brief The best decoder for the CPU, chosen once
+struct GroupsDecoderInfo {
+  GroupsDecoder decode;
+  const char *name;
+};
+
+const GroupsDecoderInfo &SelectGroupsDecoder() noexcept {
+  static const GroupsDecoderInfo res = []() -> GroupsDecoderInfo {
+#ifdef BASE64_STREAM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      return {DecodeGroupsAvx2, "avx2"};
+    if (__builtin_cpu_supports("ssse3"))
+      return {DecodeGroupsSsse3, "ssse3"};
+#endif
+    return {DecodeGroupsScalar, "scalar"};
+  }();
+  return res;
+}
+
+} // namespace
+
+Base64StreamDecoder::Base64StreamDecoder(Sink sink) noexcept
+    : sink_(std::move(sink)) {
+  out_.reserve(2 * kBlockSize + kOutputSlack);
+}
+
+void Base64StreamDecoder::Write(std::string_view chunk) {
+  size_t pos = 0;
+  while (pos < chunk.size()) {
+    if (quad_size_ == 0 && !finished_ && chunk.size() - pos >= 4) {
+      pos += DecodeGroups(chunk.substr(pos));
+      if (pos == chunk.size())
+        break;
+    }
+    // a line break, a padding, a bad symbol or the end of the chunk
+    const char symbol = chunk[pos++];
+    if (symbol == '\n' || symbol == '\r')
+      continue;
+    if (finished_)
+      throw std::runtime_error("Base64: data after the padding");
+    quad_[quad_size_++] = symbol;
+    if (quad_size_ == quad_.size()) {
+      DecodeQuad(quad_.data());
+      quad_size_ = 0;
+      if (out_.size() >= kBlockSize)
+        Flush();
+    }
+  }
+}
+
+void Base64StreamDecoder::Finish() {
+  if (quad_size_ != 0)
+    throw std::runtime_error("Base64: incomplete input");
+  Flush();
+}
+
+const char *Base64StreamDecoder::implementation() noexcept {
+  return SelectGroupsDecoder().name;
+}
+
+size_t Base64StreamDecoder::DecodeGroups(std::string_view input) {
+  // the kernel stops at a line break or a padding, out_ is grown only for
+  // the groups before it, not by a whole block for every wrapped line
+  std::string_view run = input.substr(0, kBlockSize / 3 * 4);
+  run = run.substr(0, run.find_first_of("\n\r="));
+  const size_t groups = run.size() / 4;
+  if (groups == 0)
+    return 0;
+  const size_t old_size = out_.size();
+  out_.resize(old_size + groups * 3 + kOutputSlack);
+  const size_t res = SelectGroupsDecoder().decode(input.data(), groups * 4,
+                                                  out_.data() + old_size);
+  out_.resize(old_size + res / 4 * 3);
+  if (out_.size() >= kBlockSize)
+    Flush();
+  return res;
+}
+
+void Base64StreamDecoder::DecodeQuad(const char *quad) {
+  int8_t val[4];
+  for (size_t i = 0; i < 4; ++i) {
+    val[i] = kDecodeTable[static_cast<unsigned char>(quad[i])];
+    if (val[i] == kBad)
+      throw std::runtime_error("Base64: invalid symbol");
+  }
+  // "xx==" or "xxx=" may end the input
+  if (val[0] == kPad || val[1] == kPad ||
+      (val[2] == kPad && val[3] != kPad))
+    throw std::runtime_error("Base64: bad padding");
+  out_.push_back(static_cast<char>((val[0] << 2) | (val[1] >> 4)));
+  if (val[2] == kPad) {
+    finished_ = true;
+    return;
+  }
+  out_.push_back(static_cast<char>(((val[1] & 0xF) << 4) | (val[2] >> 2)));
+  if (val[3] == kPad) {
+    finished_ = true;
+    return;
+  }
+  out_.push_back(static_cast<char>(((val[2] & 0x3) << 6) | val[3]));
+}
+
+void Base64StreamDecoder::Flush() {
+  if (out_.empty())
+    return;
+  sink_(out_);
+  out_.clear();
+}
+
+} // namespace guard::utils
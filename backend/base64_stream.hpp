@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace guard::utils {
+
+/**
+ * @class Base64StreamDecoder
+ * @brief Streaming RFC 4648 base64 decoder
+ * @details The input may be split into chunks at any position, the decoded
+ * bytes are passed to the sink in blocks of about kBlockSize bytes.
+ * Line breaks in the input are ignored. Runs of whole groups are decoded
+ * with AVX2 or SSSE3 if the CPU supports them, the rest symbol by symbol.
+ */
+class Base64StreamDecoder {
+public:
+  using Sink = std::function<void(std::string_view)>;
+
+  explicit Base64StreamDecoder(Sink sink) noexcept;
+
+  /**
+   * @brief Decode the next chunk
+   * @throws std::runtime_error if the input is not valid base64
+   */
+  void Write(std::string_view chunk);
+
+  /**
+   * @brief End of the input, flushes the decoded bytes
+   * @throws std::runtime_error if the input is incomplete
+   */
+  void Finish();
+
+  /// @brief Pass the decoded bytes to the sink, an incomplete group is kept
+  void Flush();
+
+  /// @brief Symbols of an incomplete group, waiting for the next chunk
+  inline std::string_view pending() const noexcept {
+    return {quad_.data(), quad_size_};
+  }
+
+  /// @brief true if the padding was found, no more data is expected
+  inline bool finished() const noexcept { return finished_; }
+
+  static constexpr size_t kBlockSize = 16 * 1024;
+
+  /// @brief The decoder used for runs of groups: "avx2", "ssse3" or "scalar"
+  static const char *implementation() noexcept;
+
+private:
+  /// @brief Decode one group of four symbols, appends to out_
+  void DecodeQuad(const char *quad);
+
+  /**
+   * @brief Decode whole groups until a line break, a padding or a bad
+   * symbol, appends to out_
+   * @return The number of decoded symbols
+   */
+  size_t DecodeGroups(std::string_view input);
+
+  Sink sink_;
+  std::array<char, 4> quad_{};
+  size_t quad_size_ = 0;
+  bool finished_ = false; /// padding was found
+  std::string out_;
+};
+
+} // namespace guard::utils
@@ -0,0 +1,234 @@
+#include "change_journal.hpp"
+#include "guard_utils.hpp"
+#include "log.hpp"
+#include <boost/json/parse.hpp>
+#include <boost/json/serialize.hpp>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace guard {
+
+using common_utils::Log;
+namespace json = boost::json;
+
+ChangeJournal::ChangeJournal(const std::string &dir) noexcept
+    : journal_path_(dir + "/journal.json"), lock_path_(dir + "/journal.lock") {
+}
+
+ChangeJournal::~ChangeJournal() noexcept { Unlock(); }
+
+JournalState ChangeJournal::CurrentState(const ConfigStatus &config) noexcept {
+  JournalState res;
+  res.policy = config.implicit_policy();
+  res.daemon_active = config.guard_daemon_active();
+  res.daemon_enabled = config.guard_daemon_enabled();
+  const std::string path = config.rules_file_path();
+  if (path.empty())
+    return res;
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    Log::Warning() << "[ChangeJournal] Can't read " << path;
+    return res;
+  }
+  std::stringstream content;
+  content << file.rdbuf();
+  res.rules = content.str();
+  return res;
+}
+
+bool ChangeJournal::Begin(const JournalState &prev_state,
+                          const JournalState &target_state) noexcept {
+  if (!Lock(true))
+    return false;
+  if (!Write(Record{prev_state, target_state, false})) {
+    Unlock();
+    return false;
+  }
+  prev_state_ = prev_state;
+  return true;
+}
+
+bool ChangeJournal::Commit() noexcept {
+  bool res = true;
+  if (unlink(journal_path_.c_str()) != 0 && errno != ENOENT) {
+    Log::Error() << "[ChangeJournal] Can't remove " << journal_path_ << " "
+                 << std::strerror(errno);
+    res = false;
+  }
+  // make the removal durable
+  const std::string dir =
+      std::filesystem::path(journal_path_).parent_path().string();
+  int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  prev_state_.reset();
+  Unlock();
+  return res;
+}
+
+bool ChangeJournal::Rollback(ConfigStatus &config) noexcept {
+  if (!prev_state_)
+    return false;
+  Log::Warning() << "[ChangeJournal] Rolling back the changes";
+  // the next start must finish the rollback, not replay the failed changes
+  if (!Write(Record{*prev_state_, *prev_state_, true}))
+    Log::Error() << "[ChangeJournal] Can't mark the journal as rolling back";
+  if (!ApplyState(config, *prev_state_, false)) {
+    Log::Error() << "[ChangeJournal] Rollback failed, it will be retried on "
+                    "the next start";
+    prev_state_.reset();
+    Unlock();
+    return false;
+  }
+  return Commit();
+}
+
+bool ChangeJournal::Recover(ConfigStatus &config) noexcept {
+  if (!std::filesystem::exists(journal_path_))
+    return true;
+  // a transaction of a running process is not interrupted
+  if (!Lock(false)) {
+    Log::Info() << "[ChangeJournal] The journal is locked by another process";
+    return true;
+  }
+  std::optional<Record> record = Read();
+  if (!record) {
+    Log::Error() << "[ChangeJournal] The journal is damaged and removed";
+    return Commit();
+  }
+  prev_state_ = record->prev;
+  if (record->rolling_back) {
+    Log::Warning() << "[ChangeJournal] Found an unfinished rollback";
+    return Rollback(config);
+  }
+  Log::Warning() << "[ChangeJournal] Found an unfinished transaction, replay";
+  if (ApplyState(config, record->target, true))
+    return Commit();
+  Log::Warning() << "[ChangeJournal] Replay failed";
+  return Rollback(config);
+}
+
+bool ChangeJournal::Lock(bool wait) noexcept {
+  if (lock_fd_ >= 0)
+    return true;
+  try {
+    std::filesystem::create_directories(
+        std::filesystem::path(lock_path_).parent_path());
+  } catch (const std::exception &ex) {
+    Log::Error() << "[ChangeJournal] " << ex.what();
+    return false;
+  }
+  lock_fd_ = open(lock_path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (lock_fd_ < 0) {
+    Log::Error() << "[ChangeJournal] Can't open " << lock_path_ << " "
+                 << std::strerror(errno);
+    return false;
+  }
+  int res = 0;
+  do {
+    res = flock(lock_fd_, LOCK_EX | (wait ? 0 : LOCK_NB));
+  } while (res != 0 && errno == EINTR);
+  if (res != 0) {
+    if (errno != EWOULDBLOCK)
+      Log::Error() << "[ChangeJournal] Can't lock " << lock_path_ << " "
+                   << std::strerror(errno);
+    close(lock_fd_);
+    lock_fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+void ChangeJournal::Unlock() noexcept {
+  if (lock_fd_ < 0)
+    return;
+  flock(lock_fd_, LOCK_UN);
+  close(lock_fd_);
+  lock_fd_ = -1;
+}
+
+std::optional<ChangeJournal::Record> ChangeJournal::Read() const noexcept {
+  try {
+    std::ifstream file(journal_path_);
+    if (!file.is_open())
+      return std::nullopt;
+    std::stringstream content;
+    content << file.rdbuf();
+    json::value value = json::parse(content.str());
+    const json::object &obj = value.as_object();
+    Record res;
+    res.prev = StateFromJson(obj.at("prev").as_object());
+    res.target = StateFromJson(obj.at("target").as_object());
+    res.rolling_back =
+        obj.contains("rolling_back") && obj.at("rolling_back").as_bool();
+    return res;
+  } catch (const std::exception &ex) {
+    Log::Error() << "[ChangeJournal] Can't read " << journal_path_;
+    Log::Error() << ex.what();
+  }
+  return std::nullopt;
+}
+
+bool ChangeJournal::Write(const Record &record) const noexcept {
+  try {
+    json::object obj;
+    obj["prev"] = StateToJson(record.prev);
+    obj["target"] = StateToJson(record.target);
+    obj["rolling_back"] = record.rolling_back;
+    if (!utils::WriteFileAtomic(journal_path_, json::serialize(obj), false))
+      throw std::runtime_error("Can't write " + journal_path_);
+    return true;
+  } catch (const std::exception &ex) {
+    Log::Error() << "[ChangeJournal] " << ex.what();
+  }
+  return false;
+}
+
+bool ChangeJournal::ApplyState(ConfigStatus &config, const JournalState &state,
+                               bool validate) noexcept {
+  bool res = config.ChangeImplicitPolicy(state.policy == Target::block);
+  if (state.rules) {
+    if (validate) {
+      res = config.OverwriteRulesFile(*state.rules, state.daemon_active) && res;
+    } else if (!config.rules_file_path().empty()) {
+      res = utils::WriteFileAtomic(config.rules_file_path(), *state.rules,
+                                   false) &&
+            res;
+    }
+  }
+  return config.ChangeDaemonStatus(state.daemon_active, state.daemon_enabled) &&
+         res;
+}
+
+json::object ChangeJournal::StateToJson(const JournalState &state) {
+  json::object res;
+  res["policy"] = state.policy == Target::block ? "block" : "allow";
+  if (state.rules)
+    res["rules"] = *state.rules;
+  res["daemon_active"] = state.daemon_active;
+  res["daemon_enabled"] = state.daemon_enabled;
+  return res;
+}
+
+JournalState ChangeJournal::StateFromJson(const json::object &obj) {
+  JournalState res;
+  res.policy =
+      obj.at("policy").as_string() == "block" ? Target::block : Target::allow;
+  if (obj.contains("rules"))
+    res.rules = obj.at("rules").as_string().c_str();
+  res.daemon_active = obj.at("daemon_active").as_bool();
+  res.daemon_enabled = obj.at("daemon_enabled").as_bool();
+  return res;
+}
+
+} // namespace guard
@@ -0,0 +1,126 @@
+#pragma once
+#include "config_status.hpp"
+#include "guard_rule.hpp"
+#include <boost/json.hpp>
+#include <optional>
+#include <string>
+
+#ifdef UNIT_TEST
+#include "test.hpp"
+#endif
+
+namespace guard {
+
+/// @brief The configuration state, recorded in the journal
+struct JournalState {
+  Target policy = Target::allow;
+  std::optional<std::string> rules; /// the rules file content, if known
+  bool daemon_active = false;
+  bool daemon_enabled = false;
+};
+
+/**
+ * @class ChangeJournal
+ * @brief A write-ahead journal for applying rule changes
+ * @details Before the policy, the rules file and the daemon state are
+ * changed, the previous and the target states are written to the journal.
+ * The journal is removed on commit, so a journal found on start means an
+ * interrupted transaction. It is replayed, or rolled back if the replay
+ * fails. A transaction holds an exclusive flock on the lock file, so
+ * concurrent backends apply their changes one by one.
+ */
+class ChangeJournal {
+public:
+  /// @brief Constructor
+  /// @param dir A directory for the journal and the lock file
+  explicit ChangeJournal(const std::string &dir = kDefaultDir) noexcept;
+  ~ChangeJournal() noexcept;
+  ChangeJournal(const ChangeJournal &) = delete;
+  ChangeJournal &operator=(const ChangeJournal &) = delete;
+
+  /**
+   * @brief Get the current state
+   * @param config The current configuration
+   * @return JournalState with the content of the rules file
+   */
+  static JournalState CurrentState(const ConfigStatus &config) noexcept;
+
+  /**
+   * @brief Take the exclusive flock, Begin takes it too if it is not taken
+   * @details Take the lock before the current state is read, so the changes
+   * of another process can't be overwritten.
+   * @param wait Wait for another process to release the lock
+   */
+  bool Lock(bool wait) noexcept;
+
+  /**
+   * @brief Lock the journal and record the transaction
+   * @param prev_state The state before the changes
+   * @param target_state The state to apply
+   * @return false if the journal can't be written, nothing should be changed
+   */
+  bool Begin(const JournalState &prev_state,
+             const JournalState &target_state) noexcept;
+
+  /// @brief Remove the record and unlock the journal
+  bool Commit() noexcept;
+
+  /**
+   * @brief Restore the previous state of the current transaction and commit
+   * @param config The configuration to change
+   * @return false if the previous state can't be restored, the record is
+   * kept for the next start
+   * @details The record is marked as rolling back first, so the next start
+   * finishes the rollback and never replays the failed changes.
+   */
+  bool Rollback(ConfigStatus &config) noexcept;
+
+  /**
+   * @brief Finish an interrupted transaction, if any
+   * @details Skipped if another process holds the lock. An interrupted
+   * rollback is rolled back again.
+   * @param config The configuration to change
+   * @return true if there is no unfinished transaction now
+   */
+  bool Recover(ConfigStatus &config) noexcept;
+
+  static constexpr const char *kDefaultDir = "/var/lib/alterator-usbguard";
+
+private:
+  /// @brief A transaction stored in the journal file
+  struct Record {
+    JournalState prev;
+    JournalState target;
+    bool rolling_back = false; /// the target is the previous state
+  };
+
+  void Unlock() noexcept;
+
+  /// @brief Read the record from the journal file
+  std::optional<Record> Read() const noexcept;
+
+  /// @brief Replace the journal file with the record
+  bool Write(const Record &record) const noexcept;
+
+  /**
+   * @brief Bring the configuration to a state
+   * @param validate Validate the rules and test-run the daemon (replay), or
+   * write the rules as is (rollback)
+   */
+  static bool ApplyState(ConfigStatus &config, const JournalState &state,
+                         bool validate) noexcept;
+
+  static boost::json::object StateToJson(const JournalState &state);
+  static JournalState StateFromJson(const boost::json::object &obj);
+
+  std::string journal_path_;
+  std::string lock_path_;
+  int lock_fd_ = -1;
+  std::optional<JournalState> prev_state_;
+
+#ifdef UNIT_TEST
+  friend class ::Test;
+#endif
+};
+
+} // namespace guard
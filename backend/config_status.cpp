@@ -440,75 +440,93 @@ ConfigStatus::ParseGuardRulesFile() const noexcept {
   return res;
 }
 
-bool ConfigStatus::OverwriteRulesFile(const std::string &new_content,
-                                      bool run_daemon) noexcept {
-  // temporary change the policy to "allow all"
-  // The purpose is to launch USBGuard without blocking anything
-  // to make sure it can parse new rules
-  // bool initial_policy = implicit_policy_target_ == "block";
-  // if (!ChangeImplicitPolicy(false)) {
-  //   Log::Error() << "Can't change usbguard policy";
-  //   return false;
-  // }
-  if (rules_files_exists_) {
-    // read old rules
-    std::ifstream old_file(daemon_rules_file_path);
-    if (!old_file.is_open()) {
-      Log::Error() << "[OverwriteRulesFile] Can't open file "
-                   << daemon_rules_file_path;
-      return false;
+std::optional<std::vector<GuardRule>>
+ConfigStatus::ParseGuardRulesStrict() const noexcept {
+  try {
+    if (std::filesystem::exists(daemon_rules_file_path) &&
+        !std::ifstream(daemon_rules_file_path).is_open()) {
+      Log::Error() << "Can't read the rules file " << daemon_rules_file_path;
+      return std::nullopt;
     }
-    std::stringstream old_content;
-    old_content << old_file.rdbuf();
-    old_file.close();
+  } catch (const std::exception &ex) {
+    Log::Error() << "Can't read the rules file " << daemon_rules_file_path;
+    return std::nullopt;
+  }
+  std::pair<std::vector<GuardRule>, uint> parsed_rules = ParseGuardRulesFile();
+  if (parsed_rules.first.size() != parsed_rules.second) {
+    Log::Error() << "The rules file is not completely parsed";
+    return std::nullopt;
+  }
+  return std::move(parsed_rules.first);
+}
 
-    // write new rules
-    std::ofstream file(daemon_rules_file_path);
-    if (!file.is_open()) {
-      Log::Error() << "Can't open file " << daemon_rules_file_path
-                   << " for writing";
+std::optional<RuleSet> ConfigStatus::ParseGuardRuleSet() const noexcept {
+  std::optional<std::vector<GuardRule>> parsed_rules = ParseGuardRulesStrict();
+  if (!parsed_rules)
+    return std::nullopt;
+  try {
+    return RuleSet(std::move(*parsed_rules));
+  } catch (const std::exception &ex) {
+    Log::Error() << "Can't build the rule set";
+    Log::Error() << ex.what();
+  }
+  return std::nullopt;
+}
+
+bool ConfigStatus::ValidateRulesContent(const std::string &content) noexcept {
+  std::istringstream stream(content);
+  std::string line;
+  size_t counter = 0;
+  while (std::getline(stream, line)) {
+    try {
+      GuardRule rule(line);
+    } catch (const std::logic_error &ex) {
+      Log::Error() << "[ValidateRulesContent] Can't parse the rule " << counter
+                   << " " << line;
       return false;
     }
-    file << new_content;
-    file.close();
-    // parse new rules
-    // if (!new_content.empty()) {
-    auto parsed_new_file = ParseGuardRulesFile();
-    // If some errors occurred while parsing new rules - recover
-    if (parsed_new_file.first.size() != parsed_new_file.second ||
-        !TryToRun(run_daemon)) {
-      Log::Error() << "[OverwriteRulesFile] Error parsing new rules,old file "
-                      "will be recovered";
-      std::ofstream file3(daemon_rules_file_path);
-      if (!file3.is_open()) {
-        Log::Error() << "[OverwriteRulesFile] Can't open file "
-                     << daemon_rules_file_path << " for writing";
-        return false;
-      }
-      file3 << old_content.str();
-      file3.close();
-      dbus_bindings::Systemd sysd;
-      // try to run with recovered rules
-      if (!TryToRun(run_daemon)) {
-        Log::Error() << "[OverwriteRulesFile] Can't start usbguard service. "
-                        "UsbGuard will be disabled";
-        ChangeImplicitPolicy(false);
-        // TryToRun(false);
-        ChangeDaemonStatus(false, false);
-      }
+    ++counter;
+    line.clear();
+  }
+  return true;
+}
+
+bool ConfigStatus::OverwriteRulesFile(const std::string &new_content,
+                                      bool run_daemon) noexcept {
+  // validate in memory before touching the disk
+  if (!ValidateRulesContent(new_content)) {
+    Log::Error() << "[OverwriteRulesFile] New rules are not valid, the rules "
+                    "file is not changed";
+    return false;
+  }
+  if (!rules_files_exists_)
+    return true;
+  if (!utils::WriteFileAtomic(daemon_rules_file_path, new_content, true)) {
+    Log::Error() << "[OverwriteRulesFile] Can't write file "
+                 << daemon_rules_file_path;
+    return false;
+  }
+  // The rules are validated in memory, no need to start the daemon
+  // just to check the syntax. A stopped daemon reads the file on start.
+  if (!run_daemon)
+    return true;
+  if (!TryToRun(run_daemon)) {
+    Log::Error() << "[OverwriteRulesFile] USBGuard can't start with new "
+                    "rules, old file will be recovered";
+    if (!utils::RestoreFileBackup(daemon_rules_file_path)) {
+      Log::Error() << "[OverwriteRulesFile] Can't recover file "
+                   << daemon_rules_file_path;
       return false;
     }
-    //}
+    // try to run with recovered rules
+    if (!TryToRun(run_daemon)) {
+      Log::Error() << "[OverwriteRulesFile] Can't start usbguard service. "
+                      "UsbGuard will be disabled";
+      ChangeImplicitPolicy(false);
+      ChangeDaemonStatus(false, false);
+    }
+    return false;
   }
-
-  // restore the policy
-  // if (!ChangeImplicitPolicy(initial_policy)) {
-  //   Log::Error() << "Can't change usbguard policy";
-  //   return false;
-  // // }
-  // if (run_daemon)
-  //  TryToRun(run_daemon);
-
   return true;
 }
 
@@ -695,14 +713,11 @@ bool ConfigStatus::ChangeImplicitPolicy(bool block) noexcept {
   }
   file_config.close();
   // write to config
-  std::ofstream f_out(daemon_config_file_path_);
-  if (!f_out.is_open()) {
-    Log::Error() << "Can't open file " << daemon_config_file_path_
-                 << " for writing";
+  if (!utils::WriteFileAtomic(daemon_config_file_path_, new_content.str(),
+                              false)) {
+    Log::Error() << "Can't write file " << daemon_config_file_path_;
     return false;
   }
-  f_out << new_content.str();
-  f_out.close();
   ParseDaemonConfig();
   return true;
 }
@@ -2,6 +2,7 @@
 
 #include "guard_audit.hpp"
 #include "guard_rule.hpp"
+#include "rule_set.hpp"
 #include "serializable_for_lisp.hpp"
 #include "systemd_dbus.hpp"
 #include "types.hpp"
@@ -36,8 +37,24 @@ public:
    */
   std::pair<std::vector<GuardRule>, uint> ParseGuardRulesFile() const noexcept;
 
+  /**
+   * @brief Parses usbguard rules.conf file completely
+   * @return std::nullopt if the file can't be read or some lines can't be
+   * parsed, no rules if there is no file
+   */
+  std::optional<std::vector<GuardRule>> ParseGuardRulesStrict() const noexcept;
+
+  /**
+   * @brief Parses usbguard rules.conf file to an indexed rule set
+   * @return std::nullopt if some lines can't be parsed
+   */
+  std::optional<RuleSet> ParseGuardRuleSet() const noexcept;
+
   /**
    * @brief Overwrite rules file, recover if USBGuard fails to srart
+   * @details The content is validated before the file is touched. The file
+   * is replaced atomically, the previous version is kept as a .bak file
+   * and restored if USBGuard can't start with the new rules.
    *
    * @param new_content New content of file
    * @param run_daemon Leave USBGuard running
@@ -99,6 +116,11 @@ public:
     return udev_warnings_;
   }
 
+  /// @brief Path to the rules file, empty if the file doesn't exist
+  inline std::string rules_file_path() const noexcept {
+    return rules_files_exists_ ? daemon_rules_file_path : std::string();
+  }
+
   inline Target implicit_policy() const noexcept {
     return implicit_policy_target_ == "block" ? Target::block : Target::allow;
   }
@@ -110,6 +132,13 @@ private:
   /// /lib/systemd/system
   std::string GetDaemonConfigPath() const noexcept;
 
+  /**
+   * @brief Check that every line of a rules file content is a valid rule
+   * @param content Content of a rules file
+   * @return true if all lines can be parsed
+   */
+  static bool ValidateRulesContent(const std::string &content) noexcept;
+
   /**
    * @brief Parses usbguard .conf file.
    * @details Looks for rules-file path.
@@ -0,0 +1,51 @@
+#include "csv_row_reader.hpp"
+#include <stdexcept>
+
+namespace guard::utils::csv {
+
+CsvRowReader::CsvRowReader(RowHandler handler, char separator) noexcept
+    : handler_(std::move(handler)), separator_(separator) {}
+
+void CsvRowReader::Write(std::string_view chunk) {
+  while (!chunk.empty()) {
+    const size_t line_end = chunk.find('\n');
+    const std::string_view part = chunk.substr(0, line_end);
+    if (line_.size() + part.size() > kMaxRowSize)
+      throw std::runtime_error("CSV row is too long");
+    line_.append(part);
+    if (line_end == std::string_view::npos)
+      return;
+    EmitRow();
+    ++lines_;
+    chunk.remove_prefix(line_end + 1);
+  }
+}
+
+void CsvRowReader::Finish() { EmitRow(); }
+
+void CsvRowReader::EmitRow() {
+  if (!line_.empty() && line_.back() == '\r')
+    line_.pop_back();
+  if (line_.empty())
+    return;
+  // reuse the strings of the previous row
+  size_t n_cells = 0;
+  size_t cell_begin = 0;
+  while (true) {
+    const size_t cell_end = line_.find(separator_, cell_begin);
+    if (row_.size() <= n_cells)
+      row_.emplace_back();
+    row_[n_cells++].assign(line_, cell_begin,
+                           cell_end == std::string::npos
+                               ? std::string::npos
+                               : cell_end - cell_begin);
+    if (cell_end == std::string::npos)
+      break;
+    cell_begin = cell_end + 1;
+  }
+  row_.resize(n_cells);
+  line_.clear();
+  handler_(row_, rows_++, lines_);
+}
+
+} // namespace guard::utils::csv
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace guard::utils::csv {
+
+/**
+ * @class CsvRowReader
+ * @brief Splits a streamed CSV text into rows
+ * @details The text comes from Utf8Filter, which removes quotes, so the
+ * cells are just split by the separator. Empty lines are skipped, "\r\n"
+ * line ends are accepted. Only the current row is kept in memory.
+ */
+class CsvRowReader {
+public:
+  /**
+   * @brief Called for each row, the row can be moved from
+   * @details index counts the rows, line counts all lines of the text
+   * including the empty ones, both from 0
+   */
+  using RowHandler = std::function<void(std::vector<std::string> &row,
+                                        size_t index, size_t line)>;
+
+  explicit CsvRowReader(RowHandler handler, char separator = ',') noexcept;
+
+  /**
+   * @brief Read the next chunk, complete rows are passed to the handler
+   * @throws std::runtime_error if a row is longer than kMaxRowSize
+   */
+  void Write(std::string_view chunk);
+
+  /// @brief End of the input, the last row may have no line end
+  void Finish();
+
+  /// @brief Number of rows passed to the handler
+  inline size_t rows() const noexcept { return rows_; }
+
+  static constexpr size_t kMaxRowSize = 64 * 1024;
+
+private:
+  void EmitRow();
+
+  RowHandler handler_;
+  char separator_;
+  std::string line_;
+  std::vector<std::string> row_;
+  size_t rows_ = 0;
+  size_t lines_ = 0; /// complete lines read
+};
+
+} // namespace guard::utils::csv
@@ -1,27 +1,30 @@
 #include "csv_rule.hpp"
 #include "common_utils.hpp"
+#include "guard_rule_builder.hpp"
 #include "log.hpp"
 #include <cstddef>
 #include <stdexcept>
 
 namespace guard::utils::csv {
 
-CsvRule::CsvRule(rapidcsv::Document &doc, size_t index) {
-  std::vector<std::string> row = doc.GetRow<std::string>(index);
+CsvRule::CsvRule(rapidcsv::Document &doc, size_t index)
+    : CsvRule(doc.GetRow<std::string>(index)) {}
+
+CsvRule::CsvRule(std::vector<std::string> row) {
   size_t n_cols = row.size();
   if (row.size() < 2)
-    throw std::logic_error("Empty csv row");
+    throw CsvRuleError("Empty csv row", CsvColumn::target);
   target_ = std::move(row[0]);
   if (target_.empty())
-    throw std::logic_error("Empty rule target");
+    throw CsvRuleError("Empty rule target", CsvColumn::target);
   if (n_cols >= 2)
-    interface_ = row[1];
+    interface_ = std::move(row[1]);
   if (n_cols >= 3)
-    vidpid_ = row[2];
+    vidpid_ = std::move(row[2]);
   if (n_cols >= 4)
-    hash_ = row[3];
+    hash_ = std::move(row[3]);
   if (interface_.empty() && vidpid_.empty() && hash_.empty())
-    throw std::logic_error("Empty csv row");
+    throw CsvRuleError("Empty csv row", CsvColumn::interface);
 }
 
 std::string CsvRule::BuildString() const noexcept {
@@ -36,4 +39,24 @@ std::string CsvRule::BuildString() const noexcept {
   return string_builder.str();
 }
 
+GuardRule CsvRule::Build() const {
+  // the column, which is being checked
+  CsvColumn column = CsvColumn::target;
+  try {
+    GuardRuleBuilder builder(target_);
+    column = CsvColumn::vidpid;
+    if (!vidpid_.empty())
+      builder.Id(vidpid_);
+    column = CsvColumn::hash;
+    if (!hash_.empty())
+      builder.Hash(hash_);
+    column = CsvColumn::interface;
+    if (!interface_.empty())
+      builder.Interfaces(interface_);
+    return builder.Build();
+  } catch (const std::logic_error &ex) {
+    throw CsvRuleError(ex.what(), column);
+  }
+}
+
 } // namespace guard::utils::csv
\ No newline at end of file
@@ -1,14 +1,46 @@
 #pragma once
+#include "guard_rule.hpp"
 #include "rapidcsv.h"
+#include <cstddef>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace guard::utils::csv {
 
+/// @brief Columns of a csv rules file
+enum class CsvColumn { target, interface, vidpid, hash };
+
+/// @brief An error in a csv row, with the column it was found in
+class CsvRuleError : public std::logic_error {
+public:
+  CsvRuleError(const std::string &what, CsvColumn column)
+      : std::logic_error(what), column_(column) {}
+
+  inline CsvColumn column() const noexcept { return column_; }
+
+private:
+  CsvColumn column_;
+};
+
 class CsvRule {
 public:
   explicit CsvRule(rapidcsv::Document &doc, size_t index);
+
+  /**
+   * @brief Construct from the cells of a row
+   * @details target, interface, vid:pid, hash
+   * @throws CsvRuleError
+   */
+  explicit CsvRule(std::vector<std::string> row);
   std::string BuildString() const noexcept;
 
+  /**
+   * @brief Build the rule from the columns, without a rule string
+   * @throws CsvRuleError
+   */
+  GuardRule Build() const;
+
 private:
   std::string target_;
   std::string interface_;
@@ -0,0 +1,216 @@
+#include "device_inventory.hpp"
+#include "guard_utils.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <exception>
+#include <iterator>
+#include <utility>
+
+namespace guard {
+
+using common_utils::Log;
+
+void DeviceInventory::Reset(const std::vector<usbguard::Rule> &devices,
+                            uint64_t base_version) noexcept {
+  std::vector<UsbDevice> new_devices;
+  std::vector<uint32_t> ids;
+  try {
+    new_devices.reserve(devices.size());
+    ids.reserve(devices.size());
+    for (const usbguard::Rule &rule : devices) {
+      new_devices.push_back(BuildDevice(rule.getRuleID(), rule));
+      ids.push_back(rule.getRuleID());
+    }
+    FillVendorNames(new_devices);
+  } catch (const std::exception &ex) {
+    Log::Error() << "[DeviceInventory] Can't build the device list";
+    Log::Error() << ex.what();
+    Invalidate();
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++version_;
+  // changes received by signals after listDevices was called are newer
+  for (auto it = devices_.begin(); it != devices_.end();) {
+    it = it->second.version > base_version ? std::next(it) : devices_.erase(it);
+  }
+  for (size_t i = 0; i < new_devices.size(); ++i) {
+    auto it_removed = removed_.find(ids[i]);
+    if (devices_.count(ids[i]) != 0 ||
+        (it_removed != removed_.end() && it_removed->second > base_version))
+      continue;
+    devices_.emplace(ids[i], Entry{std::move(new_devices[i]), version_});
+  }
+  removed_.clear();
+  horizon_ = version_;
+  valid_ = true;
+}
+
+void DeviceInventory::Update(uint32_t id,
+                             const usbguard::Rule &device_rule) noexcept {
+  try {
+    std::vector<UsbDevice> device{BuildDevice(id, device_rule)};
+    FillVendorNames(device);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++version_;
+    removed_.erase(id);
+    devices_.erase(id);
+    devices_.emplace(id, Entry{std::move(device.front()), version_});
+  } catch (const std::exception &ex) {
+    Log::Error() << "[DeviceInventory] Can't update the device " << id;
+    Log::Error() << ex.what();
+    Invalidate();
+  }
+}
+
+void DeviceInventory::Remove(uint32_t id) noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++version_;
+  devices_.erase(id);
+  removed_[id] = version_;
+  // forget the oldest removals
+  while (removed_.size() > kMaxRemoved) {
+    auto it_oldest = std::min_element(removed_.cbegin(), removed_.cend(),
+                                      [](const auto &lhs, const auto &rhs) {
+                                        return lhs.second < rhs.second;
+                                      });
+    horizon_ = std::max(horizon_, it_oldest->second);
+    removed_.erase(it_oldest);
+  }
+}
+
+void DeviceInventory::Invalidate() noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  valid_ = false;
+}
+
+std::vector<UsbDevice> DeviceInventory::Devices() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<UsbDevice> res;
+  res.reserve(devices_.size());
+  for (const auto &[id, entry] : devices_) {
+    res.push_back(entry.device);
+  }
+  return res;
+}
+
+DeviceInventory::Delta DeviceInventory::ChangesSince(uint64_t version) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Delta res;
+  res.version = version_;
+  res.full = version < horizon_ || version > version_;
+  for (const auto &[id, entry] : devices_) {
+    if (res.full || entry.version > version)
+      res.devices.push_back(entry.device);
+  }
+  if (res.full)
+    return res;
+  for (const auto &[id, removed_version] : removed_) {
+    if (removed_version > version)
+      res.removed.push_back(id);
+  }
+  return res;
+}
+
+bool DeviceInventory::valid() const noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return valid_;
+}
+
+uint64_t DeviceInventory::version() const noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return version_;
+}
+
+UsbDevice DeviceInventory::BuildDevice(uint32_t id,
+                                       const usbguard::Rule &device_rule) {
+  std::vector<std::string> vid_pid;
+  boost::split(vid_pid, device_rule.getDeviceID().toString(),
+               [](const char symbol) { return symbol == ':'; });
+  UsbDevice::DeviceData dev_data{
+      id,
+      usbguard::Rule::targetToString(device_rule.getTarget()),
+      device_rule.getName(),
+      !vid_pid.empty() ? vid_pid[0] : "",
+      vid_pid.size() > 1 ? vid_pid[1] : "",
+      device_rule.getViaPort(),
+      device_rule.getWithConnectType(),
+      device_rule.attributeWithInterface().toRuleString(),
+      device_rule.getSerial(),
+      device_rule.getHash(),
+      device_rule.getParentHash(),
+      ""};
+  return UsbDevice(dev_data);
+}
+
+void DeviceInventory::FillVendorNames(
+    std::vector<UsbDevice> &devices) noexcept {
+  std::unordered_set<std::string> unknown;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const UsbDevice &usb : devices) {
+      if (vendor_names_.count(usb.vid()) == 0)
+        unknown.insert(usb.vid());
+    }
+  }
+  // usb.ids is scanned without the lock, only for new vendors
+  std::unordered_map<std::string, std::string> found;
+  if (!unknown.empty())
+    found = utils::MapVendorCodesToNames(unknown);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::string &vid : unknown) {
+    auto it_found = found.find(vid);
+    vendor_names_[vid] = it_found != found.end() ? it_found->second : "";
+  }
+  for (UsbDevice &usb : devices) {
+    usb.vendor_name(vendor_names_[usb.vid()]);
+  }
+}
+
+/*-------------------------------------------------------------------------*/
+
+InventoryIpcClient::InventoryIpcClient(DeviceInventory &inventory)
+    : usbguard::IPCClient(false), inventory_(inventory) {}
+
+void InventoryIpcClient::DevicePresenceChanged(
+    uint32_t id, usbguard::DeviceManager::EventType event,
+    usbguard::Rule::Target target, const std::string &device_rule) {
+  try {
+    if (event == usbguard::DeviceManager::EventType::Remove) {
+      inventory_.Remove(id);
+      return;
+    }
+    usbguard::Rule rule = usbguard::Rule::fromString(device_rule);
+    rule.setTarget(target);
+    inventory_.Update(id, rule);
+  } catch (const std::exception &ex) {
+    Log::Error() << "[InventoryIpcClient] Can't parse the device rule";
+    Log::Error() << ex.what();
+    inventory_.Invalidate();
+  }
+}
+
+void InventoryIpcClient::DevicePolicyChanged(
+    uint32_t id, [[maybe_unused]] usbguard::Rule::Target target_old,
+    usbguard::Rule::Target target_new, const std::string &device_rule,
+    [[maybe_unused]] uint32_t rule_id) {
+  try {
+    usbguard::Rule rule = usbguard::Rule::fromString(device_rule);
+    rule.setTarget(target_new);
+    inventory_.Update(id, rule);
+  } catch (const std::exception &ex) {
+    Log::Error() << "[InventoryIpcClient] Can't parse the device rule";
+    Log::Error() << ex.what();
+    inventory_.Invalidate();
+  }
+}
+
+void InventoryIpcClient::IPCDisconnected(
+    [[maybe_unused]] bool exception_initiated,
+    [[maybe_unused]] const usbguard::IPCException &exception) {
+  Log::Warning() << "[InventoryIpcClient] Disconnected from USBGuard";
+  inventory_.Invalidate();
+}
+
+} // namespace guard
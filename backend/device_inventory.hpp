@@ -0,0 +1,133 @@
+#pragma once
+#include "usb_device.hpp"
+#include <IPCClient.hpp>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef UNIT_TEST
+#include "test.hpp"
+#endif
+
+namespace guard {
+
+/**
+ * @class DeviceInventory
+ * @brief An in-process table of the connected devices
+ * @details The table is filled once with IPCClient::listDevices and then
+ * updated by the daemon signals, so listing the devices is a memory read.
+ * Every change increments the version, a client can ask for the changes
+ * since the version it knows. Methods are thread-safe, the signals are
+ * delivered by the IPC thread.
+ */
+class DeviceInventory {
+public:
+  /// @brief Changes since a version
+  struct Delta {
+    uint64_t version = 0; /// the current version
+    bool full = true; /// the changes are unknown, devices is the full list
+    std::vector<UsbDevice> devices; /// added or changed devices
+    std::vector<uint32_t> removed;  /// ids of removed devices
+  };
+
+  /**
+   * @brief Replace the table with the list received from the daemon
+   * @param devices The result of IPCClient::listDevices
+   * @param base_version The version before listDevices was called, newer
+   * changes received by signals are kept
+   */
+  void Reset(const std::vector<usbguard::Rule> &devices,
+             uint64_t base_version) noexcept;
+
+  /// @brief Add or update a device
+  void Update(uint32_t id, const usbguard::Rule &device_rule) noexcept;
+
+  /// @brief Remove a device
+  void Remove(uint32_t id) noexcept;
+
+  /// @brief Mark the table as outdated, for example if IPC was disconnected
+  void Invalidate() noexcept;
+
+  /// @brief All devices
+  std::vector<UsbDevice> Devices() const;
+
+  /// @brief Changes since the version
+  Delta ChangesSince(uint64_t version) const;
+
+  /// @brief true if the table is filled and follows the daemon signals
+  bool valid() const noexcept;
+
+  /// @brief The current version
+  uint64_t version() const noexcept;
+
+  /**
+   * @brief Build UsbDevice from a device rule
+   * @param id The device id
+   * @param device_rule A device rule, received from the daemon
+   * @return UsbDevice without a vendor name
+   */
+  static UsbDevice BuildDevice(uint32_t id, const usbguard::Rule &device_rule);
+
+private:
+  /// @brief A device and the version of its last change
+  struct Entry {
+    UsbDevice device;
+    uint64_t version = 0;
+  };
+
+  /// @brief Fill vendor names from the cache, scan usb.ids for unknown ones
+  void FillVendorNames(std::vector<UsbDevice> &devices) noexcept;
+
+  /// Maximal number of removed device ids kept for ChangesSince
+  static constexpr size_t kMaxRemoved = 256;
+
+  mutable std::mutex mutex_;
+  std::map<uint32_t, Entry> devices_;
+  /// id : version of the removal
+  std::map<uint32_t, uint64_t> removed_;
+  /// vid : vendor name, also contains vids absent in usb.ids
+  std::unordered_map<std::string, std::string> vendor_names_;
+  uint64_t version_ = 0;
+  /// changes made before this version are unknown
+  uint64_t horizon_ = 0;
+  bool valid_ = false;
+
+#ifdef UNIT_TEST
+  friend class ::Test;
+#endif
+};
+
+/**
+ * @class InventoryIpcClient
+ * @brief USBGuard IPC client, feeding a DeviceInventory with device signals
+ */
+class InventoryIpcClient : public usbguard::IPCClient {
+public:
+  /**
+   * @brief Constructor, the client is not connected
+   * @param inventory The inventory must outlive the client
+   */
+  explicit InventoryIpcClient(DeviceInventory &inventory);
+
+  void DevicePresenceChanged(uint32_t id,
+                             usbguard::DeviceManager::EventType event,
+                             usbguard::Rule::Target target,
+                             const std::string &device_rule) override;
+
+  void DevicePolicyChanged(uint32_t id, usbguard::Rule::Target target_old,
+                           usbguard::Rule::Target target_new,
+                           const std::string &device_rule,
+                           uint32_t rule_id) override;
+
+  void IPCDisconnected(bool exception_initiated,
+                       const usbguard::IPCException &exception) override;
+
+private:
+  DeviceInventory &inventory_;
+};
+
+} // namespace guard
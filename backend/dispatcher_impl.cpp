@@ -3,8 +3,16 @@
 #include "guard.hpp"
 #include "guard_utils.hpp"
 #include "log.hpp"
+#include "rule_analyzer.hpp"
+#include "rule_evaluator.hpp"
+#include "rule_exporter.hpp"
 #include <algorithm>
+#include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/json.hpp>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
 
 namespace guard {
 
@@ -17,6 +25,22 @@ bool DispatcherImpl::Dispatch(const LispMessage &msg) const noexcept {
   if (msg.action == "list" && msg.objects == "list_curr_usbs") {
     return ListUsbDevices();
   }
+  // changes of usbs since a version
+  if (msg.action == "read" && msg.objects == "list_curr_usbs_changes") {
+    return ListUsbDevicesChanges(msg);
+  }
+  // tree of connected usbs, read from sysfs
+  if (msg.action == "read" && msg.objects == "usb_topology") {
+    return ListUsbTopology();
+  }
+  // rules applied to connected usbs, predicted from the rules file
+  if (msg.action == "read" && msg.objects == "rules_preview") {
+    return PreviewRules();
+  }
+  // duplicated and never firing rules
+  if (msg.action == "read" && msg.objects == "rules_analysis") {
+    return AnalyzeRules();
+  }
   // allow device with id
   if (msg.action == "read" && msg.objects == "usb_allow") {
     return AllowDevice(msg);
@@ -25,6 +49,10 @@ bool DispatcherImpl::Dispatch(const LispMessage &msg) const noexcept {
   if (msg.action == "read" && msg.objects == "usb_block") {
     return BlockDevice(msg);
   }
+  // allow or block many devices
+  if (msg.action == "read" && msg.objects == "usb_bulk_policy") {
+    return AllowOrBlockDevices(msg);
+  }
   // get udev rules list
   if (msg.action == "list" && msg.objects == "check_config_udev") {
     return CheckConfig();
@@ -35,6 +63,10 @@ bool DispatcherImpl::Dispatch(const LispMessage &msg) const noexcept {
     std::cout << ToLispAssoc(guard_.GetConfigStatus());
     return true;
   }
+  // IPC connection statistics
+  if (msg.action == "read" && msg.objects == "ipc_stats") {
+    return IpcStats();
+  }
   // list usbguard rules
   if (msg.action == "list" && msg.objects == "list_rules" &&
       msg.params.count("level") > 0) {
@@ -55,6 +87,25 @@ bool DispatcherImpl::Dispatch(const LispMessage &msg) const noexcept {
     return UploadRulesFile(msg);
   }
 
+  // chunked upload of a rules file
+  if (msg.action == "read" && msg.objects == "rules_upload_begin") {
+    return UploadRulesBegin();
+  }
+  if (msg.action == "read" && msg.objects == "rules_upload_chunk") {
+    return UploadRulesChunk(msg);
+  }
+  if (msg.action == "read" && msg.objects == "rules_upload_status") {
+    return UploadRulesStatus(msg);
+  }
+  if (msg.action == "read" && msg.objects == "rules_upload_commit") {
+    return UploadRulesCommit(msg);
+  }
+
+  // export rules as csv or ndjson
+  if (msg.action == "read" && msg.objects == "rules_export") {
+    return ExportRules(msg);
+  }
+
   // read logs
   if (msg.action == "read" && msg.objects == "read_log") {
     return ReadUsbGuardLogs(msg);
@@ -121,12 +172,98 @@ bool DispatcherImpl::UploadRulesFile(const LispMessage &msg) noexcept {
     Log::Warning() << "Empty rules file";
     return true;
   }
-  std::optional<std::vector<guard::GuardRule>> vec_rules =
-      utils::UploadRulesCsv(msg.params.at("upload_rules"));
+  PrintUploadResult(utils::UploadRulesCsv(msg.params.at("upload_rules")));
+  Log::Debug() << "Elapsed(ms)=" << since(start).count();
+  return true;
+}
+
+bool DispatcherImpl::UploadRulesBegin() const noexcept {
+  vecPairs vec_result;
+  std::optional<std::string> upload_id = upload_spool_.Begin();
+  vec_result.emplace_back("status", upload_id ? "OK" : "BAD");
+  vec_result.emplace_back("upload_id", upload_id.value_or(""));
+  std::cout << ToLispAssoc(
+      SerializableForLisp<vecPairs>(std::move(vec_result)));
+  return true;
+}
+
+bool DispatcherImpl::UploadRulesChunk(const LispMessage &msg) const noexcept {
+  std::optional<uint32_t> offset;
+  if (msg.params.count("offset") > 0)
+    offset = StrToUint(msg.params.at("offset"));
+  const std::string upload_id = msg.params.count("upload_id") > 0
+                                    ? msg.params.at("upload_id")
+                                    : std::string();
+  std::string status = "BAD";
+  if (!offset || msg.params.count("chunk") == 0) {
+    Log::Error() << "Wrong parameters for an upload chunk";
+  } else if (upload_spool_.Append(upload_id, *offset,
+                                  msg.params.at("chunk"))) {
+    status = "OK";
+  } else {
+    // the client continues from the received position
+    status = "BAD_OFFSET";
+  }
+  std::optional<UploadProgress> progress = upload_spool_.Progress(upload_id);
+  vecPairs vec_result;
+  vec_result.emplace_back("status", progress ? status : "BAD");
+  vec_result.emplace_back(
+      "received", std::to_string(progress.value_or(UploadProgress{}).received));
+  std::cout << ToLispAssoc(
+      SerializableForLisp<vecPairs>(std::move(vec_result)));
+  return true;
+}
+
+bool DispatcherImpl::UploadRulesStatus(const LispMessage &msg) const noexcept {
+  vecPairs vec_result;
+  std::optional<UploadProgress> progress;
+  if (msg.params.count("upload_id") > 0)
+    progress = upload_spool_.Progress(msg.params.at("upload_id"));
+  vec_result.emplace_back("status", progress ? "OK" : "BAD");
+  vec_result.emplace_back(
+      "received", std::to_string(progress.value_or(UploadProgress{}).received));
+  vec_result.emplace_back(
+      "size", std::to_string(progress.value_or(UploadProgress{}).size));
+  std::cout << ToLispAssoc(
+      SerializableForLisp<vecPairs>(std::move(vec_result)));
+  return true;
+}
+
+bool DispatcherImpl::UploadRulesCommit(const LispMessage &msg) const noexcept {
+  auto start = std::chrono::steady_clock::now();
+  std::optional<uint32_t> size;
+  if (msg.params.count("size") > 0)
+    size = StrToUint(msg.params.at("size"));
+  if (msg.params.count("upload_id") == 0 || !size) {
+    Log::Error() << "Wrong parameters for an upload commit";
+    PrintUploadResult(std::nullopt);
+    return true;
+  }
+  PrintUploadResult(upload_spool_.Commit(msg.params.at("upload_id"), *size));
+  Log::Debug() << "Elapsed(ms)=" << since(start).count();
+  return true;
+}
+
+void DispatcherImpl::PrintUploadResult(
+    const std::optional<utils::CsvUploadResult> &upload) noexcept {
   Log::Debug() << "Rules parsed";
-  if (vec_rules.has_value() && !vec_rules->empty()) {
-    std::optional<std::string> js_arr = guard::utils::BuildJsonArrayOfUpploaded(
-        vec_rules.value_or(std::vector<guard::GuardRule>()));
+  if (upload.has_value() && upload->failed_rows != 0) {
+    vecPairs vec_result;
+    vec_result.emplace_back("status", "BAD_ROWS");
+    vec_result.emplace_back("err_what",
+                            std::to_string(upload->failed_rows) + " of " +
+                                std::to_string(upload->rows) +
+                                " rows failed");
+    vec_result.emplace_back(
+        "rows_errors", EscapeQuotes(boost::json::serialize(
+                           utils::BuildJsonArrayOfRowErrors(upload->errors))));
+    std::cout << ToLispAssoc(
+        SerializableForLisp<vecPairs>(std::move(vec_result)));
+    return;
+  }
+  if (upload.has_value() && !upload->rules.empty()) {
+    std::optional<std::string> js_arr =
+        guard::utils::BuildJsonArrayOfUpploaded(upload->rules);
     // Log::Debug() << js_arr.value_or("no json arr");
     vecPairs vec_result;
     if (js_arr.has_value()) {
@@ -139,10 +276,9 @@ bool DispatcherImpl::UploadRulesFile(const LispMessage &msg) noexcept {
       vec_result.emplace_back("status", "BAD");
       vec_result.emplace_back("err_what", "0 parsed");
     }
-    Log::Debug() << "Elapsed(ms)=" << since(start).count();
     std::cout << ToLispAssoc(
         SerializableForLisp<vecPairs>(std::move(vec_result)));
-    return true;
+    return;
   }
   Log::Error() << "Empty rules list";
   vecPairs vec_result;
@@ -150,8 +286,6 @@ bool DispatcherImpl::UploadRulesFile(const LispMessage &msg) noexcept {
   vec_result.emplace_back("err_what", "0 parsed");
   std::cout << ToLispAssoc(
       SerializableForLisp<vecPairs>(std::move(vec_result)));
-  Log::Debug() << "Elapsed(ms)=" << since(start).count();
-  return true;
 }
 
 bool DispatcherImpl::SaveChangeRules(const LispMessage &msg,
@@ -195,18 +329,7 @@ bool DispatcherImpl::ListUsbGuardRules(const LispMessage &msg) const noexcept {
   std::string response;
   // map vendor ids to strings
   if (level == guard::StrictnessLevel::vid_pid) {
-    std::unordered_set<std::string> vendors;
-    for (const auto &rule : vec_rules) {
-      if (rule.vid().has_value())
-        vendors.insert(rule.vid().value_or(""));
-    }
-    auto vendors_names = guard::utils::MapVendorCodesToNames(vendors);
-    for (auto &rule : vec_rules) {
-      if (rule.vid().has_value() &&
-          vendors_names.count(rule.vid().value_or("")) > 0) {
-        rule.vendor_name(vendors_names.at(rule.vid().value_or("")));
-      }
-    }
+    SetVendorNames(vec_rules);
   }
   for (const auto &rule : vec_rules) {
     if (rule.level() == level) {
@@ -218,17 +341,213 @@ bool DispatcherImpl::ListUsbGuardRules(const LispMessage &msg) const noexcept {
   return true;
 }
 
+void DispatcherImpl::SetVendorNames(std::vector<GuardRule> &rules) noexcept {
+  std::unordered_set<std::string> vendors;
+  for (const auto &rule : rules) {
+    if (rule.vid().has_value())
+      vendors.insert(rule.vid().value_or(""));
+  }
+  auto vendors_names = guard::utils::MapVendorCodesToNames(vendors);
+  for (auto &rule : rules) {
+    if (rule.vid().has_value() &&
+        vendors_names.count(rule.vid().value_or("")) > 0) {
+      rule.vendor_name(vendors_names.at(rule.vid().value_or("")));
+    }
+  }
+}
+
+bool DispatcherImpl::ExportRules(const LispMessage &msg) const noexcept {
+  auto start = std::chrono::steady_clock::now();
+  std::optional<ExportFormat> format = ExportFormat::csv;
+  if (msg.params.count("format") > 0)
+    format = RuleExporter::StrToFormat(msg.params.at("format"));
+  if (!format) {
+    Log::Error() << "Unknown export format";
+    vecPairs vec_result;
+    vec_result.emplace_back("status", "BAD");
+    vec_result.emplace_back("err_what", "Unknown format");
+    std::cout << ToLispAssoc(
+        SerializableForLisp<vecPairs>(std::move(vec_result)));
+    return true;
+  }
+  std::optional<std::vector<guard::GuardRule>> vec_rules =
+      guard_.GetConfigStatus().ParseGuardRulesStrict();
+  if (!vec_rules) {
+    vecPairs vec_result;
+    vec_result.emplace_back("status", "BAD");
+    vec_result.emplace_back("err_what", "Can't read the rules file");
+    std::cout << ToLispAssoc(
+        SerializableForLisp<vecPairs>(std::move(vec_result)));
+    return true;
+  }
+  SetVendorNames(*vec_rules);
+  // The rows are written to the response as soon as they are built, the
+  // data is a lisp string, so quotes and line breaks are escaped.
+  std::cout << "((status \"OK\")(format "
+            << WrapWithQuotes(RuleExporter::FormatToString(*format))
+            << ")(data \"";
+  RuleExporter exporter(*format, [](std::string_view line) {
+    std::string escaped = EscapeAll(std::string(line));
+    boost::replace_all(escaped, "\n", "\\n");
+    std::cout << escaped;
+  });
+  for (const GuardRule &rule : *vec_rules) {
+    try {
+      exporter.Write(rule);
+    } catch (const std::exception &ex) {
+      Log::Error() << "Can't export the rule " << rule.number() << " "
+                   << ex.what();
+    }
+  }
+  std::cout << "\")(exported "
+            << WrapWithQuotes(std::to_string(exporter.exported()))
+            << ")(skipped "
+            << WrapWithQuotes(std::to_string(exporter.skipped())) << "))";
+  Log::Debug() << "Exported " << exporter.exported() << " rules, skipped "
+               << exporter.skipped();
+  Log::Debug() << "Elapsed(ms)=" << since(start).count();
+  return true;
+}
+
 bool DispatcherImpl::ListUsbDevices() const noexcept {
   // Log::Debug() << "Time measurement has started";
   std::vector<guard::UsbDevice> vec_usb = guard_.ListCurrentUsbDevices();
   std::cout << kMessBeg;
+  // a row per interface type
   for (const auto &usb : vec_usb) {
-    std::cout << ToLisp(usb);
+    for (auto &row : usb.SerializeRowsForLisp())
+      std::cout << ToLisp(SerializableForLisp<vecPairs>(std::move(row)));
   }
   std::cout << kMessEnd;
   return true;
 }
 
+bool DispatcherImpl::ListUsbDevicesChanges(
+    const LispMessage &msg) const noexcept {
+  uint64_t version = 0;
+  if (msg.params.count("version") > 0)
+    version = StrToUint(msg.params.at("version")).value_or(0);
+  vecPairs vec_result;
+  try {
+    DeviceInventory::Delta delta = guard_.DevicesChangedSince(version);
+    boost::json::object obj;
+    obj["version"] = delta.version;
+    obj["full"] = delta.full;
+    boost::json::array removed;
+    for (uint32_t id : delta.removed)
+      removed.emplace_back(id);
+    obj["removed"] = std::move(removed);
+    boost::json::array devices;
+    for (const auto &usb : delta.devices) {
+      for (const auto &row : usb.SerializeRowsForLisp()) {
+        boost::json::object js_usb;
+        for (const auto &[key, value] : row)
+          js_usb[key] = value;
+        devices.emplace_back(std::move(js_usb));
+      }
+    }
+    obj["devices"] = std::move(devices);
+    vec_result.emplace_back("status", "OK");
+    vec_result.emplace_back("changes_json",
+                            EscapeQuotes(boost::json::serialize(obj)));
+  } catch (const std::exception &ex) {
+    Log::Error() << "[ListUsbDevicesChanges] " << ex.what();
+    vec_result.clear();
+    vec_result.emplace_back("status", "FAILED");
+  }
+  std::cout << ToLispAssoc(
+      SerializableForLisp<vecPairs>(std::move(vec_result)));
+  return true;
+}
+
+bool DispatcherImpl::ListUsbTopology() const noexcept {
+  vecPairs vec_result;
+  try {
+    boost::json::object obj;
+    auto snapshot = guard_.Topology();
+    if (snapshot->seqnum())
+      obj["seqnum"] = *snapshot->seqnum();
+    obj["devices"] = snapshot->BuildJsonArray();
+    vec_result.emplace_back("status", "OK");
+    vec_result.emplace_back("topology_json",
+                            EscapeQuotes(boost::json::serialize(obj)));
+  } catch (const std::exception &ex) {
+    Log::Error() << "[ListUsbTopology] " << ex.what();
+    vec_result.clear();
+    vec_result.emplace_back("status", "FAILED");
+  }
+  std::cout << ToLispAssoc(
+      SerializableForLisp<vecPairs>(std::move(vec_result)));
+  return true;
+}
+
+bool DispatcherImpl::PreviewRules() const noexcept {
+  vecPairs vec_result;
+  try {
+    ConfigStatus config = guard_.GetConfigStatus();
+    // an empty preview of a broken file would look like a valid one
+    std::optional<std::vector<GuardRule>> parsed_rules =
+        config.ParseGuardRulesStrict();
+    if (!parsed_rules)
+      throw std::runtime_error("The rules file can't be parsed");
+    const std::vector<GuardRule> rules = std::move(*parsed_rules);
+    const std::vector<UsbDevice> devices = guard_.ListConnectedUsbDevices();
+    const RuleEvaluator evaluator(rules, config.implicit_policy());
+    const std::vector<RuleVerdict> verdicts = evaluator.Evaluate(devices);
+    boost::json::array arr;
+    for (size_t i = 0; i < verdicts.size() && i < devices.size(); ++i) {
+      boost::json::object obj;
+      obj["hash"] = devices[i].hash();
+      obj["name"] = devices[i].name();
+      obj["vid"] = devices[i].vid();
+      obj["pid"] = devices[i].pid();
+      obj["port"] = devices[i].port();
+      obj["target"] = GuardRule::TargetToString(verdicts[i].target);
+      obj["certain"] = verdicts[i].certain;
+      if (verdicts[i].rule) {
+        obj["rule"] = rules[*verdicts[i].rule].number();
+      } else {
+        obj["rule"] = nullptr;
+      }
+      arr.emplace_back(std::move(obj));
+    }
+    vec_result.emplace_back("status", "OK");
+    vec_result.emplace_back("preview_json",
+                            EscapeQuotes(boost::json::serialize(arr)));
+  } catch (const std::exception &ex) {
+    Log::Error() << "[PreviewRules] " << ex.what();
+    vec_result.clear();
+    vec_result.emplace_back("status", "FAILED");
+  }
+  std::cout << ToLispAssoc(
+      SerializableForLisp<vecPairs>(std::move(vec_result)));
+  return true;
+}
+
+bool DispatcherImpl::AnalyzeRules() const noexcept {
+  vecPairs vec_result;
+  try {
+    // an empty analysis of a broken file would look like a clean one
+    std::optional<std::vector<GuardRule>> parsed_rules =
+        guard_.GetConfigStatus().ParseGuardRulesStrict();
+    if (!parsed_rules)
+      throw std::runtime_error("The rules file can't be parsed");
+    const std::vector<GuardRule> rules = std::move(*parsed_rules);
+    const RuleAnalyzer analyzer(rules);
+    vec_result.emplace_back("status", "OK");
+    vec_result.emplace_back("analysis_json",
+                            EscapeQuotes(boost::json::serialize(
+                                analyzer.BuildJsonObject(rules))));
+  } catch (const std::exception &ex) {
+    Log::Error() << "[AnalyzeRules] " << ex.what();
+    vec_result.clear();
+    vec_result.emplace_back("status", "FAILED");
+  }
+  std::cout << ToLispAssoc(
+      SerializableForLisp<vecPairs>(std::move(vec_result)));
+  return true;
+}
+
 bool DispatcherImpl::AllowDevice(const LispMessage &msg) const noexcept {
   if (msg.params.count("usb_id") == 0 ||
       msg.params.find("usb_id")->second.empty()) {
@@ -259,6 +578,58 @@ bool DispatcherImpl::BlockDevice(const LispMessage &msg) const noexcept {
   return true;
 }
 
+bool DispatcherImpl::AllowOrBlockDevices(
+    const LispMessage &msg) const noexcept {
+  if (msg.params.count("usb_ids") == 0 || msg.params.count("target") == 0 ||
+      (msg.params.at("target") != "allow" &&
+       msg.params.at("target") != "block")) {
+    std::cout << kMessBeg << kMessEnd;
+    Log::Warning() << "Bad request for bulk usb policy,doing nothing";
+    return true;
+  }
+  vecPairs vec_result;
+  try {
+    std::vector<std::string> ids;
+    boost::split(ids, msg.params.at("usb_ids"),
+                 [](const char symbol) {
+                   return symbol == ',' || symbol == ' ' || symbol == ';';
+                 },
+                 boost::token_compress_on);
+    ids.erase(std::remove(ids.begin(), ids.end(), ""), ids.end());
+    std::map<std::string, std::string> results = guard_.AllowOrBlockDevices(
+        ids, msg.params.at("target") == "allow");
+    boost::json::object obj;
+    bool all_ok = !results.empty();
+    for (const auto &[id, result] : results) {
+      obj[id] = result;
+      all_ok = all_ok && result == "OK";
+    }
+    vec_result.emplace_back("status", all_ok ? "OK" : "FAILED");
+    vec_result.emplace_back("results_json",
+                            EscapeQuotes(boost::json::serialize(obj)));
+  } catch (const std::exception &ex) {
+    Log::Error() << "[AllowOrBlockDevices] " << ex.what();
+    vec_result.clear();
+    vec_result.emplace_back("status", "FAILED");
+  }
+  std::cout << ToLispAssoc(
+      SerializableForLisp<vecPairs>(std::move(vec_result)));
+  return true;
+}
+
+bool DispatcherImpl::IpcStats() const noexcept {
+  const IpcConnection::Stats &stats = guard_.IpcStats();
+  vecPairs vec_result;
+  vec_result.emplace_back("connects", std::to_string(stats.connects));
+  vec_result.emplace_back("reconnects", std::to_string(stats.reconnects));
+  vec_result.emplace_back("failures", std::to_string(stats.failures));
+  vec_result.emplace_back("last_latency_us",
+                          std::to_string(stats.last_latency.count()));
+  std::cout << ToLispAssoc(
+      SerializableForLisp<vecPairs>(std::move(vec_result)));
+  return true;
+}
+
 bool DispatcherImpl::CheckConfig() const noexcept {
   Log::Info() << "Check config";
   std::string str = kMessBeg;
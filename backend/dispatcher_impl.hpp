@@ -1,6 +1,10 @@
 #include "guard.hpp"
+#include "guard_utils.hpp"
 #include "lisp_message.hpp"
 #include "message_dispatcher.hpp"
+#include "upload_spool.hpp"
+#include <optional>
+#include <vector>
 
 namespace guard {
 
@@ -14,16 +18,33 @@ private:
   bool SaveChangeRules(const LispMessage &msg, bool apply_rules) const noexcept;
   bool ListUsbGuardRules(const LispMessage &msg) const noexcept;
   bool ListUsbDevices() const noexcept;
+  bool ListUsbDevicesChanges(const LispMessage &msg) const noexcept;
+  bool ListUsbTopology() const noexcept;
+  bool PreviewRules() const noexcept;
+  bool AnalyzeRules() const noexcept;
   bool AllowDevice(const LispMessage &msg) const noexcept;
   bool BlockDevice(const LispMessage &msg) const noexcept;
+  bool AllowOrBlockDevices(const LispMessage &msg) const noexcept;
   bool CheckConfig() const noexcept;
+  bool IpcStats() const noexcept;
   bool ReadUsbGuardLogs(const LispMessage &msg) const noexcept;
+  bool ExportRules(const LispMessage &msg) const noexcept;
+  /// @brief Resolve vendor names of the rules with a vid
+  static void SetVendorNames(std::vector<GuardRule> &rules) noexcept;
   static bool UploadRulesFile(const LispMessage &msg) noexcept;
+  bool UploadRulesBegin() const noexcept;
+  bool UploadRulesChunk(const LispMessage &msg) const noexcept;
+  bool UploadRulesStatus(const LispMessage &msg) const noexcept;
+  bool UploadRulesCommit(const LispMessage &msg) const noexcept;
+  /// @brief Print the response for an uploaded rules file
+  static void PrintUploadResult(
+      const std::optional<utils::CsvUploadResult> &upload) noexcept;
 
   static constexpr const char *kMessBeg = "(";
   static constexpr const char *kMessEnd = ")";
 
   Guard &guard_;
+  UploadSpool upload_spool_;
 };
 
 } // namespace guard
@@ -1,4 +1,5 @@
 #include "guard.hpp"
+#include "change_journal.hpp"
 #include "common_utils.hpp"
 #include "config_status.hpp"
 #include "guard_rule.hpp"
@@ -15,10 +16,12 @@
 #include <boost/json/value.hpp>
 #include <cstdint>
 #include <exception>
+#include <map>
 #include <memory>
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -26,59 +29,68 @@ namespace guard {
 
 using common_utils::Log;
 
-Guard::Guard() noexcept : ptr_ipc_(nullptr) { ConnectToUsbGuard(); }
+Guard::Guard() noexcept : ipc_(inventory_) { ConnectToUsbGuard(); }
 
-bool Guard::HealthStatus() const noexcept {
-  return ptr_ipc_ && ptr_ipc_->isConnected();
-}
+bool Guard::HealthStatus() const noexcept { return ipc_.Connected(); }
 
 std::vector<UsbDevice> Guard::ListCurrentUsbDevices() noexcept {
-  std::vector<UsbDevice> res;
   if (!HealthStatus())
-    return res;
-  // health is ok -> get all devices
+    return {};
+  ReloadInventory();
   try {
-    std::vector<usbguard::Rule> rules;
-    rules = ptr_ipc_->listDevices(kDefaultQuery);
-    for (const usbguard::Rule &rule : rules) {
-      std::vector<std::string> i_types = guard::utils::FoldUsbInterfacesList(
-          rule.attributeWithInterface().toRuleString());
-      for (const std::string &i_type : i_types) {
-        std::vector<std::string> vid_pid;
-        boost::split(vid_pid, rule.getDeviceID().toString(),
-                     [](const char symbol) { return symbol == ':'; });
-        UsbDevice::DeviceData dev_data{
-            rule.getRuleID(),
-            usbguard::Rule::targetToString(rule.getTarget()),
-            rule.getName(),
-            !vid_pid.empty() ? vid_pid[0] : "",
-            vid_pid.size() > 1 ? vid_pid[1] : "",
-            rule.getViaPort(),
-            rule.getWithConnectType(),
-            i_type,
-            rule.getSerial(),
-            rule.getHash()};
-        res.emplace_back(std::move(dev_data));
-      }
-    }
+    return inventory_.Devices();
   } catch (const std::exception &ex) {
-    Log::Error() << "USBGuard error";
+    Log::Error() << "Can't list devices";
     Log::Error() << ex.what();
-    return res;
   }
-  // fill all vendor names with one read of file
-  std::unordered_set<std::string> vendors_to_search;
-  for (const UsbDevice &usb : res) {
-    vendors_to_search.insert(usb.vid());
+  return {};
+}
+
+std::vector<UsbDevice> Guard::ListSysfsUsbDevices() noexcept {
+  try {
+    return Topology()->Devices();
+  } catch (const std::exception &ex) {
+    Log::Error() << "Can't list devices from sysfs";
+    Log::Error() << ex.what();
   }
-  std::unordered_map<std::string, std::string> vendors_names{
-      guard::utils::MapVendorCodesToNames(vendors_to_search)};
-  for (UsbDevice &usb : res) {
-    if (vendors_names.count(usb.vid()) != 0) {
-      usb.vendor_name(vendors_names[usb.vid()]);
-    }
+  return {};
+}
+
+std::vector<UsbDevice> Guard::ListConnectedUsbDevices() noexcept {
+  ConnectToUsbGuard();
+  if (HealthStatus())
+    return ListCurrentUsbDevices();
+  Log::Debug() << "USBGuard is not active, reading devices from sysfs";
+  return ListSysfsUsbDevices();
+}
+
+std::shared_ptr<const UsbTopology::Snapshot> Guard::Topology() noexcept {
+  return topology_.Get();
+}
+
+DeviceInventory::Delta Guard::DevicesChangedSince(uint64_t version) noexcept {
+  if (!HealthStatus())
+    return {};
+  ReloadInventory();
+  try {
+    return inventory_.ChangesSince(version);
+  } catch (const std::exception &ex) {
+    Log::Error() << "Can't list device changes";
+    Log::Error() << ex.what();
+  }
+  return {};
+}
+
+void Guard::ReloadInventory() noexcept {
+  if (inventory_.valid() || !HealthStatus())
+    return;
+  try {
+    uint64_t base_version = inventory_.version();
+    inventory_.Reset(ipc_.client()->listDevices(kDefaultQuery), base_version);
+  } catch (const std::exception &ex) {
+    Log::Error() << "USBGuard error";
+    Log::Error() << ex.what();
   }
-  return res;
 }
 
 bool Guard::AllowOrBlockDevice(const std::string &device_id, bool allow,
@@ -91,7 +103,7 @@ bool Guard::AllowOrBlockDevice(const std::string &device_id, bool allow,
   usbguard::Rule::Target policy =
       allow ? usbguard::Rule::Target::Allow : usbguard::Rule::Target::Block;
   try {
-    ptr_ipc_->applyDevicePolicy(*id_numeric, policy, permanent);
+    ipc_.client()->applyDevicePolicy(*id_numeric, policy, permanent);
   } catch (const usbguard::Exception &ex) {
     Log::Error() << "Can't add rule."
                  << "May be rule conflict happened.";
@@ -101,54 +113,94 @@ bool Guard::AllowOrBlockDevice(const std::string &device_id, bool allow,
   return true;
 }
 
+std::map<std::string, std::string>
+Guard::AllowOrBlockDevices(const std::vector<std::string> &device_ids,
+                           bool allow, bool permanent) noexcept {
+  std::map<std::string, std::string> res;
+  usbguard::Rule::Target policy =
+      allow ? usbguard::Rule::Target::Allow : usbguard::Rule::Target::Block;
+  // "1", "01" and " 1" are the same device, the policy is applied once and
+  // each of them gets its result
+  std::unordered_map<uint32_t, std::string> applied;
+  bool reconnected = false;
+  for (const std::string &device_id : device_ids) {
+    if (res.count(device_id) != 0)
+      continue;
+    std::optional<uint32_t> id_numeric = common_utils::StrToUint(device_id);
+    if (!id_numeric) {
+      res.emplace(device_id, "BAD_ID");
+      continue;
+    }
+    auto it_applied = applied.find(*id_numeric);
+    if (it_applied != applied.end()) {
+      res.emplace(device_id, it_applied->second);
+      continue;
+    }
+    if (!HealthStatus() && !reconnected) {
+      reconnected = true;
+      ConnectToUsbGuard();
+    }
+    std::string result = "NO_DAEMON";
+    if (HealthStatus()) {
+      try {
+        ipc_.client()->applyDevicePolicy(*id_numeric, policy, permanent);
+        result = "OK";
+      } catch (const std::exception &ex) {
+        Log::Error() << "Can't apply the policy to the device " << device_id;
+        Log::Error() << ex.what();
+        result = "FAILED";
+      }
+    }
+    applied.emplace(*id_numeric, result);
+    res.emplace(device_id, std::move(result));
+  }
+  return res;
+}
+
 ConfigStatus Guard::GetConfigStatus() noexcept {
+  // the daemon state is read from the systemd unit, a failed connection
+  // may be waiting for the backoff while the daemon runs
   ConfigStatus config_status;
   //  TODO if daemon is on active think about creating policy before enabling
   if (!HealthStatus())
     ConnectToUsbGuard();
-  config_status.guard_daemon_active(HealthStatus());
+  // a live connection proves the daemon runs if systemd can't be asked
+  if (HealthStatus())
+    config_status.guard_daemon_active(true);
   return config_status;
 }
 
-void Guard::ConnectToUsbGuard() noexcept {
-  try {
-    ptr_ipc_ = std::make_unique<usbguard::IPCClient>(true);
-  } catch (usbguard::Exception &e) {
-    Log::Warning() << "Error connecting to USBGuard daemon.";
-    Log::Warning() << e.what();
-  }
-}
+void Guard::ConnectToUsbGuard() noexcept { ipc_.Connect(); }
 
 std::optional<std::string>
 Guard::ProcessJsonRulesChanges(const std::string &msg,
                                bool apply_changes) noexcept {
   try {
+    // Lock the journal before the current state is read, concurrent
+    // changes are applied one by one and never overwrite each other.
+    std::optional<ChangeJournal> journal;
+    if (apply_changes) {
+      journal.emplace();
+      if (!journal->Lock(true))
+        throw std::runtime_error("Can't lock the change journal");
+    }
     ConfigStatus config = GetConfigStatus();
-    bool initial_active_status = config.guard_daemon_active();
-    bool initial_enable_status = config.guard_daemon_enabled();
-    Target initial_policy = config.implicit_policy();
-    guard::json::JsonChanges js_changes(msg);
+    guard::json::JsonChanges js_changes(msg, config);
+    if (journal)
+      js_changes.journal(&*journal);
     // give a list of active devices if needed
+    // the daemon state is never changed for the device list
     if (js_changes.ActiveDeviceListNeeded()) {
-      ConnectToUsbGuard();
-      // if usbguard is not active, activate it with "allow"
-      if (!HealthStatus()) {
-        Log::Debug() << "[ProcessJson] Starting usbguard with allow policy to "
-                        "get list of devices";
-        config.ChangeImplicitPolicy(false);
-        config.TryToRun(true);
-        ConnectToUsbGuard();
-        if (!HealthStatus()) {
-          throw std::runtime_error("Can't launch usbguard");
-        }
-      }
-      js_changes.active_devices(ListCurrentUsbDevices());
-      // after recieving devices, restore initial status
-      Log::Debug() << "[ProcessJson] Recovering the initial policy and status";
-      config.ChangeImplicitPolicy(initial_policy == Target::block);
-      config.ChangeDaemonStatus(initial_active_status, initial_enable_status);
+      js_changes.active_devices(ListConnectedUsbDevices());
     }
-    return js_changes.Process(apply_changes);
+    // the rules can be applied without a daemon restart
+    if (HealthStatus())
+      js_changes.ipc_client(ipc_.client());
+    std::string res = js_changes.Process(apply_changes);
+    // the daemon may have been started, the next request needs it ready
+    if (apply_changes && !HealthStatus())
+      ipc_.WaitReady(kReadyTimeout);
+    return res;
   } catch (const std::exception &ex) {
     Log::Error()
         << "Ann error occured while processing changes from web interface";
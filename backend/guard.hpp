@@ -1,8 +1,14 @@
 #pragma once
 #include "config_status.hpp"
+#include "device_inventory.hpp"
+#include "ipc_connection.hpp"
 #include "usb_device.hpp"
+#include "usb_topology.hpp"
 #include <IPCClient.hpp>
 #include <USBGuard.hpp>
+#include <chrono>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <optional>
 #include <string>
@@ -22,8 +28,31 @@ public:
 
   /// @brief List current usb devices
   /// @return vector<UsbDevices>
+  /// @details The devices are read from the inventory, kept up to date by
+  /// the daemon signals. The daemon is asked only if the inventory is invalid.
   std::vector<UsbDevice> ListCurrentUsbDevices() noexcept;
 
+  /// @brief Get list of connected devices from sysfs
+  /// @return vector<UsbDevices>
+  /// @details Works without the daemon, the hashes are computed the same way
+  /// as USBGuard does.
+  std::vector<UsbDevice> ListSysfsUsbDevices() noexcept;
+
+  /// @brief Get list of connected devices from the daemon if it's active,
+  /// from sysfs otherwise
+  std::vector<UsbDevice> ListConnectedUsbDevices() noexcept;
+
+  /// @brief The tree of connected devices
+  /// @details Sysfs is read again only after a uevent.
+  std::shared_ptr<const UsbTopology::Snapshot> Topology() noexcept;
+
+  /**
+   * @brief Changes of the connected devices since a version
+   * @param version A version, returned by the previous call (0 - any)
+   * @return DeviceInventory::Delta, full list if the version is too old
+   */
+  DeviceInventory::Delta DevicesChangedSince(uint64_t version) noexcept;
+
   /**
    * @brief Allow or block device
    * @param[in] id  string, containing numerical id of usb device
@@ -32,6 +61,28 @@ public:
    */
   bool AllowOrBlockDevice(const std::string &device_id, bool allow = false,
                           bool permanent = true) noexcept;
+
+  /**
+   * @brief Allow or block many devices over one IPC connection
+   * @param device_ids Numerical ids of usb devices, the policy is applied
+   * once per device, "1" and "01" get the same result
+   * @param allow false - block, true - allow
+   * @param permanent true(default) - create permanent UsbGuard rules
+   * @return device id : "OK" | "FAILED" | "BAD_ID" | "NO_DAEMON"
+   * @details A failed device doesn't stop the batch. The connection is
+   * restored once if the daemon drops it in the middle. usbguard's
+   * IPCClient waits for the reply of each call and can't pipeline them,
+   * so the saving is the single connection, the calls stay sequential.
+   */
+  std::map<std::string, std::string>
+  AllowOrBlockDevices(const std::vector<std::string> &device_ids,
+                      bool allow = false, bool permanent = true) noexcept;
+
+  /// @brief IPC connection statistics
+  inline const IpcConnection::Stats &IpcStats() const noexcept {
+    return ipc_.stats();
+  }
+
   /**
    * @brief check configuration of UsbGuard daemon
    * @return ConfigStatus object
@@ -87,11 +138,18 @@ public:
 private:
   /// True if daemon is active
   bool HealthStatus() const noexcept;
-  /// try to connect the UsbGuardDaemon
+  /// connect the UsbGuardDaemon, a healthy connection is reused
   void ConnectToUsbGuard() noexcept;
+  /// fill the inventory with listDevices if it's invalid
+  void ReloadInventory() noexcept;
 
   const std::string kDefaultQuery = "match";
-  std::unique_ptr<usbguard::IPCClient> ptr_ipc_;
+  /// how long to wait for the daemon after start
+  static constexpr std::chrono::milliseconds kReadyTimeout{5000};
+  // the inventory must outlive the client
+  DeviceInventory inventory_;
+  IpcConnection ipc_;
+  UsbTopology topology_;
 
 #ifdef UNIT_TEST
   friend class ::Test;
@@ -69,6 +69,10 @@ GuardRule::GuardRule(const std::string &raw_str) {
   cond_ = ParseConditions(tokens);
   // id (vid:pid)
   // token id MUST contain a ':' symbol
+  // id one-of { vid:pid ... }
+  if (HasOperator(tokens, "id")) {
+    ids_ = ParseTokenWithOperator(tokens, "id", utils::VidPidValidator);
+  }
   std::optional<std::string> str_id =
       utils::ParseToken(tokens, "id", utils::VidPidValidator);
   if (str_id.has_value()) {
@@ -92,9 +96,14 @@ GuardRule::GuardRule(const std::string &raw_str) {
   // the string. default_predicat - Function is the default behavior of values
   // validating.
   // hash length MUST be > 7 symbols
-  hash_ = utils::ParseToken(tokens, "hash", [](const std::string &val) {
+  auto hash_predicat = [](const std::string &val) {
     return val.size() > 7 && val.size() < 101;
-  });
+  };
+  // hash one-of { "hash" ... }
+  if (HasOperator(tokens, "hash")) {
+    hashes_ = ParseTokenWithOperator(tokens, "hash", hash_predicat);
+  }
+  hash_ = utils::ParseToken(tokens, "hash", hash_predicat);
   parent_hash_ =
       utils::ParseToken(tokens, "parent-hash", [](const std::string &val) {
         return val.size() > 7 && val.size() < 101;
@@ -123,6 +132,16 @@ GuardRule::GuardRule(const std::string &raw_str) {
   // Log::Debug() << BuildString();
 }
 
+GuardRule::GuardRule(Target target) noexcept : target_(target) {}
+
+GuardRule::GuardRule(Target target, const std::string &vid,
+                     const std::string &pid)
+    : target_(target), vid_(vid), pid_(pid) {
+  if (!utils::VidPidValidator(vid + ':' + pid))
+    throw std::logic_error("Bad vid_pid " + vid + ':' + pid);
+  DetermineStrictnessLevel();
+}
+
 void GuardRule::FinalValidator(std::vector<std::string> &splitted) const {
   // check
   for (std::string &str : splitted)
@@ -140,7 +159,8 @@ void GuardRule::FinalValidator(std::vector<std::string> &splitted) const {
     throw std::logic_error("Not all tokens were parsed");
   }
 
-  if (vid_.value_or("").empty() && (pid_.value_or("").empty()) &&
+  if (!ids_ && !hashes_ && vid_.value_or("").empty() &&
+      (pid_.value_or("").empty()) &&
       (hash_.value_or("").empty()) && (parent_hash_.value_or("").empty()) &&
       (device_name_.value_or("").empty()) && (serial_.value_or("").empty()) &&
       !port_.has_value() && !with_interface_.has_value() &&
@@ -153,7 +173,10 @@ void GuardRule::DetermineStrictnessLevel() noexcept {
   // Determine the stricness level
   // conditions,parent-hash and port are not used for hashing
   // if rule contains a port or a condition - this is a "raw" rule
-  if (hash_ && !cond_ && !port_)
+  // sets of ids or hashes are shown as raw rules
+  if (ids_ || hashes_)
+    level_ = StrictnessLevel::non_strict;
+  else if (hash_ && !cond_ && !port_)
     level_ = StrictnessLevel::hash;
   else if (vid_ && pid_ && !cond_ && !port_)
     level_ = StrictnessLevel::vid_pid;
@@ -253,12 +276,16 @@ GuardRule::BuildString(bool build_parent_hash,
   res << map_target.at(target_);
   if (vid_ && pid_)
     res << " id " << *vid_ << ":" << *pid_;
+  if (ids_)
+    res << " id " << SetToString(*ids_, false);
   if (serial_)
     res << " serial " << QuoteIfNotQuoted(*serial_);
   if (device_name_)
     res << " name " << QuoteIfNotQuoted(*device_name_);
   if (hash_)
     res << " hash " << QuoteIfNotQuoted(*hash_);
+  if (hashes_)
+    res << " hash " << SetToString(*hashes_, true);
   if (build_parent_hash && parent_hash_)
     res << " parent-hash " << QuoteIfNotQuoted(*parent_hash_);
   if (port_) {
@@ -281,6 +308,57 @@ GuardRule::BuildString(bool build_parent_hash,
   return result;
 }
 
+std::string GuardRule::CanonicalString() const noexcept {
+  auto is_unordered = [](RuleOperator rule_operator) {
+    return rule_operator != RuleOperator::equals_ordered &&
+           rule_operator != RuleOperator::no_operator;
+  };
+  auto unsorted = [&is_unordered](const auto &attribute) {
+    return attribute && is_unordered(attribute->first) &&
+           !std::is_sorted(attribute->second.cbegin(),
+                           attribute->second.cend());
+  };
+  bool need_sorting =
+      unsorted(ids_) || unsorted(hashes_) ||
+      (port_ && is_unordered(port_->first) &&
+       !std::is_sorted(port_->second.cbegin(), port_->second.cend())) ||
+      (with_interface_ && is_unordered(with_interface_->first) &&
+       !std::is_sorted(with_interface_->second.cbegin(),
+                       with_interface_->second.cend()));
+  if (!need_sorting)
+    return BuildString(true, true);
+  GuardRule tmp = *this;
+  if (tmp.ids_ && is_unordered(tmp.ids_->first))
+    std::sort(tmp.ids_->second.begin(), tmp.ids_->second.end());
+  if (tmp.hashes_ && is_unordered(tmp.hashes_->first))
+    std::sort(tmp.hashes_->second.begin(), tmp.hashes_->second.end());
+  if (tmp.port_ && is_unordered(tmp.port_->first))
+    std::sort(tmp.port_->second.begin(), tmp.port_->second.end());
+  if (tmp.with_interface_ && is_unordered(tmp.with_interface_->first))
+    std::sort(tmp.with_interface_->second.begin(),
+              tmp.with_interface_->second.end());
+  return tmp.BuildString(true, true);
+}
+
+std::string GuardRule::SetToString(
+    const std::pair<RuleOperator, std::vector<std::string>> &attribute,
+    bool quote) {
+  std::string res;
+  auto value_to_string = [quote](const std::string &value) {
+    return quote ? QuoteIfNotQuoted(value) : value;
+  };
+  if (attribute.first == RuleOperator::no_operator) {
+    if (!attribute.second.empty())
+      res = value_to_string(attribute.second.front());
+    return res;
+  }
+  res = map_operator.at(attribute.first) + " {";
+  for (const std::string &value : attribute.second)
+    res += " " + value_to_string(value);
+  res += " }";
+  return res;
+}
+
 std::string GuardRule::PortsToString() const {
   std::stringstream string_builder;
   if (port_) {
@@ -398,6 +476,11 @@ GuardRule::StrToStrictnessLevel(const std::string &str) noexcept {
   return StrictnessLevel::non_strict;
 }
 
+std::string GuardRule::TargetToString(Target target) noexcept {
+  auto it = map_target.find(target);
+  return it != map_target.cend() ? it->second : std::string();
+}
+
 std::optional<std::pair<RuleOperator, std::vector<RuleWithBool>>>
 GuardRule::ParseConditions(std::vector<std::string> &splitted) {
   std::logic_error ex_common("Cant parse conditions");
@@ -539,4 +622,16 @@ bool GuardRule::IsReservedWord(const std::string &str) noexcept {
   return false;
 }
 
+bool GuardRule::HasOperator(const std::vector<std::string> &splitted,
+                            const std::string &name) noexcept {
+  auto it_name = std::find(splitted.cbegin(), splitted.cend(), name);
+  if (it_name == splitted.cend() || std::next(it_name) == splitted.cend())
+    return false;
+  const std::string &next = *std::next(it_name);
+  return std::find_if(map_operator.cbegin(), map_operator.cend(),
+                      [&next](const auto &pair) {
+                        return pair.second == next;
+                      }) != map_operator.cend();
+}
+
 } // namespace guard
\ No newline at end of file
@@ -14,6 +14,8 @@
 
 namespace guard {
 
+class GuardRuleBuilder;
+
 // clang-format off
 
 /// @brief Target ::= allow | block | reject
@@ -75,6 +77,15 @@ public:
    */
   explicit GuardRule(const std::string &raw_str);
 
+  /**
+   * @brief Construct a "target id vid:pid" rule without parsing a string
+   * @param target The rule target
+   * @param vid Vendor id (4 hex digits or "*")
+   * @param pid Product id (4 hex digits or "*")
+   * @throws std::logical_error if the id is not valid
+   */
+  GuardRule(Target target, const std::string &vid, const std::string &pid);
+
   // GuardRule &operator=(const GuardRule &) noexcept = delete;
   // GuardRule &operator=(GuardRule &&) noexcept = delete;
   // GuardRule(GuardRule &&)  = default;
@@ -93,6 +104,14 @@ public:
   BuildString(bool build_parent_hash = true,
               bool with_interface_array_no_operator = true) const noexcept;
 
+  /**
+   * @brief Build a canonical rule string
+   * @details The same as BuildString(true,true), but values of unordered
+   * sets (all-of,one-of,none-of,equals) are sorted, so equal rules always
+   * give equal strings.
+   */
+  std::string CanonicalString() const noexcept;
+
   /**
    * @brief Builds a vector of string pairs, suitable for
    * sending to lisp
@@ -108,6 +127,9 @@ public:
   /// @return StrictnessLevel - non_strict if no corresondent level is found.
   static StrictnessLevel StrToStrictnessLevel(const std::string &str) noexcept;
 
+  /// @brief Converts a Target to a string ("allow","block","reject")
+  static std::string TargetToString(Target target) noexcept;
+
   /// @brief Builds a string from interfaces
   std::string
   InterfacesToString(bool with_interface_array_no_operator = true) const;
@@ -133,8 +155,45 @@ public:
   inline std::string device_name() const noexcept {
     return device_name_.value_or("");
   }
+  inline const std::optional<std::string> &parent_hash() const noexcept {
+    return parent_hash_;
+  }
+  inline const std::optional<std::string> &serial() const noexcept {
+    return serial_;
+  }
+  inline const std::optional<std::string> &conn_type() const noexcept {
+    return conn_type_;
+  }
+  inline const std::optional<
+      std::pair<RuleOperator, std::vector<std::string>>> &
+  ids() const noexcept {
+    return ids_;
+  }
+  inline const std::optional<
+      std::pair<RuleOperator, std::vector<std::string>>> &
+  hashes() const noexcept {
+    return hashes_;
+  }
+  inline const std::optional<
+      std::pair<RuleOperator, std::vector<std::string>>> &
+  port() const noexcept {
+    return port_;
+  }
+  inline const std::optional<
+      std::pair<RuleOperator, std::vector<std::string>>> &
+  with_interface() const noexcept {
+    return with_interface_;
+  }
+  inline const std::optional<
+      std::pair<RuleOperator, std::vector<RuleWithBool>>> &
+  conditions() const noexcept {
+    return cond_;
+  }
 
 private:
+  /// @brief An empty rule, filled by GuardRuleBuilder
+  explicit GuardRule(Target target) noexcept;
+
   ///  @brief Build a condition string from this object.
   std::string ConditionsToString() const;
   /// @brief Determine a strictness level, wtite to level_
@@ -146,6 +205,13 @@ private:
   void FinalValidator(std::vector<std::string> &) const;
   /// @brief Builds a string from ports
   std::string PortsToString() const;
+  /// @brief Builds "operator { value ... }" or a single value
+  static std::string SetToString(
+      const std::pair<RuleOperator, std::vector<std::string>> &attribute,
+      bool quote);
+  /// @brief true if the token is followed by an operator
+  static bool HasOperator(const std::vector<std::string> &splitted,
+                          const std::string &name) noexcept;
 
   /**
    * @brief Parse a token when operators are possible for token
@@ -209,6 +275,10 @@ private:
   std::optional<std::string> vid_;
   std::optional<std::string> pid_;
   std::optional<std::string> hash_;
+  /// id with an operator: id one-of { vid:pid ... }
+  std::optional<std::pair<RuleOperator, std::vector<std::string>>> ids_;
+  /// hash with an operator: hash one-of { "hash" ... }
+  std::optional<std::pair<RuleOperator, std::vector<std::string>>> hashes_;
   std::optional<std::string> parent_hash_;
   std::optional<std::string> device_name_;
   std::optional<std::string> serial_;
@@ -220,6 +290,7 @@ private:
   StrictnessLevel level_ = StrictnessLevel::hash;
   std::optional<std::string> vendor_name_;
 
+  friend class GuardRuleBuilder;
 #ifdef UNIT_TEST
   friend class ::Test;
 #endif
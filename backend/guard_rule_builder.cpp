@@ -0,0 +1,173 @@
+#include "guard_rule_builder.hpp"
+#include "common_utils.hpp"
+#include "guard_utils.hpp"
+#include <algorithm>
+#include <boost/algorithm/string/predicate.hpp>
+#include <stdexcept>
+
+namespace guard {
+
+using common_utils::QuoteIfNotQuoted;
+
+GuardRuleBuilder::GuardRuleBuilder(Target target) noexcept : rule_(target) {}
+
+GuardRuleBuilder::GuardRuleBuilder(const std::string &target)
+    : rule_(Target::block) {
+  auto it_target = std::find_if(
+      GuardRule::map_target.cbegin(), GuardRule::map_target.cend(),
+      [&target](const auto &element) { return element.second == target; });
+  if (it_target == GuardRule::map_target.cend())
+    throw std::logic_error("Bad rule target " + target);
+  rule_.target_ = it_target->first;
+}
+
+GuardRuleBuilder &GuardRuleBuilder::Id(const std::string &vid,
+                                       const std::string &pid) {
+  if (!utils::VidPidValidator(vid + ':' + pid))
+    throw std::logic_error("Bad vid_pid " + vid + ':' + pid);
+  rule_.vid_ = vid;
+  rule_.pid_ = pid;
+  return *this;
+}
+
+GuardRuleBuilder &GuardRuleBuilder::Id(const std::string &vid_pid) {
+  const size_t separator = vid_pid.find(':');
+  if (separator == std::string::npos)
+    throw std::logic_error("Bad vid_pid " + vid_pid);
+  return Id(vid_pid.substr(0, separator), vid_pid.substr(separator + 1));
+}
+
+GuardRuleBuilder &GuardRuleBuilder::Ids(RuleOperator rule_operator,
+                                        std::vector<std::string> ids) {
+  // a single id without an operator is set by Id
+  if (ids.empty() || rule_operator == RuleOperator::no_operator)
+    throw std::logic_error("Bad ids for a rule");
+  for (const std::string &vid_pid : ids) {
+    if (!utils::VidPidValidator(vid_pid))
+      throw std::logic_error("Bad vid_pid " + vid_pid);
+  }
+  rule_.ids_ = {rule_operator, std::move(ids)};
+  return *this;
+}
+
+GuardRuleBuilder &GuardRuleBuilder::Hash(const std::string &hash) {
+  rule_.hash_ = Quoted(hash, "hash", true);
+  return *this;
+}
+
+GuardRuleBuilder &GuardRuleBuilder::Hashes(RuleOperator rule_operator,
+                                           std::vector<std::string> hashes) {
+  // a single hash without an operator is set by Hash
+  if (hashes.empty() || rule_operator == RuleOperator::no_operator)
+    throw std::logic_error("Bad hashes for a rule");
+  for (std::string &hash : hashes)
+    hash = Quoted(hash, "hash", true);
+  rule_.hashes_ = {rule_operator, std::move(hashes)};
+  return *this;
+}
+
+GuardRuleBuilder &
+GuardRuleBuilder::ParentHash(const std::string &parent_hash) {
+  rule_.parent_hash_ = Quoted(parent_hash, "parent-hash", true);
+  return *this;
+}
+
+GuardRuleBuilder &GuardRuleBuilder::Name(const std::string &name) {
+  rule_.device_name_ = Quoted(name, "name", false);
+  return *this;
+}
+
+GuardRuleBuilder &GuardRuleBuilder::Serial(const std::string &serial) {
+  rule_.serial_ = Quoted(serial, "serial", false);
+  return *this;
+}
+
+GuardRuleBuilder &
+GuardRuleBuilder::ConnectType(const std::string &conn_type) {
+  rule_.conn_type_ = Quoted(conn_type, "with-connect-type", false);
+  return *this;
+}
+
+GuardRuleBuilder &GuardRuleBuilder::Port(const std::string &port) {
+  rule_.port_ =
+      ParseAttribute("via-port", port, [](const std::string &val) {
+        return !GuardRule::IsReservedWord(val) &&
+               !boost::starts_with(val, "\\\"") &&
+               !boost::ends_with(val, "\\\"");
+      });
+  return *this;
+}
+
+GuardRuleBuilder &
+GuardRuleBuilder::Interfaces(RuleOperator rule_operator,
+                             std::vector<std::string> interfaces) {
+  if (interfaces.empty() ||
+      (rule_operator == RuleOperator::no_operator && interfaces.size() > 1))
+    throw std::logic_error("Bad interfaces for a rule");
+  for (const std::string &interface : interfaces) {
+    if (!utils::InterfaceValidator(interface))
+      throw std::logic_error("Bad interface " + interface);
+  }
+  rule_.with_interface_ = {rule_operator, std::move(interfaces)};
+  return *this;
+}
+
+GuardRuleBuilder &
+GuardRuleBuilder::Interfaces(const std::string &interfaces) {
+  rule_.with_interface_ = ParseAttribute("with-interface", interfaces,
+                                         utils::InterfaceValidator);
+  return *this;
+}
+
+GuardRuleBuilder &
+GuardRuleBuilder::Conditions(const std::string &conditions) {
+  std::vector<std::string> tokens = utils::SplitRawRule(conditions);
+  if (tokens.empty())
+    throw std::logic_error("Empty conditions");
+  if (tokens.front() != "if")
+    tokens.insert(tokens.begin(), "if");
+  rule_.cond_ = GuardRule::ParseConditions(tokens);
+  if (!rule_.cond_ || !tokens.empty())
+    throw std::logic_error("Can't parse conditions " + conditions);
+  return *this;
+}
+
+GuardRule GuardRuleBuilder::Build() const {
+  GuardRule res = rule_;
+  res.DetermineStrictnessLevel();
+  std::vector<std::string> no_tokens;
+  res.FinalValidator(no_tokens);
+  return res;
+}
+
+std::string GuardRuleBuilder::Quoted(const std::string &value,
+                                     const char *attribute, bool is_hash) {
+  std::string res = QuoteIfNotQuoted(value);
+  // the same limits as the rule parser has
+  const bool bad_size = is_hash && (res.size() < 8 || res.size() > 100);
+  // a quote inside the value would end the string in the rules file
+  bool inner_quote = false;
+  for (size_t i = 1; i + 1 < res.size() && !inner_quote; ++i) {
+    inner_quote = res[i] == '"' && res[i - 1] != '\\';
+  }
+  if (bad_size || inner_quote)
+    throw std::logic_error(std::string("Bad value for ") + attribute);
+  return res;
+}
+
+std::pair<RuleOperator, std::vector<std::string>>
+GuardRuleBuilder::ParseAttribute(
+    const std::string &name, const std::string &value,
+    const std::function<bool(const std::string &)> &predicat) {
+  std::vector<std::string> tokens = utils::SplitRawRule(name + ' ' + value);
+  // an array of interfaces without an operator means "equals", as in the
+  // rule parser
+  if (name == "with-interface" && tokens.size() > 1 && tokens[1] == "{")
+    tokens.insert(tokens.begin() + 1, "equals");
+  auto res = GuardRule::ParseTokenWithOperator(tokens, name, predicat);
+  if (!res || !tokens.empty())
+    throw std::logic_error("Bad value for " + name);
+  return std::move(*res);
+}
+
+} // namespace guard
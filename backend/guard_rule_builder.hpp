@@ -0,0 +1,76 @@
+#pragma once
+#include "guard_rule.hpp"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace guard {
+
+/**
+ * @class GuardRuleBuilder
+ * @brief Builds a GuardRule from separate fields, without formatting and
+ * parsing a rule string
+ * @details Each field is validated as the rule parser validates it,
+ * string values are stored quoted. The built rule gives the same
+ * BuildString() as a rule parsed from the equivalent string.
+ * @throws std::logic_error from the setters if a value is not valid
+ */
+class GuardRuleBuilder {
+public:
+  explicit GuardRuleBuilder(Target target) noexcept;
+
+  /// @param target "allow", "block" or "reject"
+  /// @throws std::logic_error
+  explicit GuardRuleBuilder(const std::string &target);
+
+  /// @brief id vid:pid, "*" is allowed
+  GuardRuleBuilder &Id(const std::string &vid, const std::string &pid);
+  /// @brief id from a "vid:pid" string
+  GuardRuleBuilder &Id(const std::string &vid_pid);
+  /// @brief id with an operator: one-of { vid:pid ... }, "*" is allowed
+  GuardRuleBuilder &Ids(RuleOperator rule_operator,
+                        std::vector<std::string> ids);
+  GuardRuleBuilder &Hash(const std::string &hash);
+  /// @brief hash with an operator, the hashes are quoted if needed
+  GuardRuleBuilder &Hashes(RuleOperator rule_operator,
+                           std::vector<std::string> hashes);
+  GuardRuleBuilder &ParentHash(const std::string &parent_hash);
+  GuardRuleBuilder &Name(const std::string &name);
+  GuardRuleBuilder &Serial(const std::string &serial);
+  GuardRuleBuilder &ConnectType(const std::string &conn_type);
+
+  /// @brief via-port as in a rule: "1-1" or "one-of { "1-1" "1-2" }"
+  GuardRuleBuilder &Port(const std::string &port);
+
+  /// @brief with-interface with an operator
+  GuardRuleBuilder &Interfaces(RuleOperator rule_operator,
+                               std::vector<std::string> interfaces);
+
+  /// @brief with-interface as in a rule: "03:*:*", "{ 03:01:01 03:00:00 }"
+  /// or "one-of { 03:*:* 08:*:* }"
+  GuardRuleBuilder &Interfaces(const std::string &interfaces);
+
+  /// @brief Conditions as in a rule, with or without the leading "if"
+  GuardRuleBuilder &Conditions(const std::string &conditions);
+
+  /**
+   * @brief Build the rule
+   * @throws std::logic_error if the rule is empty
+   */
+  GuardRule Build() const;
+
+private:
+  /// @brief Quote the value and check it with the parser predicate
+  static std::string Quoted(const std::string &value, const char *attribute,
+                            bool is_hash);
+
+  /// @brief Parse "name value" tokens of an attribute with an operator
+  static std::pair<RuleOperator, std::vector<std::string>>
+  ParseAttribute(const std::string &name, const std::string &value,
+                 const std::function<bool(const std::string &)> &predicat);
+
+  GuardRule rule_;
+};
+
+} // namespace guard
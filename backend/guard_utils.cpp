@@ -1,11 +1,12 @@
 #include "guard_utils.hpp"
-#include "base64_rfc4648.hpp"
+#include "base64_stream.hpp"
 #include "common_utils.hpp"
+#include "csv_row_reader.hpp"
 #include "csv_rule.hpp"
 #include "guard_rule.hpp"
 #include "json_rule.hpp"
 #include "log.hpp"
-#include "rapidcsv.h"
+#include "thread_pool.hpp"
 #include "usb_device.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -13,69 +14,205 @@
 #include <boost/json/array.hpp>
 #include <boost/json/object.hpp>
 #include <boost/json/serialize.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <exception>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <utility>
 
 namespace guard::utils {
 
 using common_utils::Log;
 
-std::optional<std::vector<GuardRule>>
-UploadRulesCsv(const std::string &file) noexcept {
-  const size_t kColumnsRequired = 2;
-  try {
-    std::string csv_string =
-        cppcodec::base64_rfc4648::decode<std::string>(file);
-    csv_string = cppcodec::base64_rfc4648::decode<std::string>(csv_string);
-    // Log::Debug() << "CSV WIDE = " << csv_string;
-    csv_string = common_utils::UnUtf8(csv_string);
-    // Log::Debug() << "CSV (UnUtf8) = " << csv_string;
-    std::stringstream sstream(csv_string);
-    rapidcsv::Document doc(sstream, rapidcsv::LabelParams(-1, -1),
-                           rapidcsv::SeparatorParams(','));
-    if (doc.GetRowCount() == 0 || doc.GetColumnCount() < kColumnsRequired) {
-      Log::Error() << "Bad csv file";
-      return std::nullopt;
+namespace {
+
+/// @brief An exception with the text of an errno saved at the failed call
+std::runtime_error SysError(int err, const std::string &what) {
+  return std::runtime_error(what + ": " + std::strerror(err));
+}
+
+/// @brief Rows converted at once, limits the memory used by the rows
+constexpr size_t kBatchRows = 4096;
+/// @brief Smaller batches are converted without the thread pool
+constexpr size_t kParallelMinRows = 512;
+
+/**
+ * @brief Convert a batch of csv rows to rules, the batch is cleared
+ * @param lines The lines of the rows in the file, for the errors
+ * @param first_row The index of the first row of the batch
+ * @param pool Created on the first big batch
+ * @param res The rules and errors are appended in the rows order
+ */
+void ConvertCsvRows(std::vector<std::vector<std::string>> &batch,
+                    std::vector<size_t> &lines, size_t first_row,
+                    std::optional<ThreadPool> &pool, CsvUploadResult &res) {
+  struct Converted {
+    std::optional<GuardRule> rule;
+    std::optional<CsvRowError> error;
+  };
+  std::vector<Converted> converted(batch.size());
+  auto convert = [&batch, &lines, &converted, first_row](size_t begin,
+                                                         size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      try {
+        GuardRule rule = csv::CsvRule(std::move(batch[i])).Build();
+        rule.number(first_row + i);
+        converted[i].rule = std::move(rule);
+      } catch (const csv::CsvRuleError &ex) {
+        converted[i].error = CsvRowError{
+            lines[i], static_cast<size_t>(ex.column()), ex.what()};
+      }
+    }
+  };
+  if (batch.size() < kParallelMinRows) {
+    convert(0, batch.size());
+  } else {
+    if (!pool)
+      pool.emplace();
+    const size_t step = (batch.size() + pool->size() - 1) / pool->size();
+    std::vector<std::future<void>> futures;
+    for (size_t begin = 0; begin < batch.size(); begin += step) {
+      const size_t end = std::min(batch.size(), begin + step);
+      futures.push_back(
+          pool->Submit([&convert, begin, end] { convert(begin, end); }));
     }
-    // Log::Debug() << csv_string;
-    size_t n_rows = doc.GetRowCount();
-    Log::Debug() << "Rows count" << n_rows;
-    std::vector<size_t> failed_rules;
-    std::vector<GuardRule> res;
-    for (size_t i = 0; i < n_rows; ++i) {
+    // all tasks must finish before the batch is destroyed
+    std::exception_ptr ex_ptr;
+    for (std::future<void> &future : futures) {
       try {
-        std::string raw_str_tule = utils::csv::CsvRule(doc, i).BuildString();
-        // Log::Debug() << raw_str_tule;
-        GuardRule tmpRule(raw_str_tule);
-        // Log::Debug() << "GUARD RULE "<< tmpRule.BuildString();
-        tmpRule.number(i);
-        // raw rules are not supported for csv
-        if (tmpRule.level() != StrictnessLevel::non_strict)
-          res.emplace_back(std::move(tmpRule));
-      } catch (const std::logic_error &ex) {
-        Log::Debug() << "Can't parse a csv rule " << i;
-        Log::Debug() << ex.what();
-        failed_rules.push_back(i);
+        future.get();
+      } catch (...) {
+        ex_ptr = std::current_exception();
       }
     }
-    if (!failed_rules.empty()) {
-      Log::Warning() << "Parsing of " << failed_rules.size() << "was failed";
+    if (ex_ptr)
+      std::rethrow_exception(ex_ptr);
+  }
+  for (Converted &item : converted) {
+    if (item.error) {
+      ++res.failed_rows;
+      if (res.errors.size() < CsvUploadResult::kMaxRowErrors)
+        res.errors.push_back(std::move(*item.error));
+      continue;
+    }
+    // raw rules are not supported for csv
+    if (item.rule && item.rule->level() != StrictnessLevel::non_strict)
+      res.rules.push_back(std::move(*item.rule));
+  }
+  batch.clear();
+  lines.clear();
+}
+
+/**
+ * @brief Parse csv rules from the once decoded file
+ * @param feed Writes the input to the decoder of the inner base64 layer
+ */
+std::optional<CsvUploadResult> ParseCsvUpload(
+    const std::function<void(Base64StreamDecoder &)> &feed) noexcept {
+  constexpr size_t kColumnsRequired = 2;
+  try {
+    CsvUploadResult res;
+    std::optional<ThreadPool> pool;
+    std::vector<std::vector<std::string>> batch;
+    std::vector<size_t> batch_lines;
+    size_t batch_first_row = 0;
+    // Each stage passes its output to the next one by blocks:
+    // base64 -> utf-8 filter -> csv rows
+    csv::CsvRowReader reader(
+        [&](std::vector<std::string> &row, size_t i, size_t line) {
+          if (i == 0 && row.size() < kColumnsRequired)
+            throw std::runtime_error("Bad csv file");
+          if (batch.empty())
+            batch_first_row = i;
+          batch.push_back(std::move(row));
+          batch_lines.push_back(line);
+          if (batch.size() == kBatchRows)
+            ConvertCsvRows(batch, batch_lines, batch_first_row, pool, res);
+        });
+    common_utils::Utf8Filter filter(
+        [&reader](std::string_view chunk) { reader.Write(chunk); });
+    Base64StreamDecoder inner([&filter](std::string_view chunk) {
+      if (!filter.Write(chunk))
+        throw std::runtime_error("Bad utf-8 string");
+    });
+    feed(inner);
+    inner.Finish();
+    if (!filter.Finish())
+      throw std::runtime_error("Bad utf-8 string");
+    reader.Finish();
+    ConvertCsvRows(batch, batch_lines, batch_first_row, pool, res);
+    res.rows = reader.rows();
+    if (res.rows == 0) {
+      Log::Error() << "Bad csv file";
       return std::nullopt;
     }
-    Log::Debug() << "CSV rules number = " << res.size();
+    Log::Debug() << "Rows count " << res.rows;
+    if (res.failed_rows != 0) {
+      Log::Warning() << "Parsing of " << res.failed_rows << " rows was failed";
+    }
+    Log::Debug() << "CSV rules number = " << res.rules.size();
     return res;
   } catch (const std::exception &ex) {
     Log::Error() << "Can't parse a csv file";
+    Log::Error() << ex.what();
     return std::nullopt;
   }
 }
 
+} // namespace
+
+std::optional<CsvUploadResult>
+UploadRulesCsv(const std::string &file) noexcept {
+  // the file is base64 encoded twice
+  return ParseCsvUpload([&file](Base64StreamDecoder &inner) {
+    Base64StreamDecoder outer(
+        [&inner](std::string_view chunk) { inner.Write(chunk); });
+    const std::string_view input(file);
+    for (size_t pos = 0; pos < input.size();
+         pos += Base64StreamDecoder::kBlockSize) {
+      outer.Write(input.substr(pos, Base64StreamDecoder::kBlockSize));
+    }
+    outer.Finish();
+  });
+}
+
+std::optional<CsvUploadResult> UploadRulesCsv(std::istream &input) noexcept {
+  return ParseCsvUpload([&input](Base64StreamDecoder &inner) {
+    std::string block(Base64StreamDecoder::kBlockSize, '\0');
+    while (input) {
+      input.read(block.data(), static_cast<std::streamsize>(block.size()));
+      inner.Write(std::string_view(block.data(), input.gcount()));
+    }
+    if (input.bad())
+      throw std::runtime_error("Can't read the uploaded file");
+  });
+}
+
+boost::json::array
+BuildJsonArrayOfRowErrors(const std::vector<CsvRowError> &errors) {
+  boost::json::array res;
+  res.reserve(errors.size());
+  for (const CsvRowError &error : errors) {
+    boost::json::object obj;
+    obj["line"] = error.line;
+    obj["column"] = error.column;
+    obj["message"] = error.message;
+    res.emplace_back(std::move(obj));
+  }
+  return res;
+}
+
 std::optional<std::string>
 BuildJsonArrayOfUpploaded(const std::vector<GuardRule> &vec_rules) noexcept {
   namespace json = boost::json;
@@ -127,64 +264,7 @@ BuildJsonArrayOfUpploaded(const std::vector<GuardRule> &vec_rules) noexcept {
 }
 
 std::vector<std::string> FoldUsbInterfacesList(std::string i_type) {
-  boost::erase_first(i_type, "with-interface");
-  boost::trim(i_type);
-  std::vector<std::string> vec_i_types;
-  // if a multiple types in one string
-  if (i_type.find('{') != std::string::npos &&
-      i_type.find('}') != std::string::npos) {
-    std::vector<std::string> splitted;
-    boost::erase_all(i_type, "{");
-    boost::erase_all(i_type, "}");
-    boost::trim(i_type);
-    boost::split(splitted, i_type,
-                 [](const char symbol) { return symbol == ' '; });
-    // create sequence of usb types
-    std::vector<UsbType> vec_usb_types;
-    for (const std::string &usb_type : splitted) {
-      try {
-        vec_usb_types.emplace_back(usb_type);
-      } catch (const std::exception &e) {
-        Log::Error() << "Can't parse a usb type" << usb_type;
-        Log::Error() << e.what();
-      }
-    }
-    // fold if possible
-    // put to multiset bases
-    std::multiset<unsigned char> set;
-    for (const UsbType &usb_type : vec_usb_types) {
-      set.emplace(usb_type.base());
-    }
-    // if a key is not unique, create a mask.
-    auto it_unique_end =
-        std::unique(vec_usb_types.begin(), vec_usb_types.end(),
-                    [](const UsbType &first, const UsbType &second) {
-                      return first.base() == second.base();
-                    });
-    for (auto it = vec_usb_types.begin(); it != it_unique_end; ++it) {
-      size_t numb = set.count(it->base());
-      std::string tmp = it->base_str();
-      if (numb == 1) {
-        tmp += ':';
-        tmp += it->sub_str();
-        tmp += ':';
-        tmp += it->protocol_str();
-      } else {
-        tmp += ":*:*";
-      }
-      vec_i_types.emplace_back(std::move(tmp));
-    }
-  } else {
-    try {
-      UsbType tmp(i_type);
-    } catch (const std::exception &ex) {
-      Log::Error() << "Can't parse a usb type " << i_type;
-      Log::Error() << ex.what();
-    }
-    // push even if parsing failed
-    vec_i_types.push_back(std::move(i_type));
-  }
-  return vec_i_types;
+  return UsbInterfaceSet(i_type).Fold();
 }
 
 std::unordered_map<std::string, std::string>
@@ -506,6 +586,104 @@ bool IsSuspiciousUdevFile(const std::string &str_path) {
   return false;
 }
 
+bool WriteFileAtomic(const std::string &path, const std::string &content,
+                     bool keep_backup) noexcept {
+  namespace fs = std::filesystem;
+  std::string tmp_path;
+  int fd = -1;
+  try {
+    fs::path target(path);
+    fs::path dir = target.has_parent_path() ? target.parent_path() : ".";
+    tmp_path = (dir / ("." + target.filename().string() + ".XXXXXX")).string();
+    fd = mkstemp(tmp_path.data());
+    if (fd < 0) {
+      const int err = errno;
+      tmp_path.clear();
+      throw SysError(err, "Can't create a temporary file in " + dir.string());
+    }
+    // the same mode and owner as the target has
+    struct stat target_stat {};
+    if (stat(path.c_str(), &target_stat) == 0) {
+      if (fchmod(fd, target_stat.st_mode & 07777) != 0 ||
+          fchown(fd, target_stat.st_uid, target_stat.st_gid) != 0) {
+        Log::Warning() << "Can't copy permissions of " << path;
+      }
+    }
+    const char *ptr_data = content.data();
+    size_t left = content.size();
+    while (left > 0) {
+      ssize_t written = write(fd, ptr_data, left);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0) {
+        const int err = written < 0 ? errno : EIO;
+        throw SysError(err, "Can't write " + tmp_path);
+      }
+      ptr_data += written;
+      left -= static_cast<size_t>(written);
+    }
+    if (fsync(fd) != 0) {
+      const int err = errno;
+      throw SysError(err, "Can't fsync " + tmp_path);
+    }
+    int close_res = close(fd);
+    const int close_err = errno;
+    fd = -1;
+    if (close_res != 0)
+      throw SysError(close_err, "Can't close " + tmp_path);
+    // the backup is a hard link to the old version, so renaming the new file
+    // doesn't touch the backup
+    if (keep_backup && fs::exists(target)) {
+      const std::string bak_path = path + ".bak";
+      fs::remove(bak_path);
+      if (link(path.c_str(), bak_path.c_str()) != 0) {
+        fs::copy_file(target, bak_path, fs::copy_options::overwrite_existing);
+      }
+    }
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+      const int err = errno;
+      throw SysError(err, "Can't rename " + tmp_path + " to " + path);
+    }
+    tmp_path.clear();
+    // make the rename durable
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+      fsync(dir_fd);
+      close(dir_fd);
+    }
+  } catch (const std::exception &ex) {
+    Log::Error() << "[WriteFileAtomic] " << ex.what();
+    if (fd >= 0)
+      close(fd);
+    if (!tmp_path.empty())
+      unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool RestoreFileBackup(const std::string &path) noexcept {
+  const std::string bak_path = path + ".bak";
+  if (rename(bak_path.c_str(), path.c_str()) != 0) {
+    Log::Error() << "[RestoreFileBackup] Can't restore " << path << " from "
+                 << bak_path << " " << std::strerror(errno);
+    return false;
+  }
+  try {
+    std::filesystem::path target(path);
+    std::filesystem::path dir =
+        target.has_parent_path() ? target.parent_path() : ".";
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+      fsync(dir_fd);
+      close(dir_fd);
+    }
+  } catch (const std::exception &ex) {
+    Log::Warning() << "[RestoreFileBackup] " << ex.what();
+  }
+  return true;
+}
+
 std::unordered_map<std::string, std::string> InspectUdevRules(
 #ifdef UNIT_TEST
     const std::vector<std::string> *vec
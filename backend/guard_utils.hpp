@@ -5,6 +5,9 @@
  */
 
 #include "guard_rule.hpp"
+#include <boost/json/array.hpp>
+#include <cstddef>
+#include <istream>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -13,12 +16,43 @@
 
 namespace guard::utils {
 
+/// @brief A csv row which can't be converted to a rule
+struct CsvRowError {
+  size_t line = 0;   /// the line of the file from 0, empty lines counted
+  size_t column = 0; /// from 0
+  std::string message;
+};
+
+/// @brief Rules and errors of a csv upload
+struct CsvUploadResult {
+  std::vector<GuardRule> rules; /// in the file order
+  std::vector<CsvRowError> errors; /// the first kMaxRowErrors errors
+  size_t rows = 0;
+  size_t failed_rows = 0;
+
+  static constexpr size_t kMaxRowErrors = 1000;
+};
+
 /**
  * @brief Upload CSV rules from file, uploaded by user
  * @param file  file content
+ * @return std::nullopt if the file itself is bad (encoding, no rows)
+ * @details Rows are converted to rules on a thread pool, the order of the
+ * rules is kept. A bad row doesn't stop the conversion.
  */
-std::optional<std::vector<GuardRule>>
-UploadRulesCsv(const std::string &file) noexcept;
+std::optional<CsvUploadResult> UploadRulesCsv(const std::string &file) noexcept;
+
+/**
+ * @brief Upload CSV rules from a stream
+ * @param input The file content with the outer base64 layer decoded, for
+ * example a spooled chunked upload
+ * @return std::nullopt if the file itself is bad
+ */
+std::optional<CsvUploadResult> UploadRulesCsv(std::istream &input) noexcept;
+
+/// @brief [{"line":0,"column":3,"message":"..."},...]
+boost::json::array
+BuildJsonArrayOfRowErrors(const std::vector<CsvRowError> &errors);
 
 /**
  * @brief Build a json response for rules uploaded from csv
@@ -126,6 +160,25 @@ RuleConditions ConvertToConditionWithParam(RuleConditions cond) noexcept;
  */
 bool IsSuspiciousUdevFile(const std::string &str_path);
 
+/**
+ * @brief Atomically replace the content of a file
+ * @details The content is written to a temporary file in the same directory,
+ * flushed with fsync and renamed over the target, so the target is never
+ * truncated. The file mode and owner of the target are preserved.
+ * @param path Path to the target file
+ * @param content New content
+ * @param keep_backup Keep the previous version as path.bak
+ * @return true on success
+ */
+bool WriteFileAtomic(const std::string &path, const std::string &content,
+                     bool keep_backup) noexcept;
+
+/**
+ * @brief Atomically restore a file from path.bak created by WriteFileAtomic
+ * @return true on success
+ */
+bool RestoreFileBackup(const std::string &path) noexcept;
+
 /// @brief  inspect udev rules for suspicious files
 /// @param vec just for testing purposes
 /// @return map of string file:warning
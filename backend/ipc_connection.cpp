@@ -0,0 +1,97 @@
+#include "ipc_connection.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+namespace guard {
+
+using common_utils::Log;
+
+IpcConnection::IpcConnection(DeviceInventory &inventory) noexcept
+    : inventory_(inventory), next_attempt_(std::chrono::steady_clock::now()) {
+}
+
+bool IpcConnection::Connected() const noexcept {
+  try {
+    return client_ && client_->isConnected();
+  } catch (const std::exception &ex) {
+    Log::Error() << "[IpcConnection] " << ex.what();
+  }
+  return false;
+}
+
+bool IpcConnection::Connect() noexcept {
+  if (Connected())
+    return true;
+  if (std::chrono::steady_clock::now() < next_attempt_) {
+    Log::Debug() << "[IpcConnection] Waiting for the next attempt";
+    return false;
+  }
+  if (!DaemonActive())
+    return false;
+  return TryConnect();
+}
+
+bool IpcConnection::WaitReady(std::chrono::milliseconds timeout) noexcept {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!Connect()) {
+    auto now = std::chrono::steady_clock::now();
+    // a stopped unit never gets ready
+    if (now >= deadline || !DaemonActive()) {
+      Log::Warning() << "[IpcConnection] USBGuard is not ready";
+      return false;
+    }
+    auto wake_up = std::max(next_attempt_, now + kPollInterval);
+    std::this_thread::sleep_until(std::min(wake_up, deadline));
+  }
+  return true;
+}
+
+bool IpcConnection::TryConnect() noexcept {
+  const auto start = std::chrono::steady_clock::now();
+  try {
+    // the old client is destroyed first, its signals are not delivered anymore
+    client_.reset();
+    inventory_.Invalidate();
+    client_ = std::make_unique<InventoryIpcClient>(inventory_);
+    client_->connect();
+  } catch (const std::exception &ex) {
+    Log::Warning() << "Error connecting to USBGuard daemon.";
+    Log::Warning() << ex.what();
+  }
+  const auto now = std::chrono::steady_clock::now();
+  stats_.last_latency =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - start);
+  if (Connected()) {
+    ++stats_.connects;
+    if (was_connected_)
+      ++stats_.reconnects;
+    was_connected_ = true;
+    failures_in_row_ = 0;
+    next_attempt_ = now;
+    Log::Debug() << "[IpcConnection] Connected in "
+                 << stats_.last_latency.count() << " us";
+    return true;
+  }
+  ++stats_.failures;
+  // 100ms, 200ms ... 5s
+  auto delay = kBaseDelay * (1U << std::min(failures_in_row_, 6U));
+  next_attempt_ = now + std::min<std::chrono::milliseconds>(delay, kMaxDelay);
+  ++failures_in_row_;
+  return false;
+}
+
+bool IpcConnection::DaemonActive() noexcept {
+  if (!systemd_)
+    systemd_ = std::make_unique<dbus_bindings::Systemd>();
+  std::optional<bool> active = systemd_->IsUnitActive(kDaemonUnit);
+  if (!active.has_value()) {
+    // try to connect anyway, the dbus connection will be recreated
+    systemd_.reset();
+    return true;
+  }
+  return *active;
+}
+
+} // namespace guard
@@ -0,0 +1,84 @@
+#pragma once
+#include "device_inventory.hpp"
+#include "systemd_dbus.hpp"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#ifdef UNIT_TEST
+#include "test.hpp"
+#endif
+
+namespace guard {
+
+/**
+ * @class IpcConnection
+ * @brief Keeps one IPC connection to USBGuard
+ * @details A healthy connection is reused. A new connection is attempted
+ * only if the usbguard unit is active, failed attempts are repeated with
+ * a bounded exponential backoff, so a dead daemon doesn't slow every
+ * request down.
+ */
+class IpcConnection {
+public:
+  /// @brief Connection statistics
+  struct Stats {
+    uint64_t connects = 0;   /// successful connections
+    uint64_t reconnects = 0; /// connections after a lost one
+    uint64_t failures = 0;   /// failed attempts
+    std::chrono::microseconds last_latency{0}; /// the last connect duration
+  };
+
+  /// @brief Constructor, doesn't connect
+  /// @param inventory The inventory, fed by the client signals
+  explicit IpcConnection(DeviceInventory &inventory) noexcept;
+
+  /// @brief true if the client is connected
+  bool Connected() const noexcept;
+
+  /**
+   * @brief Reuse the connection or connect if allowed by the backoff
+   * @return true if connected
+   */
+  bool Connect() noexcept;
+
+  /**
+   * @brief Wait until the daemon accepts connections, for example after
+   * the unit was started
+   * @details systemd reports the unit active when the process runs, the
+   * IPC socket may appear later. Stops early if the unit isn't active.
+   * @param timeout Maximal waiting time
+   * @return true if connected
+   */
+  bool WaitReady(std::chrono::milliseconds timeout) noexcept;
+
+  /// @brief The client, nullptr if it was never created
+  inline InventoryIpcClient *client() noexcept { return client_.get(); }
+
+  inline const Stats &stats() const noexcept { return stats_; }
+
+private:
+  /// @brief One attempt to connect, updates the backoff and the stats
+  bool TryConnect() noexcept;
+  /// @brief true if the unit is active or its state is unknown
+  bool DaemonActive() noexcept;
+
+  static constexpr std::chrono::milliseconds kBaseDelay{100};
+  static constexpr std::chrono::milliseconds kMaxDelay{5000};
+  static constexpr std::chrono::milliseconds kPollInterval{50};
+  static constexpr const char *kDaemonUnit = "usbguard.service";
+
+  DeviceInventory &inventory_;
+  std::unique_ptr<InventoryIpcClient> client_;
+  std::unique_ptr<dbus_bindings::Systemd> systemd_;
+  unsigned int failures_in_row_ = 0;
+  std::chrono::steady_clock::time_point next_attempt_;
+  bool was_connected_ = false;
+  Stats stats_;
+
+#ifdef UNIT_TEST
+  friend class ::Test;
+#endif
+};
+
+} // namespace guard
@@ -0,0 +1,90 @@
+#include "ipc_rules_updater.hpp"
+#include "log.hpp"
+#include "rule_set_diff.hpp"
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace guard {
+
+using common_utils::Log;
+
+IpcRulesUpdater::IpcRulesUpdater(usbguard::IPCClient &ipc) noexcept
+    : ipc_(ipc) {}
+
+bool IpcRulesUpdater::Apply(
+    const std::vector<GuardRule> &target_rules) noexcept {
+  changes_sent_ = 0;
+  try {
+    if (!ipc_.isConnected())
+      return false;
+    std::vector<usbguard::Rule> daemon_rules = ipc_.listRules();
+    // Build the same string representation for the daemon rules and for the
+    // target rules to compare them.
+    std::vector<std::string> daemon_keys;
+    daemon_keys.reserve(daemon_rules.size());
+    for (const usbguard::Rule &rule : daemon_rules) {
+      daemon_keys.emplace_back(GuardRule(rule.toString()).CanonicalString());
+    }
+    std::vector<std::string> target_keys;
+    target_keys.reserve(target_rules.size());
+    for (const GuardRule &rule : target_rules) {
+      target_keys.emplace_back(rule.CanonicalString());
+    }
+    const RuleSetDiff diff(daemon_keys, target_keys);
+    // a moved rule is removed and inserted to the new position
+    size_t n_remove = diff.removed().size() + diff.moved().size();
+    size_t n_insert = diff.added().size() + diff.moved().size();
+    Log::Debug() << "[IpcRulesUpdater] Remove " << n_remove << " insert "
+                 << n_insert;
+    if (n_remove + n_insert > kMaxLiveChanges) {
+      Log::Info() << "[IpcRulesUpdater] Too many changes for a live update";
+      return false;
+    }
+    if (diff.Empty())
+      return true;
+    // the daemon rule ID for each target rule
+    std::vector<uint32_t> target_ids(target_rules.size(),
+                                     usbguard::Rule::RootID);
+    std::vector<bool> insert(target_rules.size(), false);
+    for (const RuleSetDiff::Match &match : diff.unchanged()) {
+      target_ids[match.second] = daemon_rules[match.first].getRuleID();
+    }
+    for (size_t pos : diff.added()) {
+      insert[pos] = true;
+    }
+    for (size_t pos : diff.removed()) {
+      ipc_.removeRule(daemon_rules[pos].getRuleID());
+      ++changes_sent_;
+    }
+    for (const RuleSetDiff::Match &match : diff.moved()) {
+      insert[match.second] = true;
+      ipc_.removeRule(daemon_rules[match.first].getRuleID());
+      ++changes_sent_;
+    }
+    // insert each rule right after its predecessor in the target order
+    for (size_t i = 0; i < target_rules.size(); ++i) {
+      if (!insert[i])
+        continue;
+      const uint32_t parent_id =
+          i == 0 ? usbguard::Rule::RootID : target_ids[i - 1];
+      target_ids[i] = ipc_.appendRule(target_rules[i].BuildString(true, true),
+                                      parent_id, true);
+      ++changes_sent_;
+    }
+  } catch (const usbguard::Exception &ex) {
+    Log::Error() << "[IpcRulesUpdater] IPC error after " << changes_sent_
+                 << " changes";
+    Log::Error() << ex.what();
+    return false;
+  } catch (const std::exception &ex) {
+    Log::Error() << "[IpcRulesUpdater] Can't apply rules via IPC";
+    Log::Error() << ex.what();
+    return false;
+  }
+  return true;
+}
+
+} // namespace guard
@@ -0,0 +1,45 @@
+#pragma once
+#include "guard_rule.hpp"
+#include <IPCClient.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace guard {
+
+/**
+ * @class IpcRulesUpdater
+ * @brief Applies a rule set to the running USBGuard daemon via IPC
+ * @details Only the difference between the daemon rules and the target rules
+ * (see RuleSetDiff) is sent (removeRule/appendRule), so the daemon is not
+ * restarted and the connected devices are not re-authorized. New and moved
+ * rules are inserted right after their predecessors.
+ */
+class IpcRulesUpdater {
+public:
+  /// @brief Constructor
+  /// @param ipc A connected IPC client
+  explicit IpcRulesUpdater(usbguard::IPCClient &ipc) noexcept;
+
+  /**
+   * @brief Bring the daemon rules to the target state
+   * @param target_rules Desired rules in the rules file order
+   * @return true if the daemon now holds the target rules
+   * @return false if a live update is impossible (the diff is too large,
+   * the daemon rules can't be parsed or an IPC call failed), the caller
+   * should fall back to rewriting the rules file
+   */
+  bool Apply(const std::vector<GuardRule> &target_rules) noexcept;
+
+  /// @brief Number of IPC calls made by the last Apply
+  inline size_t changes_sent() const noexcept { return changes_sent_; }
+
+private:
+  /// Maximal number of appendRule/removeRule calls for a live update
+  static constexpr size_t kMaxLiveChanges = 100;
+
+  usbguard::IPCClient &ipc_;
+  size_t changes_sent_ = 0;
+};
+
+} // namespace guard
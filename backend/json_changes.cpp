@@ -1,22 +1,31 @@
 #include "json_changes.hpp"
+#include "android_vidpid.hpp"
+#include "change_journal.hpp"
 #include "common_utils.hpp"
 #include "guard_rule.hpp"
+#include "guard_rule_builder.hpp"
+#include "ipc_rules_updater.hpp"
 #include "json_rule.hpp"
 #include "log.hpp"
+#include "rule_set_compactor.hpp"
+#include "rule_set_diff.hpp"
+#include "rule_set_validator.hpp"
 #include <boost/json/array.hpp>
 #include <boost/json/object.hpp>
 #include <boost/json/serialize.hpp>
 #include <exception>
-#include <filesystem>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <unordered_set>
 
 namespace guard::json {
 
 using common_utils::Log;
 
-JsonChanges::JsonChanges(const std::string &msg)
-    : p_jobj_(nullptr), daemon_activate_(false), target_policy_(Target::block),
+JsonChanges::JsonChanges(const std::string &msg, const ConfigStatus &config)
+    : config_(config), p_jobj_(nullptr), ptr_ipc_(nullptr),
+      daemon_activate_(false), target_policy_(Target::block),
       rules_changed_by_policy_(false) {
   std::logic_error common_ex("Can't parse JSON");
   try {
@@ -32,6 +41,7 @@ JsonChanges::JsonChanges(const std::string &msg)
   ExtractDaemonTargetState();
   ExtractTargetPolicy();
   ExtractPresetMode();
+  ExtractCompactMode();
 }
 
 void JsonChanges::ExtractDaemonTargetState() {
@@ -64,6 +74,17 @@ void JsonChanges::ExtractPresetMode() {
   throw std::runtime_error("No preset mode is found in JSON");
 }
 
+void JsonChanges::ExtractCompactMode() noexcept {
+  // presets that add a rule per device are compacted by default
+  compact_rules_ = preset_mode_ == "put_connected_to_white_list" ||
+                   preset_mode_ == "put_connected_to_white_list_plus_HID" ||
+                   preset_mode_ == "block_and_reject_android";
+  if (p_jobj_ != nullptr && p_jobj_->contains("compact_rules") &&
+      p_jobj_->at("compact_rules").is_string()) {
+    compact_rules_ = p_jobj_->at("compact_rules").as_string() == "true";
+  }
+}
+
 std::string JsonChanges::Process(bool apply) {
   if (preset_mode_ == "manual_mode") {
     ProcessManualMode();
@@ -107,6 +128,25 @@ std::string JsonChanges::Process(bool apply) {
 
   obj_result_["rules_PRESET"] = AddAppendByPresetToResponse();
 
+  // add rules_to_add to new rules vector
+  for (auto &rule : rules_to_add_)
+    new_rules_.push_back(std::move(rule));
+  if (compact_rules_) {
+    RuleSetCompactor compactor;
+    new_rules_ = compactor.Compact(new_rules_);
+    obj_result_["COMPACTION"] = compactor.report().BuildJsonObject();
+  }
+  bool structure_ok = ValidateResultingRules();
+  if (!structure_ok)
+    obj_result_["STATUS"] = "BAD";
+  // a preview of the changes, only if the current rules were read
+  std::optional<RuleSetDiff> diff;
+  if (current_rules_) {
+    diff.emplace(*current_rules_, new_rules_);
+    if (!diff->Empty())
+      obj_result_["DIFF"] = diff->BuildJsonObject(new_rules_);
+  }
+
   // Log::Debug() << obj_result_;
   //  if we dont need to apply the rules
   if (!apply) {
@@ -114,79 +154,117 @@ std::string JsonChanges::Process(bool apply) {
     return json::serialize(obj_result_);
   }
   obj_result_["ACTION"] = "apply";
-  config_.ChangeImplicitPolicy(target_policy_ == Target::block);
-  // add rules_to_add to new rules vector
-  for (auto &rule : rules_to_add_)
-    new_rules_.push_back(std::move(rule));
+  if (!structure_ok)
+    throw std::logic_error("The resulting rule set is not valid");
+  const bool policy_changed = config_.implicit_policy() != target_policy_;
   std::string str_new_rules;
   for (const auto &rule : new_rules_) {
     str_new_rules += rule.BuildString(true, true);
     str_new_rules += "\n";
   }
-  // Log::Debug() << "new rules " << str_new_rules;
-  // overwrite the rules and test launch if some rules were added or deleted
-  if (rules_changed_by_policy_ || !rules_to_delete_.empty() ||
-      !rules_to_add_.empty()) {
-    if (!config_.OverwriteRulesFile(str_new_rules, daemon_activate_)) {
-      Log::Error() << "Can't launch the daemon with new rules";
-      throw std::runtime_error("Can't launch the daemon with new rules");
+  const bool rules_changed =
+      diff ? !diff->Empty()
+           : rules_changed_by_policy_ || !rules_to_delete_.empty() ||
+                 !rules_to_add_.empty();
+  // record the intended state, an interrupted transaction is finished on
+  // the next start
+  JournalState target_state;
+  target_state.policy = target_policy_;
+  if (rules_changed)
+    target_state.rules = str_new_rules;
+  target_state.daemon_active = daemon_activate_;
+  target_state.daemon_enabled = daemon_activate_;
+  ChangeJournal own_journal;
+  ChangeJournal &journal =
+      ptr_journal_ != nullptr ? *ptr_journal_ : own_journal;
+  if (!journal.Begin(ChangeJournal::CurrentState(config_), target_state))
+    throw std::runtime_error("Can't write the change journal");
+  try {
+    config_.ChangeImplicitPolicy(target_policy_ == Target::block);
+    // Log::Debug() << "new rules " << str_new_rules;
+    // apply the rules via IPC if possible, otherwise
+    // overwrite the rules and test launch if some rules were added or deleted
+    if (rules_changed) {
+      if (ApplyRulesLive(policy_changed)) {
+        obj_result_["APPLY_MODE"] = "live";
+      } else if (config_.OverwriteRulesFile(str_new_rules, daemon_activate_)) {
+        obj_result_["APPLY_MODE"] = "restart";
+      } else {
+        Log::Error() << "Can't launch the daemon with new rules";
+        throw std::runtime_error("Can't launch the daemon with new rules");
+      }
     }
+    if (!config_.ChangeDaemonStatus(daemon_activate_, daemon_activate_))
+      throw std::runtime_error("Change the daemon status FAILED");
+  } catch (const std::exception &) {
+    journal.Rollback(config_);
+    throw;
   }
-  if (!config_.ChangeDaemonStatus(daemon_activate_, daemon_activate_))
-    throw std::runtime_error("Change the daemon status FAILED");
+  journal.Commit();
   return json::serialize(obj_result_);
 }
 
-void JsonChanges::AddBlockAndroid() {
-  const std::string path_to_vidpid = "/etc/usbguard/android_vidpid.json";
-  try {
-    if (!std::filesystem::exists(path_to_vidpid)) {
-      throw(std::runtime_error("android_vidpid.json file doesn't exist"));
-    }
-  } catch (const std::exception &ex) {
-    Log::Error() << "Can't find file " << path_to_vidpid << "\n" << ex.what();
-    throw std::runtime_error("android_vidpid file is missing");
+const RuleSet &JsonChanges::CurrentRules() {
+  if (!current_rules_) {
+    // make sure that old rules were successfully parsed
+    current_rules_ = config_.ParseGuardRuleSet();
+    if (!current_rules_)
+      throw std::logic_error(
+          "The rules file is not completelly parsed, can't edit");
+  }
+  return *current_rules_;
+}
+
+bool JsonChanges::ValidateResultingRules() {
+  RuleSetValidator validator(target_policy_);
+  bool res = validator.Validate(new_rules_);
+  if (!validator.errors().empty()) {
+    json::array errors;
+    for (const auto &diag : validator.errors())
+      errors.emplace_back(json::object{{"id", diag.id}, {"msg", diag.message}});
+    obj_result_["STRUCTURE_ERRORS"] = std::move(errors);
   }
-  std::stringstream buf;
-  std::ifstream file_vid_pid(path_to_vidpid);
-  if (!file_vid_pid.is_open()) {
-    Log::Error() << "Can't open file" << path_to_vidpid;
-    throw std::runtime_error("android_vidpid file is missing");
+  if (!validator.warnings().empty()) {
+    json::array warnings;
+    for (const auto &diag : validator.warnings())
+      warnings.emplace_back(
+          json::object{{"id", diag.id}, {"msg", diag.message}});
+    obj_result_["STRUCTURE_WARNINGS"] = std::move(warnings);
   }
-  buf << file_vid_pid.rdbuf();
-  file_vid_pid.close();
+  return res;
+}
 
-  boost::json::value json;
-  boost::json::array *ptr_arr;
-  try {
-    json = boost::json::parse(buf.str());
-  } catch (const std::exception &ex) {
-    Log::Error() << "Can't parse a JSON file";
-    throw std::runtime_error("Can't parse the android_vidpid file");
-  }
-  ptr_arr = json.if_array();
-  if (ptr_arr == nullptr || ptr_arr->empty()) {
-    Log::Error() << "Empty json array";
-    throw std::runtime_error("An empty android_vidpid file");
-  }
-  for (const auto &element : *ptr_arr) {
-    if (element.is_object() && element.as_object().contains("vid") &&
-        element.as_object().contains("pid")) {
-      std::stringstream string_builder;
-      string_builder << "block id "
-                     << common_utils::UnQuote(
-                            element.as_object().at("vid").as_string().c_str())
-                     << ":"
-                     << common_utils::UnQuote(
-                            element.as_object().at("pid").as_string().c_str());
-      try {
-        rules_to_add_.emplace_back(string_builder.str());
-        added_by_preset_.emplace_back(string_builder.str());
-      } catch (const std::logic_error &ex) {
-        Log::Warning() << "Error creating a rule from JSON";
-        Log::Warning() << string_builder.str();
-        throw std::logic_error("Error creating a rule from JSON");
-      }
+bool JsonChanges::ApplyRulesLive(bool policy_changed) noexcept {
+  // The implicit policy is read by the daemon only at start,
+  // a stopped daemon reads the rules file anyway.
+  if (ptr_ipc_ == nullptr || policy_changed || !daemon_activate_ ||
+      !config_.guard_daemon_active())
+    return false;
+  IpcRulesUpdater updater(*ptr_ipc_);
+  if (!updater.Apply(new_rules_)) {
+    Log::Warning() << "Can't apply the rules via IPC, the rules file will be "
+                      "overwritten";
+    return false;
+  }
+  Log::Info() << "Rules were applied via IPC, changes sent "
+              << updater.changes_sent();
+  return true;
+}
+
+void JsonChanges::AddBlockAndroid() {
+  const std::vector<AndroidVidPid::Entry> entries = AndroidVidPid().Load();
+  rules_to_add_.reserve(rules_to_add_.size() + entries.size());
+  added_by_preset_.reserve(added_by_preset_.size() + entries.size());
+  for (const AndroidVidPid::Entry &entry : entries) {
+    const std::string vid = common_utils::vidpid_table::ToHex(entry.vid);
+    const std::string pid =
+        entry.any_pid ? "*" : common_utils::vidpid_table::ToHex(entry.pid);
+    try {
+      rules_to_add_.emplace_back(Target::block, vid, pid);
+      added_by_preset_.push_back(rules_to_add_.back());
+    } catch (const std::logic_error &ex) {
+      Log::Warning() << "Error creating a rule for " << vid << ':' << pid;
+      throw std::logic_error("Error creating a rule for an android device");
     }
   }
 }
@@ -234,13 +312,19 @@ boost::json::object JsonChanges::AddAppendByPresetToResponse() const {
 
 void JsonChanges::AddBlockUsbStorages() {
   try {
-    rules_to_add_.emplace_back("block with-interface 08:*:*");
-    added_by_preset_.emplace_back("block with-interface 08:*:*");
-    rules_to_add_.emplace_back("block with-interface 06:*:*");
-    added_by_preset_.emplace_back("block with-interface 06:*:*");
-    rules_to_add_.emplace_back("block with-interface one-of { 06:*:* 08:*:* }");
-    added_by_preset_.emplace_back(
-        "block with-interface one-of { 06:*:* 08:*:* }");
+    for (const GuardRule &rule :
+         {GuardRuleBuilder(Target::block)
+              .Interfaces(RuleOperator::no_operator, {"08:*:*"})
+              .Build(),
+          GuardRuleBuilder(Target::block)
+              .Interfaces(RuleOperator::no_operator, {"06:*:*"})
+              .Build(),
+          GuardRuleBuilder(Target::block)
+              .Interfaces(RuleOperator::one_of, {"06:*:*", "08:*:*"})
+              .Build()}) {
+      rules_to_add_.push_back(rule);
+      added_by_preset_.push_back(rule);
+    }
   } catch (const std::logic_error &ex) {
     Log::Error() << "Can't add a rules for USB storages";
     Log::Error() << ex.what();
@@ -250,10 +334,13 @@ void JsonChanges::AddBlockUsbStorages() {
 
 void JsonChanges::AddAllowHid() {
   try {
-    rules_to_add_.emplace_back("allow with-interface 03:*:*");
-    rules_to_add_.emplace_back("allow with-interface 09:*:*");
-    added_by_preset_.emplace_back("allow with-interface 03:*:*");
-    added_by_preset_.emplace_back("allow with-interface 09:*:*");
+    for (const char *interface : {"03:*:*", "09:*:*"}) {
+      GuardRule rule = GuardRuleBuilder(Target::allow)
+                           .Interfaces(RuleOperator::no_operator, {interface})
+                           .Build();
+      rules_to_add_.push_back(rule);
+      added_by_preset_.push_back(std::move(rule));
+    }
   } catch (const std::logic_error &ex) {
     Log::Error() << "Can't add a rules for HID devices";
     Log::Error() << ex.what();
@@ -265,14 +352,18 @@ void JsonChanges::ProcessAllowConnected() {
   if (!active_devices_.has_value()) {
     throw std::logic_error("No active devices list found");
   }
+  // identical devices give equal rules, add each rule once
+  RuleSet added;
   for (const UsbDevice &dev : active_devices_.value()) {
-    std::stringstream string_builder;
-    string_builder << "allow name "
-                   << common_utils::QuoteIfNotQuoted(dev.name()) << " hash "
-                   << common_utils::QuoteIfNotQuoted(dev.hash());
     try {
-      rules_to_add_.emplace_back(string_builder.str());
-      added_by_preset_.emplace_back(string_builder.str());
+      GuardRule rule = GuardRuleBuilder(Target::allow)
+                           .Name(dev.name())
+                           .Hash(dev.hash())
+                           .Build();
+      if (!added.AddUnique(rule))
+        continue;
+      rules_to_add_.push_back(rule);
+      added_by_preset_.push_back(std::move(rule));
     } catch (const std::logic_error &ex) {
       Log::Error() << "Can't create a rule for device"
                    << "allow name "
@@ -309,41 +400,32 @@ void JsonChanges::ProcessManualMode() {
 }
 
 void JsonChanges::DeleteAllOldRules() {
-  // make sure that old rules were successfully parsed
-  std::pair<std::vector<guard::GuardRule>, uint> parsed_rules =
-      config_.ParseGuardRulesFile();
-  if (parsed_rules.first.size() != parsed_rules.second)
-    throw std::logic_error(
-        "The rules file is not completelly parsed, can't edit");
-  for (const auto &rule : parsed_rules.first) {
+  for (const auto &rule : CurrentRules()) {
     rules_deleted_.push_back(rule.number());
   }
 }
 
 void JsonChanges::DeleteRules() {
-  // make sure that old rules were successfully parsed
-  std::pair<std::vector<guard::GuardRule>, uint> parsed_rules =
-      config_.ParseGuardRulesFile();
-  if (parsed_rules.first.size() != parsed_rules.second)
-    throw std::logic_error(
-        "The rules file is not completelly parsed, can't edit");
-  // copy old rules,except listed in rule_indexes
-  std::set<uint> unique_indexes(rules_to_delete_.cbegin(),
-                                rules_to_delete_.cend());
-  for (const auto &rule : parsed_rules.first) {
-    if (unique_indexes.count(rule.number()) == 0) {
-      // skip rules with conflicting policy,place rest to new_rules
-      // if implicit policy="allow" rules must be block or reject
-      if ((target_policy_ == Target::allow &&
-           (rule.target() == Target::block ||
-            rule.target() == Target::reject)) ||
-          (target_policy_ == Target::block && rule.target() == Target::allow)) {
-        new_rules_.push_back(rule);
-      } else {
-        rules_changed_by_policy_ = true;
-        rules_deleted_.push_back(rule.number());
-      }
+  const RuleSet &current = CurrentRules();
+  // the listed rules are found by the number index
+  std::unordered_set<uint> deleted;
+  for (uint number : rules_to_delete_) {
+    if (current.FindByNumber(number) != nullptr &&
+        deleted.insert(number).second)
+      rules_deleted_.push_back(number);
+  }
+  // skip rules with conflicting policy, place rest to new_rules
+  for (const auto &rule : current) {
+    if (deleted.count(rule.number()) != 0)
+      continue;
+    // if implicit policy="allow" rules must be block or reject
+    if ((target_policy_ == Target::allow &&
+         (rule.target() == Target::block ||
+          rule.target() == Target::reject)) ||
+        (target_policy_ == Target::block && rule.target() == Target::allow)) {
+      new_rules_.push_back(rule);
     } else {
+      rules_changed_by_policy_ = true;
       rules_deleted_.push_back(rule.number());
     }
   }
@@ -358,6 +440,7 @@ void JsonChanges::ProcessJsonAppended() {
     return;
   boost::json::array json_arr_OK;
   boost::json::array json_arr_BAD;
+  boost::json::object json_bad_messages;
   for (const auto &rule : *ptr_json_array_rules) {
     const boost::json::object *ptr_json_rule = rule.if_object();
     if (ptr_json_rule != nullptr && ptr_json_rule->contains("tr_id")) {
@@ -365,8 +448,7 @@ void JsonChanges::ProcessJsonAppended() {
       // try to build a rule
       try {
         guard::json::JsonRule json_rule(ptr_json_rule);
-        GuardRule rule_new{json_rule.BuildString()};
-        ;
+        GuardRule rule_new = json_rule.Build();
         if (rule_new.target() == target_policy_) {
           throw std::logic_error("Redundant rule");
         }
@@ -381,12 +463,15 @@ void JsonChanges::ProcessJsonAppended() {
         Log::Error() << ex.what();
         if (tr_id != nullptr && !tr_id->empty()) {
           json_arr_BAD.emplace_back(*tr_id);
+          json_bad_messages[*tr_id] = ex.what();
         }
       }
     }
   }
   obj_result_["rules_OK"] = std::move(json_arr_OK);
   obj_result_["rules_BAD"] = std::move(json_arr_BAD);
+  if (!json_bad_messages.empty())
+    obj_result_["rules_BAD_MSG"] = std::move(json_bad_messages);
 }
 
 } // namespace guard::json
\ No newline at end of file
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "change_journal.hpp"
 #include "config_status.hpp"
 #include "guard.hpp"
 #include "guard_rule.hpp"
+#include "rule_set.hpp"
 #include "usb_device.hpp"
+#include <IPCClient.hpp>
 #include <boost/json.hpp>
 #include <boost/json/object.hpp>
 #include <optional>
@@ -14,9 +17,30 @@ namespace guard::json {
 
 namespace json = boost::json;
 
+/**
+ * @class JsonChanges
+ * @brief Builds the resulting rule set from the current rules and the changes
+ * recieved from the web-interface
+ * @details The validation is performed in memory, files and the daemon are
+ * touched only by Process(true).
+ */
 class JsonChanges {
 public:
-  explicit JsonChanges(const std::string &msg);
+  /**
+   * @brief Constructor
+   * @param msg JSON string with changes
+   * @param config The current configuration
+   * @throws std::logic_error,std::runtime_error
+   */
+  JsonChanges(const std::string &msg, const ConfigStatus &config);
+
+  /**
+   * @brief Set the current rules, otherwise they are parsed from the rules
+   * file once
+   */
+  inline void current_rules(std::vector<GuardRule> &&rules) {
+    current_rules_.emplace(std::move(rules));
+  }
 
   inline bool ActiveDeviceListNeeded() const noexcept {
     return preset_mode_ == "put_connected_to_white_list" ||
@@ -27,12 +51,48 @@ public:
     active_devices_ = std::move(devices);
   }
 
+  /**
+   * @brief Set the IPC client used to apply the rules without restarting
+   * the daemon
+   * @param ptr_ipc A connected client or nullptr
+   */
+  inline void ipc_client(usbguard::IPCClient *ptr_ipc) noexcept {
+    ptr_ipc_ = ptr_ipc;
+  }
+
+  /**
+   * @brief Set the journal, which was locked before the current state was
+   * read, otherwise Process(true) locks its own journal
+   */
+  inline void journal(ChangeJournal *ptr_journal) noexcept {
+    ptr_journal_ = ptr_journal;
+  }
+
   std::string Process(bool apply);
 
 private:
   void ExtractDaemonTargetState();
   void ExtractTargetPolicy();
   void ExtractPresetMode();
+  /**
+   * @brief Optional "compact_rules":"true"|"false" - merge per-device rules
+   * @details On by default for the presets adding a rule per device:
+   * allowing connected devices and blocking android devices.
+   */
+  void ExtractCompactMode() noexcept;
+
+  /**
+   * @brief Current rules, the rules file is parsed only on the first call
+   * @throws std::logic_error if the rules file is not completely parsed
+   */
+  const RuleSet &CurrentRules();
+
+  /**
+   * @brief Check the resulting rule set new_rules_, put errors and warnings
+   * to obj_result_
+   * @return true if no structural errors were found
+   */
+  bool ValidateResultingRules();
 
   /**
    * @brief fills obj_result_,rules_to_delete_, rules_deleted_,rules_to_add_
@@ -81,14 +141,23 @@ private:
 
   /**
    * @brief Add androide devicese to rules_to_add_ with "block"
-   *
+   * @details The binary table is used, the JSON list is a fallback
+   * @throws std::runtime_error if no list can be read
    */
   void AddBlockAndroid();
 
+  /**
+   * @brief Try to apply new_rules_ to the running daemon via IPC
+   * @param policy_changed True if the implicit policy was changed
+   * @return true if the rules were applied without a daemon restart
+   */
+  bool ApplyRulesLive(bool policy_changed) noexcept;
+
   boost::json::object AddAppendByPresetToResponse() const;
 
   // default init
   std::string preset_mode_;
+  std::optional<RuleSet> current_rules_;
   std::vector<GuardRule> new_rules_;
   std::vector<uint> rules_to_delete_;
   std::vector<uint> rules_deleted_;
@@ -100,9 +169,12 @@ private:
   json::value json_value_;
 
   json::object *p_jobj_;
+  usbguard::IPCClient *ptr_ipc_;
+  ChangeJournal *ptr_journal_ = nullptr;
   bool daemon_activate_;
   Target target_policy_;
   bool rules_changed_by_policy_;
+  bool compact_rules_ = false;
 };
 
 } // namespace guard::json
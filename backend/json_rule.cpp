@@ -1,4 +1,5 @@
 #include "json_rule.hpp"
+#include "guard_rule_builder.hpp"
 #include <sstream>
 
 namespace guard::json {
@@ -59,6 +60,31 @@ std::string JsonRule::BuildString() const noexcept {
   return string_builder.str();
 }
 
+GuardRule JsonRule::Build() const {
+  if (!raw_.empty())
+    return GuardRule(raw_);
+  GuardRuleBuilder builder(target_);
+  if (!vid_.empty())
+    builder.Id(vid_, pid_);
+  if (!serial_.empty())
+    builder.Serial(serial_);
+  if (!device_name_.empty())
+    builder.Name(device_name_);
+  if (!hash_.empty())
+    builder.Hash(hash_);
+  if (!parent_hash_.empty())
+    builder.ParentHash(parent_hash_);
+  if (!port_.empty())
+    builder.Port(port_);
+  if (!interface_.empty())
+    builder.Interfaces(interface_);
+  if (!connection_.empty())
+    builder.ConnectType(connection_);
+  if (!condition_.empty())
+    builder.Conditions(condition_);
+  return builder.Build();
+}
+
 void JsonRule::ParseOneField(const boost::json::object *ptr_field) {
   for (const auto &field_obj : *ptr_field) {
     std::string field =
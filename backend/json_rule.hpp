@@ -1,4 +1,5 @@
 #pragma once
+#include "guard_rule.hpp"
 #include <boost/json.hpp>
 #include <string>
 
@@ -9,6 +10,13 @@ public:
   explicit JsonRule(const boost::json::object *ptr_obj);
   std::string BuildString() const noexcept;
 
+  /**
+   * @brief Build the rule from the fields, without a rule string
+   * @details A raw rule is still parsed
+   * @throws std::logic_error
+   */
+  GuardRule Build() const;
+
 private:
   std::string target_;
   std::string vid_;
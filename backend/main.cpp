@@ -1,3 +1,5 @@
+#include "change_journal.hpp"
+#include "config_status.hpp"
 #include "dispatcher_impl.hpp"
 #include "guard.hpp"
 #include "lisp_message.hpp"
@@ -5,6 +7,11 @@
 #include "message_reader.hpp"
 
 int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
+  // finish the changes interrupted by a crash
+  {
+    guard::ConfigStatus config;
+    guard::ChangeJournal().Recover(config);
+  }
   guard::Guard guard;
   guard::DispatcherImpl impl(guard);
   auto dispatcher_func = [&impl](const LispMessage &msg) {
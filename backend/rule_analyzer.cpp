@@ -0,0 +1,331 @@
+#include "rule_analyzer.hpp"
+#include "common_utils.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <array>
+#include <boost/json/array.hpp>
+#include <unordered_map>
+
+namespace guard {
+
+using common_utils::UnQuote;
+
+namespace {
+
+/// @brief Compare optional string attributes, the rule values may be quoted
+bool CoversString(const std::optional<std::string> &first,
+                  const std::optional<std::string> &second) {
+  if (!first)
+    return true;
+  return second && UnQuote(*first) == UnQuote(*second);
+}
+
+/// @brief vid or pid, "*" is the same as no value
+bool CoversId(const std::optional<std::string> &first,
+              const std::optional<std::string> &second) {
+  if (!first || *first == "*")
+    return true;
+  return second && *first == *second;
+}
+
+/// @brief The operator requires all device values to match the rule values
+bool IsEquals(RuleOperator rule_operator) {
+  return rule_operator == RuleOperator::equals ||
+         rule_operator == RuleOperator::no_operator;
+}
+
+} // namespace
+
+RuleAnalyzer::RuleAnalyzer(const std::vector<GuardRule> &rules) {
+  // canonical string : position
+  std::unordered_map<std::string, size_t> seen;
+  // earlier rules, that can cover other rules, by the most specific key
+  std::unordered_map<std::string, std::vector<size_t>> by_hash;
+  std::unordered_map<std::string, std::vector<size_t>> by_vid_pid;
+  std::unordered_map<std::string, std::vector<size_t>> by_vid;
+  std::vector<size_t> generic;
+  static const std::vector<size_t> empty;
+  auto find = [](const auto &index,
+                 const std::string &key) -> const std::vector<size_t> & {
+    auto it = index.find(key);
+    return it != index.end() ? it->second : empty;
+  };
+  for (size_t pos = 0; pos < rules.size(); ++pos) {
+    const GuardRule &rule = rules[pos];
+    auto [it_seen, inserted] = seen.try_emplace(rule.CanonicalString(), pos);
+    if (!inserted) {
+      findings_.push_back({RuleFinding::Kind::duplicate, pos, it_seen->second});
+      continue;
+    }
+    const std::string hash = UnQuote(rule.hash());
+    const std::string vid = rule.vid().value_or("*");
+    const std::string pid = rule.pid().value_or("*");
+    // the earliest rule covering this one
+    std::optional<size_t> cover;
+    const std::array<const std::vector<size_t> *, 4> buckets{
+        &find(by_hash, hash), &find(by_vid_pid, vid + ':' + pid),
+        &find(by_vid, vid), &generic};
+    for (const std::vector<size_t> *bucket : buckets) {
+      for (size_t candidate : *bucket) {
+        if (cover && candidate > *cover)
+          break;
+        if (Covers(rules[candidate], rule))
+          cover = candidate;
+      }
+    }
+    if (cover) {
+      findings_.push_back({rules[*cover].target() == rule.target()
+                               ? RuleFinding::Kind::shadowed
+                               : RuleFinding::Kind::contradiction,
+                           pos, *cover});
+    }
+    // only rules without runtime conditions can cover
+    if (RuleEvaluator::EvaluateConditions(rule) != true)
+      continue;
+    if (!hash.empty()) {
+      by_hash[hash].push_back(pos);
+    } else if (vid != "*" && pid != "*") {
+      by_vid_pid[vid + ':' + pid].push_back(pos);
+    } else if (vid != "*") {
+      by_vid[vid].push_back(pos);
+    } else {
+      generic.push_back(pos);
+    }
+  }
+  std::sort(findings_.begin(), findings_.end(),
+            [](const RuleFinding &lhs, const RuleFinding &rhs) {
+              return lhs.pos < rhs.pos;
+            });
+}
+
+boost::json::object
+RuleAnalyzer::BuildJsonObject(const std::vector<GuardRule> &rules) const {
+  boost::json::array duplicates;
+  boost::json::array shadowed;
+  boost::json::array contradictions;
+  for (const RuleFinding &finding : findings_) {
+    boost::json::object obj;
+    obj["rule"] = rules[finding.pos].number();
+    obj["by"] = rules[finding.by].number();
+    switch (finding.kind) {
+    case RuleFinding::Kind::duplicate:
+      duplicates.emplace_back(std::move(obj));
+      break;
+    case RuleFinding::Kind::shadowed:
+      shadowed.emplace_back(std::move(obj));
+      break;
+    case RuleFinding::Kind::contradiction:
+      contradictions.emplace_back(std::move(obj));
+      break;
+    }
+  }
+  boost::json::object res;
+  res["duplicates"] = std::move(duplicates);
+  res["shadowed"] = std::move(shadowed);
+  res["contradictions"] = std::move(contradictions);
+  return res;
+}
+
+bool RuleAnalyzer::Covers(const GuardRule &first, const GuardRule &second) {
+  if (RuleEvaluator::EvaluateConditions(first) != true)
+    return false;
+  if (!CoversId(first.vid(), second.vid()) ||
+      !CoversId(first.pid(), second.pid()))
+    return false;
+  if (first.ids() && !CoversIds(*first.ids(), second))
+    return false;
+  if (first.hashes() && !CoversHashes(*first.hashes(), second))
+    return false;
+  std::optional<std::string> first_hash;
+  std::optional<std::string> second_hash;
+  if (!first.hash().empty())
+    first_hash = first.hash();
+  if (!second.hash().empty())
+    second_hash = second.hash();
+  std::optional<std::string> first_name;
+  std::optional<std::string> second_name;
+  if (!first.device_name().empty())
+    first_name = first.device_name();
+  if (!second.device_name().empty())
+    second_name = second.device_name();
+  if (!CoversString(first_hash, second_hash) ||
+      !CoversString(first.parent_hash(), second.parent_hash()) ||
+      !CoversString(first_name, second_name) ||
+      !CoversString(first.serial(), second.serial()) ||
+      !CoversString(first.conn_type(), second.conn_type()))
+    return false;
+  if (first.port() &&
+      (!second.port() || !CoversPorts(*first.port(), *second.port())))
+    return false;
+  if (first.with_interface() &&
+      (!second.with_interface() ||
+       !CoversInterfaces(*first.with_interface(), *second.with_interface())))
+    return false;
+  return true;
+}
+
+std::optional<RuleAnalyzer::ValueSet> RuleAnalyzer::ToValueSet(
+    const std::pair<RuleOperator, std::vector<std::string>> &attribute) {
+  ValueSet res;
+  for (const std::string &value : attribute.second)
+    res.values.insert(UnQuote(value));
+  switch (attribute.first) {
+  case RuleOperator::one_of:
+    return res;
+  case RuleOperator::none_of:
+    res.complement = true;
+    return res;
+  default:
+    // a device has one port, it can't be equal to several values
+    if (res.values.size() != 1)
+      return std::nullopt;
+    return res;
+  }
+}
+
+bool RuleAnalyzer::CoversIds(
+    const std::pair<RuleOperator, std::vector<std::string>> &first,
+    const GuardRule &second) {
+  // wildcards are not expanded
+  auto has_wildcard = [](const std::string &value) {
+    return value.find('*') != std::string::npos;
+  };
+  if (std::any_of(first.second.cbegin(), first.second.cend(), has_wildcard))
+    return false;
+  if (second.ids())
+    return CoversValues(ToValueSet(first), ToValueSet(*second.ids()));
+  if (!second.vid() || !second.pid())
+    return false;
+  const std::string id = *second.vid() + ':' + *second.pid();
+  if (has_wildcard(id))
+    return false;
+  return CoversValues(ToValueSet(first), ValueSet{false, {id}});
+}
+
+bool RuleAnalyzer::CoversHashes(
+    const std::pair<RuleOperator, std::vector<std::string>> &first,
+    const GuardRule &second) {
+  if (second.hashes())
+    return CoversValues(ToValueSet(first), ToValueSet(*second.hashes()));
+  if (second.hash().empty())
+    return false;
+  return CoversValues(ToValueSet(first),
+                      ValueSet{false, {UnQuote(second.hash())}});
+}
+
+bool RuleAnalyzer::CoversPorts(
+    const std::pair<RuleOperator, std::vector<std::string>> &first,
+    const std::pair<RuleOperator, std::vector<std::string>> &second) {
+  return CoversValues(ToValueSet(first), ToValueSet(second));
+}
+
+bool RuleAnalyzer::CoversValues(const std::optional<ValueSet> &first_set,
+                                const std::optional<ValueSet> &second_set) {
+  if (!first_set || !second_set)
+    return false;
+  auto contains = [](const std::set<std::string> &outer,
+                     const std::set<std::string> &inner) {
+    return std::includes(outer.cbegin(), outer.cend(), inner.cbegin(),
+                         inner.cend());
+  };
+  if (!first_set->complement && !second_set->complement)
+    return contains(first_set->values, second_set->values);
+  if (first_set->complement && second_set->complement)
+    return contains(second_set->values, first_set->values);
+  if (first_set->complement) {
+    return std::none_of(second_set->values.cbegin(),
+                        second_set->values.cend(),
+                        [&first_set](const std::string &value) {
+                          return first_set->values.count(value) != 0;
+                        });
+  }
+  return false;
+}
+
+bool RuleAnalyzer::CoversInterfaces(
+    const std::pair<RuleOperator, std::vector<std::string>> &first,
+    const std::pair<RuleOperator, std::vector<std::string>> &second) {
+  std::optional<std::vector<InterfacePattern>> first_patterns =
+      RuleEvaluator::CompileInterfaces(first);
+  std::optional<std::vector<InterfacePattern>> second_patterns =
+      RuleEvaluator::CompileInterfaces(second);
+  if (!first_patterns || !second_patterns || first_patterns->empty() ||
+      second_patterns->empty())
+    return false;
+  const std::vector<InterfacePattern> &outer = *first_patterns;
+  const std::vector<InterfacePattern> &inner = *second_patterns;
+  // each pattern of the first rule contains a pattern of the second
+  auto each_outer_contains_inner = [&]() {
+    return std::all_of(outer.cbegin(), outer.cend(),
+                       [&](const InterfacePattern &out) {
+                         return std::any_of(
+                             inner.cbegin(), inner.cend(),
+                             [&](const InterfacePattern &in) {
+                               return Contains(out, in);
+                             });
+                       });
+  };
+  // each pattern of the second rule is contained in a pattern of the first
+  auto each_inner_contained = [&]() {
+    return std::all_of(inner.cbegin(), inner.cend(),
+                       [&](const InterfacePattern &in) {
+                         return std::any_of(
+                             outer.cbegin(), outer.cend(),
+                             [&](const InterfacePattern &out) {
+                               return Contains(out, in);
+                             });
+                       });
+  };
+  // the second rule guarantees a device interface for each its pattern
+  const bool inner_all = second.first == RuleOperator::all_of ||
+                         second.first == RuleOperator::equals_ordered ||
+                         IsEquals(second.first);
+  switch (first.first) {
+  case RuleOperator::one_of:
+    if (second.first == RuleOperator::one_of)
+      return each_inner_contained();
+    return inner_all &&
+           std::any_of(inner.cbegin(), inner.cend(),
+                       [&](const InterfacePattern &in) {
+                         return std::any_of(outer.cbegin(), outer.cend(),
+                                            [&](const InterfacePattern &out) {
+                                              return Contains(out, in);
+                                            });
+                       });
+  case RuleOperator::all_of:
+    return inner_all && each_outer_contains_inner();
+  case RuleOperator::equals:
+  case RuleOperator::no_operator:
+    // all device interfaces are matched by the second rule patterns
+    return IsEquals(second.first) && each_inner_contained() &&
+           each_outer_contains_inner();
+  case RuleOperator::none_of:
+    return IsEquals(second.first) &&
+           std::all_of(inner.cbegin(), inner.cend(),
+                       [&](const InterfacePattern &in) {
+                         return std::all_of(
+                             outer.cbegin(), outer.cend(),
+                             [&](const InterfacePattern &out) {
+                               return Disjoint(out, in);
+                             });
+                       });
+  case RuleOperator::equals_ordered:
+    return second.first == RuleOperator::equals_ordered && outer == inner;
+  }
+  return false;
+}
+
+bool RuleAnalyzer::Contains(const InterfacePattern &outer,
+                            const InterfacePattern &inner) noexcept {
+  // the inner pattern fixes at least the same parts with the same values
+  return (outer.second & inner.second) == outer.second &&
+         (inner.first & outer.second) == outer.first;
+}
+
+bool RuleAnalyzer::Disjoint(const InterfacePattern &first,
+                            const InterfacePattern &second) noexcept {
+  const uint32_t common = first.second & second.second;
+  return (first.first & common) != (second.first & common);
+}
+
+} // namespace guard
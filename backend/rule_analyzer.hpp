@@ -0,0 +1,110 @@
+#pragma once
+#include "guard_rule.hpp"
+#include "rule_evaluator.hpp"
+#include <boost/json/object.hpp>
+#include <cstddef>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef UNIT_TEST
+#include "test.hpp"
+#endif
+
+namespace guard {
+
+/// @brief A problem found in a rule set
+struct RuleFinding {
+  enum class Kind {
+    duplicate,    /// the same rule appears earlier
+    shadowed,     /// an earlier rule with the same target always matches first
+    contradiction /// an earlier rule with another target always matches first
+  };
+  Kind kind;
+  size_t pos; /// position of the rule that never fires
+  size_t by;  /// position of the earlier rule
+};
+
+/**
+ * @class RuleAnalyzer
+ * @brief Finds rules that never fire
+ * @details A rule never fires if an earlier rule matches every device it
+ * matches (covers it). The check is conservative: a cover is reported only
+ * if it follows from the rule attributes, rules with runtime conditions
+ * never cover other rules.
+ * Earlier rules are indexed by hash, vid:pid and vid, a rule is compared
+ * only with the earlier rules from its buckets and with the generic bucket.
+ */
+class RuleAnalyzer {
+public:
+  /// @brief Analyze the rules
+  explicit RuleAnalyzer(const std::vector<GuardRule> &rules);
+
+  inline const std::vector<RuleFinding> &findings() const noexcept {
+    return findings_;
+  }
+
+  /**
+   * @brief Findings for the UI
+   * @param rules The same rules
+   * @return {"duplicates":[],"shadowed":[],"contradictions":[]}, each
+   * element is {"rule":number,"by":number}
+   */
+  boost::json::object
+  BuildJsonObject(const std::vector<GuardRule> &rules) const;
+
+  /**
+   * @brief Check if the first rule matches every device, matched by the
+   * second rule
+   */
+  static bool Covers(const GuardRule &first, const GuardRule &second);
+
+private:
+  using InterfacePattern = RuleEvaluator::InterfacePattern;
+
+  /// @brief Allowed values of a single-valued attribute (via-port, id)
+  struct ValueSet {
+    bool complement = false; /// all values except values
+    std::set<std::string> values;
+  };
+
+  static std::optional<ValueSet> ToValueSet(
+      const std::pair<RuleOperator, std::vector<std::string>> &attribute);
+
+  /// @brief true if every value of the second set is in the first one
+  static bool CoversValues(const std::optional<ValueSet> &first_set,
+                           const std::optional<ValueSet> &second_set);
+
+  static bool
+  CoversIds(const std::pair<RuleOperator, std::vector<std::string>> &first,
+            const GuardRule &second);
+
+  static bool
+  CoversHashes(const std::pair<RuleOperator, std::vector<std::string>> &first,
+               const GuardRule &second);
+
+  static bool CoversPorts(
+      const std::pair<RuleOperator, std::vector<std::string>> &first,
+      const std::pair<RuleOperator, std::vector<std::string>> &second);
+
+  static bool CoversInterfaces(
+      const std::pair<RuleOperator, std::vector<std::string>> &first,
+      const std::pair<RuleOperator, std::vector<std::string>> &second);
+
+  /// @brief true if every type matching inner matches outer
+  static bool Contains(const InterfacePattern &outer,
+                       const InterfacePattern &inner) noexcept;
+
+  /// @brief true if no type matches both patterns
+  static bool Disjoint(const InterfacePattern &first,
+                       const InterfacePattern &second) noexcept;
+
+  std::vector<RuleFinding> findings_;
+
+#ifdef UNIT_TEST
+  friend class ::Test;
+#endif
+};
+
+} // namespace guard
@@ -0,0 +1,315 @@
+#include "rule_evaluator.hpp"
+#include "common_utils.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <limits>
+#include <string_view>
+
+namespace guard {
+
+using common_utils::Log;
+using common_utils::UnQuote;
+
+namespace {
+
+/**
+ * @brief Match a set of device values against a set of rule values
+ * @param applies bool(rule_value, device_value)
+ * @details A value without an operator is the same as "equals"
+ */
+template <typename RuleValue, typename DeviceValue, typename Predicat>
+bool MatchSet(RuleOperator rule_operator,
+              const std::vector<RuleValue> &rule_values,
+              const std::vector<DeviceValue> &device_values,
+              const Predicat &applies) {
+  auto applies_to_any = [&](const RuleValue &rule_value) {
+    return std::any_of(device_values.cbegin(), device_values.cend(),
+                       [&](const DeviceValue &device_value) {
+                         return applies(rule_value, device_value);
+                       });
+  };
+  auto applied_by_any = [&](const DeviceValue &device_value) {
+    return std::any_of(rule_values.cbegin(), rule_values.cend(),
+                       [&](const RuleValue &rule_value) {
+                         return applies(rule_value, device_value);
+                       });
+  };
+  switch (rule_operator) {
+  case RuleOperator::all_of:
+    return std::all_of(rule_values.cbegin(), rule_values.cend(),
+                       applies_to_any);
+  case RuleOperator::one_of:
+    return std::any_of(rule_values.cbegin(), rule_values.cend(),
+                       applies_to_any);
+  case RuleOperator::none_of:
+    return std::none_of(rule_values.cbegin(), rule_values.cend(),
+                        applies_to_any);
+  case RuleOperator::equals_ordered:
+    if (rule_values.size() != device_values.size())
+      return false;
+    for (size_t i = 0; i < rule_values.size(); ++i) {
+      if (!applies(rule_values[i], device_values[i]))
+        return false;
+    }
+    return true;
+  case RuleOperator::equals:
+  case RuleOperator::no_operator:
+    return std::all_of(rule_values.cbegin(), rule_values.cend(),
+                       applies_to_any) &&
+           std::all_of(device_values.cbegin(), device_values.cend(),
+                       applied_by_any);
+  }
+  return false;
+}
+
+/// @brief Compare a rule id "vid:pid", wildcards are allowed, with a device
+bool IdApplies(const std::string &rule_value, const std::string &device_id) {
+  const size_t rule_sep = rule_value.find(':');
+  const size_t device_sep = device_id.find(':');
+  if (rule_sep == std::string::npos || device_sep == std::string::npos)
+    return false;
+  const std::string_view rule_id(rule_value);
+  const std::string_view id(device_id);
+  const std::string_view vid = rule_id.substr(0, rule_sep);
+  const std::string_view pid = rule_id.substr(rule_sep + 1);
+  return (vid == "*" || vid == id.substr(0, device_sep)) &&
+         (pid == "*" || pid == id.substr(device_sep + 1));
+}
+
+/// @brief Compare a rule value, maybe quoted, with a device value
+bool EqualsUnquoted(const std::string &rule_value,
+                    const std::string &device_value) {
+  return rule_value == device_value || UnQuote(rule_value) == device_value;
+}
+
+} // namespace
+
+RuleEvaluator::RuleEvaluator(const std::vector<GuardRule> &rules,
+                             Target implicit_policy)
+    : rules_(rules), implicit_policy_(implicit_policy),
+      interfaces_(rules.size()) {
+  for (size_t pos = 0; pos < rules_.size(); ++pos) {
+    const GuardRule &rule = rules_[pos];
+    if (rule.with_interface())
+      interfaces_[pos] = CompileInterfaces(*rule.with_interface());
+    const std::string hash = UnQuote(rule.hash());
+    if (!hash.empty()) {
+      by_hash_[hash].push_back(pos);
+      continue;
+    }
+    const std::string vid = rule.vid().value_or("*");
+    const std::string pid = rule.pid().value_or("*");
+    if (vid != "*" && pid != "*") {
+      by_vid_pid_[vid + ':' + pid].push_back(pos);
+    } else if (vid != "*") {
+      by_vid_[vid].push_back(pos);
+    } else {
+      generic_.push_back(pos);
+    }
+  }
+}
+
+RuleVerdict RuleEvaluator::Evaluate(const UsbDevice &device) const noexcept {
+  RuleVerdict verdict{std::nullopt, implicit_policy_, true};
+  try {
+    static const std::vector<size_t> empty;
+    auto find = [](const auto &index, const std::string &key)
+        -> const std::vector<size_t> & {
+      auto it = index.find(key);
+      return it != index.end() ? it->second : empty;
+    };
+    // candidates from the buckets, merged in the rules order
+    const std::array<const std::vector<size_t> *, 4> buckets{
+        &find(by_hash_, device.hash()),
+        &find(by_vid_pid_, device.vid() + ':' + device.pid()),
+        &find(by_vid_, device.vid()), &generic_};
+    std::array<size_t, 4> next{0, 0, 0, 0};
+    while (true) {
+      size_t min_pos = std::numeric_limits<size_t>::max();
+      size_t min_bucket = buckets.size();
+      for (size_t i = 0; i < buckets.size(); ++i) {
+        if (next[i] < buckets[i]->size() &&
+            (*buckets[i])[next[i]] < min_pos) {
+          min_pos = (*buckets[i])[next[i]];
+          min_bucket = i;
+        }
+      }
+      if (min_bucket == buckets.size())
+        break;
+      ++next[min_bucket];
+      if (Check(min_pos, device, verdict))
+        break;
+    }
+  } catch (const std::exception &ex) {
+    Log::Error() << "[RuleEvaluator] " << ex.what();
+    verdict = {std::nullopt, implicit_policy_, false};
+  }
+  return verdict;
+}
+
+std::vector<RuleVerdict>
+RuleEvaluator::Evaluate(const std::vector<UsbDevice> &devices) const noexcept {
+  std::vector<RuleVerdict> res;
+  try {
+    res.reserve(devices.size());
+    for (const UsbDevice &device : devices)
+      res.push_back(Evaluate(device));
+  } catch (const std::exception &ex) {
+    Log::Error() << "[RuleEvaluator] " << ex.what();
+    res.clear();
+  }
+  return res;
+}
+
+bool RuleEvaluator::Check(size_t pos, const UsbDevice &device,
+                          RuleVerdict &verdict) const noexcept {
+  const GuardRule &rule = rules_[pos];
+  if (!MatchAttributes(rule, device, interfaces_[pos]))
+    return false;
+  std::optional<bool> conditions = EvaluateConditions(rule);
+  if (conditions.has_value() && !*conditions)
+    return false;
+  verdict.rule = pos;
+  verdict.target = rule.target();
+  verdict.certain = conditions.has_value();
+  return true;
+}
+
+bool RuleEvaluator::Matches(const GuardRule &rule,
+                            const UsbDevice &device) noexcept {
+  if (!rule.with_interface())
+    return MatchAttributes(rule, device, {});
+  return MatchAttributes(rule, device,
+                         CompileInterfaces(*rule.with_interface()));
+}
+
+bool RuleEvaluator::MatchAttributes(
+    const GuardRule &rule, const UsbDevice &device,
+    const std::optional<std::vector<InterfacePattern>> &interfaces) noexcept {
+  try {
+    if (rule.vid() && *rule.vid() != "*" && *rule.vid() != device.vid())
+      return false;
+    if (rule.pid() && *rule.pid() != "*" && *rule.pid() != device.pid())
+      return false;
+    if (rule.ids() &&
+        !MatchSet(rule.ids()->first, rule.ids()->second,
+                  std::vector<std::string>{device.vid() + ':' + device.pid()},
+                  IdApplies))
+      return false;
+    if (!rule.hash().empty() && !EqualsUnquoted(rule.hash(), device.hash()))
+      return false;
+    if (rule.hashes() &&
+        !MatchSet(rule.hashes()->first, rule.hashes()->second,
+                  std::vector<std::string>{device.hash()}, EqualsUnquoted))
+      return false;
+    if (rule.parent_hash() &&
+        !EqualsUnquoted(*rule.parent_hash(), device.parent_hash()))
+      return false;
+    if (!rule.device_name().empty() &&
+        !EqualsUnquoted(rule.device_name(), device.name()))
+      return false;
+    if (rule.serial() && !EqualsUnquoted(*rule.serial(), device.serial()))
+      return false;
+    if (rule.conn_type() &&
+        !EqualsUnquoted(*rule.conn_type(), device.connection()))
+      return false;
+    if (rule.port() &&
+        !MatchSet(rule.port()->first, rule.port()->second,
+                  std::vector<std::string>{device.port()}, EqualsUnquoted))
+      return false;
+    if (rule.with_interface() &&
+        (!interfaces || !MatchSet(rule.with_interface()->first, *interfaces,
+                                  device.interfaces().types(),
+                                  InterfaceApplies)))
+      return false;
+  } catch (const std::exception &ex) {
+    Log::Error() << "[RuleEvaluator] " << ex.what();
+    return false;
+  }
+  return true;
+}
+
+std::optional<bool>
+RuleEvaluator::EvaluateConditions(const GuardRule &rule) noexcept {
+  if (!rule.conditions())
+    return true;
+  std::vector<bool> values;
+  for (const RuleWithBool &condition : rule.conditions()->second) {
+    bool value = false;
+    if (condition.second.first == RuleConditions::always_true)
+      value = true;
+    else if (condition.second.first == RuleConditions::always_false)
+      value = false;
+    else
+      return std::nullopt;
+    // the first element is false for a negated condition
+    values.push_back(condition.first ? value : !value);
+  }
+  auto is_true = [](bool value) { return value; };
+  switch (rule.conditions()->first) {
+  case RuleOperator::one_of:
+    return std::any_of(values.cbegin(), values.cend(), is_true);
+  case RuleOperator::none_of:
+    return std::none_of(values.cbegin(), values.cend(), is_true);
+  default:
+    return std::all_of(values.cbegin(), values.cend(), is_true);
+  }
+}
+
+std::optional<RuleEvaluator::InterfacePattern>
+RuleEvaluator::ParseInterfacePattern(const std::string &str) noexcept {
+  // replace wildcards with zeros, set the mask for the rest
+  std::string digits = str;
+  uint32_t mask = 0;
+  size_t part = 0;
+  size_t begin = 0;
+  while (part < 3) {
+    size_t end = digits.find(':', begin);
+    if (end == std::string::npos)
+      end = digits.size();
+    if (digits.compare(begin, end - begin, "*") == 0) {
+      digits[begin] = '0';
+    } else {
+      mask |= 0xFFu << (8 * (2 - part));
+    }
+    ++part;
+    begin = end + 1;
+    if (end == digits.size())
+      break;
+  }
+  if (part != 3)
+    return std::nullopt;
+  std::optional<UsbType> usb_type = UsbType::Parse(digits);
+  if (!usb_type)
+    return std::nullopt;
+  return InterfacePattern{usb_type->packed() & mask, mask};
+}
+
+std::optional<std::vector<RuleEvaluator::InterfacePattern>>
+RuleEvaluator::CompileInterfaces(
+    const std::pair<RuleOperator, std::vector<std::string>>
+        &with_interface) noexcept {
+  try {
+    std::vector<InterfacePattern> res;
+    res.reserve(with_interface.second.size());
+    for (const std::string &str : with_interface.second) {
+      std::optional<InterfacePattern> pattern = ParseInterfacePattern(str);
+      if (!pattern)
+        return std::nullopt;
+      res.push_back(*pattern);
+    }
+    return res;
+  } catch (const std::exception &ex) {
+    Log::Error() << "[RuleEvaluator] " << ex.what();
+  }
+  return std::nullopt;
+}
+
+bool RuleEvaluator::InterfaceApplies(const InterfacePattern &pattern,
+                                     const UsbType &usb_type) noexcept {
+  return (usb_type.packed() & pattern.second) == pattern.first;
+}
+
+} // namespace guard
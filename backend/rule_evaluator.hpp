@@ -0,0 +1,109 @@
+#pragma once
+#include "guard_rule.hpp"
+#include "usb_device.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef UNIT_TEST
+#include "test.hpp"
+#endif
+
+namespace guard {
+
+/// @brief The result of rules evaluation for one device
+struct RuleVerdict {
+  std::optional<size_t> rule; /// position of the first matching rule
+  Target target;              /// the rule target or the implicit policy
+  bool certain = true; /// false if the rule has a condition, known at runtime
+};
+
+/**
+ * @class RuleEvaluator
+ * @brief Predicts which rule the daemon applies to a device, offline
+ * @details Evaluates id, hash, parent-hash, name, serial, via-port,
+ * with-interface and with-connect-type with all operators, as USBGuard does.
+ * The first matching rule wins, the implicit policy is used if no rule
+ * matches. Rules are indexed by hash, vid:pid and vid, so only a few
+ * candidates are checked for a device, the rest of the rules are in
+ * the generic bucket.
+ * A rule with a runtime condition (localtime, random, ...) stops the
+ * evaluation with an uncertain result.
+ * @warning The rules must outlive the evaluator.
+ */
+class RuleEvaluator {
+public:
+  /**
+   * @brief Constructor
+   * @param rules Rules in the rules file order
+   * @param implicit_policy The implicit policy of the daemon
+   */
+  RuleEvaluator(const std::vector<GuardRule> &rules,
+                Target implicit_policy);
+
+  /// @brief The verdict for a device
+  RuleVerdict Evaluate(const UsbDevice &device) const noexcept;
+
+  /// @brief Verdicts for the devices, in the same order
+  std::vector<RuleVerdict>
+  Evaluate(const std::vector<UsbDevice> &devices) const noexcept;
+
+  /**
+   * @brief Check device attributes against the rule
+   * @return true if all attributes of the rule match, conditions are not
+   * checked
+   */
+  static bool Matches(const GuardRule &rule,
+                      const UsbDevice &device) noexcept;
+
+  /**
+   * @brief Evaluate the conditions, if they don't depend on runtime
+   * @return std::nullopt if the result is known only at runtime
+   */
+  static std::optional<bool> EvaluateConditions(const GuardRule &rule) noexcept;
+
+  /// @brief "03:*:*" -> value and mask
+  using InterfacePattern = std::pair<uint32_t, uint32_t>;
+
+  /// @brief Parse a with-interface value, wildcards are allowed
+  static std::optional<InterfacePattern>
+  ParseInterfacePattern(const std::string &str) noexcept;
+
+  /// @return std::nullopt if a value can't be parsed, such rule never
+  /// matches
+  static std::optional<std::vector<InterfacePattern>> CompileInterfaces(
+      const std::pair<RuleOperator, std::vector<std::string>>
+          &with_interface) noexcept;
+
+private:
+  static bool InterfaceApplies(const InterfacePattern &pattern,
+                               const UsbType &usb_type) noexcept;
+
+  static bool MatchAttributes(
+      const GuardRule &rule, const UsbDevice &device,
+      const std::optional<std::vector<InterfacePattern>> &interfaces) noexcept;
+
+  /// @brief Check a rule from the index
+  bool Check(size_t pos, const UsbDevice &device,
+             RuleVerdict &verdict) const noexcept;
+
+  const std::vector<GuardRule> &rules_;
+  Target implicit_policy_;
+  // rule positions, ascending
+  std::unordered_map<std::string, std::vector<size_t>> by_hash_;
+  std::unordered_map<std::string, std::vector<size_t>> by_vid_pid_;
+  std::unordered_map<std::string, std::vector<size_t>> by_vid_;
+  std::vector<size_t> generic_;
+  /// compiled with-interface values, by the rule position
+  std::vector<std::optional<std::vector<InterfacePattern>>> interfaces_;
+
+#ifdef UNIT_TEST
+  friend class ::Test;
+#endif
+};
+
+} // namespace guard
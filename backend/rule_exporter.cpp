@@ -0,0 +1,91 @@
+#include "rule_exporter.hpp"
+#include "common_utils.hpp"
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/json/object.hpp>
+#include <boost/json/serialize.hpp>
+#include <utility>
+
+namespace guard {
+
+using common_utils::UnQuote;
+
+RuleExporter::RuleExporter(ExportFormat format, Sink sink) noexcept
+    : format_(format), sink_(std::move(sink)) {}
+
+bool RuleExporter::Write(const GuardRule &rule) {
+  std::string line;
+  if (format_ == ExportFormat::csv) {
+    std::optional<std::string> row = CsvRow(rule);
+    if (!row) {
+      ++skipped_;
+      return false;
+    }
+    line = std::move(*row);
+  } else {
+    line = JsonLine(rule);
+  }
+  line.push_back('\n');
+  sink_(line);
+  ++exported_;
+  return true;
+}
+
+std::optional<ExportFormat>
+RuleExporter::StrToFormat(const std::string &str) noexcept {
+  if (str == "csv")
+    return ExportFormat::csv;
+  if (str == "ndjson")
+    return ExportFormat::ndjson;
+  return std::nullopt;
+}
+
+std::string RuleExporter::FormatToString(ExportFormat format) noexcept {
+  return format == ExportFormat::csv ? "csv" : "ndjson";
+}
+
+std::optional<std::string> RuleExporter::CsvRow(const GuardRule &rule) {
+  // the import has no columns for these attributes
+  if (rule.parent_hash() || rule.serial() || rule.conn_type() ||
+      rule.port() || rule.conditions() || rule.ids() || rule.hashes())
+    return std::nullopt;
+  // the hash covers the name, "name ... hash ..." is written as the hash
+  if (!rule.device_name().empty() && rule.hash().empty())
+    return std::nullopt;
+  const bool has_id = rule.vid() && rule.pid();
+  if (!has_id && rule.hash().empty() && !rule.with_interface())
+    return std::nullopt;
+  std::string res = GuardRule::TargetToString(rule.target());
+  res += ',';
+  res += boost::algorithm::trim_copy(rule.InterfacesToString(true));
+  res += ',';
+  if (has_id)
+    res += *rule.vid() + ':' + *rule.pid();
+  res += ',';
+  res += UnQuote(rule.hash());
+  // the vendor name may contain commas and quotes
+  const std::string vendor = rule.vendor_name().value_or("");
+  if (!vendor.empty()) {
+    res += ",\"";
+    for (const char symbol : vendor) {
+      if (symbol == '"')
+        res += '"';
+      res += symbol;
+    }
+    res += '"';
+  }
+  return res;
+}
+
+std::string RuleExporter::JsonLine(const GuardRule &rule) {
+  boost::json::object obj;
+  obj["number"] = rule.number();
+  obj["target"] = GuardRule::TargetToString(rule.target());
+  obj["id"] = rule.vid() && rule.pid() ? *rule.vid() + ':' + *rule.pid() : "";
+  obj["hash"] = UnQuote(rule.hash());
+  obj["interface"] = boost::algorithm::trim_copy(rule.InterfacesToString(true));
+  obj["vendor_name"] = rule.vendor_name().value_or("");
+  obj["rule"] = rule.BuildString(true, true);
+  return boost::json::serialize(obj);
+}
+
+} // namespace guard
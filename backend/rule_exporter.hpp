@@ -0,0 +1,61 @@
+#pragma once
+#include "guard_rule.hpp"
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace guard {
+
+/// @brief Formats of the rules export
+enum class ExportFormat { csv, ndjson };
+
+/**
+ * @class RuleExporter
+ * @brief Writes rules one by one as CSV rows or JSON lines
+ * @details A CSV row has the columns of the import (target, interface,
+ * vid:pid, hash) and the vendor name, which the import ignores. The name
+ * of a rule with a hash is dropped, the hash covers it. Rules with other
+ * attributes can't be written as CSV and are skipped. A JSON line
+ * has the rule string and its fields, any rule can be written. Each line
+ * is passed to the sink as soon as it is built.
+ */
+class RuleExporter {
+public:
+  using Sink = std::function<void(std::string_view)>;
+
+  RuleExporter(ExportFormat format, Sink sink) noexcept;
+
+  /**
+   * @brief Write a rule
+   * @return false if the rule can't be written in the format
+   */
+  bool Write(const GuardRule &rule);
+
+  inline size_t exported() const noexcept { return exported_; }
+  inline size_t skipped() const noexcept { return skipped_; }
+
+  /// @brief "csv" or "ndjson"
+  static std::optional<ExportFormat>
+  StrToFormat(const std::string &str) noexcept;
+
+  static std::string FormatToString(ExportFormat format) noexcept;
+
+  /**
+   * @brief Build a CSV row without the line break
+   * @return std::nullopt if the rule has attributes out of the CSV columns
+   */
+  static std::optional<std::string> CsvRow(const GuardRule &rule);
+
+  /// @brief Build a JSON object without the line break
+  static std::string JsonLine(const GuardRule &rule);
+
+private:
+  ExportFormat format_;
+  Sink sink_;
+  size_t exported_ = 0;
+  size_t skipped_ = 0;
+};
+
+} // namespace guard
@@ -0,0 +1,162 @@
+#include "rule_set.hpp"
+#include "common_utils.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace guard {
+
+using common_utils::UnQuote;
+
+RuleSet::ConstIterator::ConstIterator(const RuleSet *set, size_t pos) noexcept
+    : set_(set), pos_(pos) {
+  SkipRemoved();
+}
+
+RuleSet::ConstIterator &RuleSet::ConstIterator::operator++() noexcept {
+  ++pos_;
+  SkipRemoved();
+  return *this;
+}
+
+RuleSet::ConstIterator RuleSet::ConstIterator::operator++(int) noexcept {
+  ConstIterator res = *this;
+  ++*this;
+  return res;
+}
+
+void RuleSet::ConstIterator::SkipRemoved() noexcept {
+  while (pos_ < set_->rules_.size() && set_->removed_[pos_])
+    ++pos_;
+}
+
+RuleSet::RuleSet(std::vector<GuardRule> rules) : rules_(std::move(rules)) {
+  canonical_.reserve(rules_.size());
+  removed_.assign(rules_.size(), false);
+  size_ = rules_.size();
+  for (size_t pos = 0; pos < rules_.size(); ++pos) {
+    canonical_.emplace_back(rules_[pos].CanonicalString());
+    next_number_ = std::max(next_number_, rules_[pos].number() + 1);
+    AddToIndexes(pos);
+  }
+}
+
+uint RuleSet::Add(GuardRule rule) {
+  std::string canonical = rule.CanonicalString();
+  return Add(std::move(rule), std::move(canonical));
+}
+
+uint RuleSet::Add(GuardRule rule, std::string canonical) {
+  rule.number(next_number_++);
+  canonical_.push_back(std::move(canonical));
+  rules_.push_back(std::move(rule));
+  removed_.push_back(false);
+  ++size_;
+  AddToIndexes(rules_.size() - 1);
+  return rules_.back().number();
+}
+
+bool RuleSet::AddUnique(GuardRule rule) {
+  // the canonical string is the costly part, build it once
+  std::string canonical = rule.CanonicalString();
+  if (!Lookup(by_canonical_, canonical).empty())
+    return false;
+  Add(std::move(rule), std::move(canonical));
+  return true;
+}
+
+bool RuleSet::Remove(uint number) noexcept {
+  auto it = by_number_.find(number);
+  if (it == by_number_.end())
+    return false;
+  const size_t pos = it->second;
+  by_number_.erase(it);
+  RemoveFromIndex(by_hash_, UnQuote(rules_[pos].hash()), pos);
+  RemoveFromIndex(by_vid_pid_, VidPidKey(rules_[pos]), pos);
+  RemoveFromIndex(by_canonical_, canonical_[pos], pos);
+  removed_[pos] = true;
+  --size_;
+  return true;
+}
+
+const GuardRule *RuleSet::FindByNumber(uint number) const noexcept {
+  auto it = by_number_.find(number);
+  return it != by_number_.end() ? &rules_[it->second] : nullptr;
+}
+
+const GuardRule *RuleSet::FindEqual(const GuardRule &rule) const {
+  std::vector<const GuardRule *> res =
+      Lookup(by_canonical_, rule.CanonicalString());
+  return res.empty() ? nullptr : res.front();
+}
+
+std::vector<const GuardRule *>
+RuleSet::FindByHash(const std::string &hash) const {
+  return Lookup(by_hash_, UnQuote(hash));
+}
+
+std::vector<const GuardRule *>
+RuleSet::FindByVidPid(const std::string &vid, const std::string &pid) const {
+  return Lookup(by_vid_pid_, vid + ':' + pid);
+}
+
+std::vector<GuardRule> RuleSet::ToVector() const {
+  std::vector<GuardRule> res;
+  res.reserve(size_);
+  for (const GuardRule &rule : *this)
+    res.push_back(rule);
+  return res;
+}
+
+std::vector<std::string> RuleSet::CanonicalStrings() const {
+  std::vector<std::string> res;
+  res.reserve(size_);
+  for (size_t pos = 0; pos < rules_.size(); ++pos) {
+    if (!removed_[pos])
+      res.push_back(canonical_[pos]);
+  }
+  return res;
+}
+
+void RuleSet::AddToIndexes(size_t pos) {
+  const GuardRule &rule = rules_[pos];
+  by_number_[rule.number()] = pos;
+  const std::string hash = UnQuote(rule.hash());
+  if (!hash.empty())
+    by_hash_[hash].push_back(pos);
+  const std::string vid_pid = VidPidKey(rule);
+  if (!vid_pid.empty())
+    by_vid_pid_[vid_pid].push_back(pos);
+  by_canonical_[canonical_[pos]].push_back(pos);
+}
+
+std::vector<const GuardRule *> RuleSet::Lookup(const Index &index,
+                                               const std::string &key) const {
+  std::vector<const GuardRule *> res;
+  auto it = index.find(key);
+  if (it == index.end())
+    return res;
+  res.reserve(it->second.size());
+  for (size_t pos : it->second)
+    res.push_back(&rules_[pos]);
+  return res;
+}
+
+void RuleSet::RemoveFromIndex(Index &index, const std::string &key,
+                              size_t pos) noexcept {
+  auto it = index.find(key);
+  if (it == index.end())
+    return;
+  auto &positions = it->second;
+  positions.erase(std::remove(positions.begin(), positions.end(), pos),
+                  positions.end());
+  if (positions.empty())
+    index.erase(it);
+}
+
+std::string RuleSet::VidPidKey(const GuardRule &rule) {
+  if (!rule.vid() || !rule.pid())
+    return {};
+  return *rule.vid() + ':' + *rule.pid();
+}
+
+} // namespace guard
@@ -0,0 +1,126 @@
+#pragma once
+#include "guard_rule.hpp"
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef UNIT_TEST
+#include "test.hpp"
+#endif
+
+namespace guard {
+
+/**
+ * @class RuleSet
+ * @brief Rules in the rules file order with lookup by number, hash, vid:pid
+ * and the canonical string
+ * @details A removed rule leaves a gap, so positions and numbers of the
+ * other rules never change, all lookups are O(1). Added rules get numbers
+ * after the largest one.
+ */
+class RuleSet {
+public:
+  /// @brief Iterates over the rules in order, skipping removed ones
+  class ConstIterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = GuardRule;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const GuardRule *;
+    using reference = const GuardRule &;
+
+    ConstIterator(const RuleSet *set, size_t pos) noexcept;
+    reference operator*() const noexcept { return set_->rules_[pos_]; }
+    pointer operator->() const noexcept { return &set_->rules_[pos_]; }
+    ConstIterator &operator++() noexcept;
+    ConstIterator operator++(int) noexcept;
+    bool operator==(const ConstIterator &other) const noexcept {
+      return pos_ == other.pos_;
+    }
+    bool operator!=(const ConstIterator &other) const noexcept {
+      return pos_ != other.pos_;
+    }
+
+  private:
+    void SkipRemoved() noexcept;
+    const RuleSet *set_;
+    size_t pos_;
+  };
+
+  RuleSet() = default;
+
+  /// @brief Construct from parsed rules, the rule numbers are kept
+  explicit RuleSet(std::vector<GuardRule> rules);
+
+  /**
+   * @brief Append a rule
+   * @return The number given to the rule
+   */
+  uint Add(GuardRule rule);
+
+  /**
+   * @brief Append a rule if there is no equal rule
+   * @return false if an equal rule exists
+   */
+  bool AddUnique(GuardRule rule);
+
+  /**
+   * @brief Remove a rule by the number
+   * @return false if there is no such rule
+   */
+  bool Remove(uint number) noexcept;
+
+  /// @brief A rule by the number
+  const GuardRule *FindByNumber(uint number) const noexcept;
+
+  /// @brief The first rule equal to the rule, as CanonicalString compares
+  const GuardRule *FindEqual(const GuardRule &rule) const;
+
+  /// @brief Rules with the hash, in order
+  std::vector<const GuardRule *> FindByHash(const std::string &hash) const;
+
+  /// @brief Rules with exactly this id, wildcards are not expanded
+  std::vector<const GuardRule *> FindByVidPid(const std::string &vid,
+                                              const std::string &pid) const;
+
+  /// @brief Rules without gaps, in order
+  std::vector<GuardRule> ToVector() const;
+
+  /// @brief Canonical strings of the rules, in order
+  std::vector<std::string> CanonicalStrings() const;
+
+  inline ConstIterator begin() const noexcept { return {this, 0}; }
+  inline ConstIterator end() const noexcept { return {this, rules_.size()}; }
+  inline size_t size() const noexcept { return size_; }
+  inline bool empty() const noexcept { return size_ == 0; }
+
+private:
+  using Index = std::unordered_map<std::string, std::vector<size_t>>;
+
+  uint Add(GuardRule rule, std::string canonical);
+  void AddToIndexes(size_t pos);
+  std::vector<const GuardRule *> Lookup(const Index &index,
+                                        const std::string &key) const;
+  static void RemoveFromIndex(Index &index, const std::string &key,
+                              size_t pos) noexcept;
+  static std::string VidPidKey(const GuardRule &rule);
+
+  std::vector<GuardRule> rules_;
+  std::vector<std::string> canonical_;
+  std::vector<bool> removed_;
+  size_t size_ = 0;
+  uint next_number_ = 0;
+  std::unordered_map<uint, size_t> by_number_;
+  Index by_hash_;
+  Index by_vid_pid_;
+  Index by_canonical_;
+
+#ifdef UNIT_TEST
+  friend class ::Test;
+#endif
+};
+
+} // namespace guard
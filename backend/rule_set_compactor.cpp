@@ -0,0 +1,133 @@
+#include "rule_set_compactor.hpp"
+#include "common_utils.hpp"
+#include "guard_rule_builder.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+
+namespace guard {
+
+using common_utils::Log;
+using common_utils::QuoteIfNotQuoted;
+
+boost::json::object CompactionReport::BuildJsonObject() const {
+  boost::json::object res;
+  res["before"] = rules_before;
+  res["after"] = rules_after;
+  res["merged"] = merged_rules;
+  res["groups"] = groups;
+  return res;
+}
+
+RuleSetCompactor::RuleSetCompactor(size_t max_values) noexcept
+    : max_values_(std::max<size_t>(max_values, 2)) {}
+
+std::vector<GuardRule>
+RuleSetCompactor::Compact(const std::vector<GuardRule> &rules) {
+  report_ = CompactionReport();
+  report_.rules_before = rules.size();
+  std::vector<GuardRule> res;
+  res.reserve(rules.size());
+  size_t run_begin = 0;
+  while (run_begin < rules.size()) {
+    // a run of rules with the same target
+    size_t run_end = run_begin + 1;
+    while (run_end < rules.size() &&
+           rules[run_end].target() == rules[run_begin].target())
+      ++run_end;
+    std::vector<const GuardRule *> ids;
+    std::vector<const GuardRule *> hashes;
+    // other rules are copied, merged rules are placed at the first rule
+    // of their group
+    bool ids_placed = false;
+    bool hashes_placed = false;
+    for (size_t pos = run_begin; pos < run_end; ++pos) {
+      const Kind kind = Classify(rules[pos]);
+      if (kind == Kind::id)
+        ids.push_back(&rules[pos]);
+      if (kind == Kind::hash)
+        hashes.push_back(&rules[pos]);
+    }
+    for (size_t pos = run_begin; pos < run_end; ++pos) {
+      switch (Classify(rules[pos])) {
+      case Kind::id:
+        if (!ids_placed)
+          MergeGroup(ids, Kind::id, res);
+        ids_placed = true;
+        break;
+      case Kind::hash:
+        if (!hashes_placed)
+          MergeGroup(hashes, Kind::hash, res);
+        hashes_placed = true;
+        break;
+      case Kind::other:
+        res.push_back(rules[pos]);
+        break;
+      }
+    }
+    run_begin = run_end;
+  }
+  report_.rules_after = res.size();
+  Log::Debug() << "[RuleSetCompactor] " << report_.rules_before << " -> "
+               << report_.rules_after << " rules";
+  return res;
+}
+
+RuleSetCompactor::Kind
+RuleSetCompactor::Classify(const GuardRule &rule) noexcept {
+  if (rule.parent_hash() || rule.serial() || rule.port() ||
+      rule.with_interface() || rule.conn_type() || rule.conditions() ||
+      rule.ids() || rule.hashes())
+    return Kind::other;
+  const bool has_id = rule.vid() && rule.pid();
+  if (has_id && rule.hash().empty() && rule.device_name().empty() &&
+      *rule.vid() != "*" && *rule.pid() != "*")
+    return Kind::id;
+  if (!has_id && !rule.vid() && !rule.hash().empty())
+    return Kind::hash;
+  return Kind::other;
+}
+
+void RuleSetCompactor::MergeGroup(const std::vector<const GuardRule *> &rules,
+                                  Kind kind, std::vector<GuardRule> &res) {
+  if (rules.empty())
+    return;
+  // a single rule is kept as is
+  if (rules.size() == 1) {
+    res.push_back(*rules.front());
+    return;
+  }
+  std::vector<std::string> values;
+  std::unordered_set<std::string> seen;
+  for (const GuardRule *rule : rules) {
+    std::string value = kind == Kind::id
+                            ? *rule->vid() + ':' + *rule->pid()
+                            : QuoteIfNotQuoted(rule->hash());
+    if (seen.insert(value).second)
+      values.push_back(std::move(value));
+  }
+  const Target target = rules.front()->target();
+  for (size_t begin = 0; begin < values.size(); begin += max_values_) {
+    const size_t end = std::min(values.size(), begin + max_values_);
+    GuardRuleBuilder builder(target);
+    if (end - begin == 1) {
+      if (kind == Kind::id)
+        builder.Id(values[begin]);
+      else
+        builder.Hash(values[begin]);
+    } else {
+      std::vector<std::string> group(values.begin() + begin,
+                                     values.begin() + end);
+      if (kind == Kind::id)
+        builder.Ids(RuleOperator::one_of, std::move(group));
+      else
+        builder.Hashes(RuleOperator::one_of, std::move(group));
+    }
+    res.push_back(builder.Build());
+    ++report_.groups;
+  }
+  report_.merged_rules += rules.size();
+}
+
+} // namespace guard
@@ -0,0 +1,73 @@
+#pragma once
+#include "guard_rule.hpp"
+#include <boost/json/object.hpp>
+#include <cstddef>
+#include <vector>
+
+#ifdef UNIT_TEST
+#include "test.hpp"
+#endif
+
+namespace guard {
+
+/// @brief The result of a compaction
+struct CompactionReport {
+  size_t rules_before = 0;
+  size_t rules_after = 0;
+  size_t merged_rules = 0; /// rules replaced by one-of rules
+  size_t groups = 0;       /// one-of rules built
+
+  boost::json::object BuildJsonObject() const;
+};
+
+/**
+ * @class RuleSetCompactor
+ * @brief Rewrites per-device rules to fewer one-of rules
+ * @details Rules with only an id (vid:pid without wildcards) become
+ * "id one-of { ... }", rules with only a hash (and optionally a name,
+ * which is a part of the USBGuard hash) become "hash one-of { ... }".
+ * Rules are merged only inside a run of consecutive rules with the same
+ * target: any rule of the run gives the same result, so the first-match
+ * semantics is kept. A merged rule takes the place of the first rule of
+ * its group.
+ */
+class RuleSetCompactor {
+public:
+  /// @param max_values The maximum number of values in one rule
+  explicit RuleSetCompactor(size_t max_values = kMaxValues) noexcept;
+
+  /**
+   * @brief Compact the rules
+   * @return The equivalent rule set
+   * @throws std::logic_error if a merged rule can't be built
+   */
+  std::vector<GuardRule> Compact(const std::vector<GuardRule> &rules);
+
+  inline const CompactionReport &report() const noexcept { return report_; }
+
+  static constexpr size_t kMaxValues = 256;
+
+private:
+  enum class Kind { id, hash, other };
+
+  /// @brief What the rule can be merged by
+  static Kind Classify(const GuardRule &rule) noexcept;
+
+  /**
+   * @brief Build rules for a group
+   * @param rules The rules of the group
+   * @param kind Kind::id or Kind::hash
+   * @param res Merged rules are appended here
+   */
+  void MergeGroup(const std::vector<const GuardRule *> &rules, Kind kind,
+                  std::vector<GuardRule> &res);
+
+  size_t max_values_;
+  CompactionReport report_;
+
+#ifdef UNIT_TEST
+  friend class ::Test;
+#endif
+};
+
+} // namespace guard
@@ -0,0 +1,119 @@
+#include "rule_set_diff.hpp"
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+
+namespace guard {
+
+namespace {
+
+std::vector<std::string> CanonicalKeys(const std::vector<GuardRule> &rules) {
+  std::vector<std::string> res;
+  res.reserve(rules.size());
+  for (const GuardRule &rule : rules) {
+    res.emplace_back(rule.CanonicalString());
+  }
+  return res;
+}
+
+} // namespace
+
+RuleSetDiff::RuleSetDiff(const std::vector<GuardRule> &old_rules,
+                         const std::vector<GuardRule> &new_rules) {
+  Compare(CanonicalKeys(old_rules), CanonicalKeys(new_rules));
+}
+
+RuleSetDiff::RuleSetDiff(const RuleSet &old_rules,
+                         const std::vector<GuardRule> &new_rules) {
+  Compare(old_rules.CanonicalStrings(), CanonicalKeys(new_rules));
+}
+
+RuleSetDiff::RuleSetDiff(const std::vector<std::string> &old_keys,
+                         const std::vector<std::string> &new_keys) {
+  Compare(old_keys, new_keys);
+}
+
+void RuleSetDiff::Compare(const std::vector<std::string> &old_keys,
+                          const std::vector<std::string> &new_keys) {
+  // canonical string : old positions (ascending) not matched yet
+  std::unordered_map<std::string, std::vector<size_t>> old_positions;
+  old_positions.reserve(old_keys.size());
+  for (size_t i = old_keys.size(); i > 0; --i) {
+    old_positions[old_keys[i - 1]].push_back(i - 1);
+  }
+  // match equal rules in order of appearance
+  std::vector<Match> matched;
+  matched.reserve(std::min(old_keys.size(), new_keys.size()));
+  std::vector<bool> old_matched(old_keys.size(), false);
+  for (size_t i = 0; i < new_keys.size(); ++i) {
+    auto it_pos = old_positions.find(new_keys[i]);
+    if (it_pos == old_positions.end() || it_pos->second.empty()) {
+      added_.push_back(i);
+      continue;
+    }
+    matched.emplace_back(it_pos->second.back(), i);
+    old_matched[it_pos->second.back()] = true;
+    it_pos->second.pop_back();
+  }
+  for (size_t i = 0; i < old_keys.size(); ++i) {
+    if (!old_matched[i])
+      removed_.push_back(i);
+  }
+  // Longest increasing subsequence of old positions (patience sorting).
+  // tails[k] - index in matched of the smallest tail of a subsequence k+1 long
+  std::vector<size_t> tails;
+  std::vector<size_t> prev(matched.size(), matched.size());
+  for (size_t i = 0; i < matched.size(); ++i) {
+    auto it_tail = std::lower_bound(tails.begin(), tails.end(),
+                                    matched[i].first,
+                                    [&matched](size_t ind, size_t val) {
+                                      return matched[ind].first < val;
+                                    });
+    if (it_tail != tails.begin())
+      prev[i] = *std::prev(it_tail);
+    if (it_tail == tails.end()) {
+      tails.push_back(i);
+    } else {
+      *it_tail = i;
+    }
+  }
+  std::vector<bool> in_lis(matched.size(), false);
+  for (size_t i = tails.empty() ? matched.size() : tails.back();
+       i < matched.size(); i = prev[i]) {
+    in_lis[i] = true;
+  }
+  for (size_t i = 0; i < matched.size(); ++i) {
+    (in_lis[i] ? unchanged_ : moved_).push_back(matched[i]);
+  }
+}
+
+boost::json::object
+RuleSetDiff::BuildJsonObject(const std::vector<GuardRule> &new_rules) const {
+  boost::json::object res;
+  boost::json::array arr_added;
+  for (size_t pos : added_) {
+    boost::json::object obj;
+    obj["pos"] = pos;
+    if (pos < new_rules.size())
+      obj["rule"] = new_rules[pos].BuildString(true, true);
+    arr_added.emplace_back(std::move(obj));
+  }
+  boost::json::array arr_removed;
+  for (size_t pos : removed_) {
+    arr_removed.emplace_back(pos);
+  }
+  boost::json::array arr_moved;
+  for (const Match &match : moved_) {
+    boost::json::object obj;
+    obj["from"] = match.first;
+    obj["to"] = match.second;
+    arr_moved.emplace_back(std::move(obj));
+  }
+  res["added"] = std::move(arr_added);
+  res["removed"] = std::move(arr_removed);
+  res["moved"] = std::move(arr_moved);
+  res["unchanged"] = unchanged_.size();
+  return res;
+}
+
+} // namespace guard
@@ -0,0 +1,89 @@
+#pragma once
+#include "guard_rule.hpp"
+#include "rule_set.hpp"
+#include <boost/json.hpp>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace guard {
+
+/**
+ * @class RuleSetDiff
+ * @brief The difference between two ordered rule sets
+ * @details Rules are compared by GuardRule::CanonicalString. Equal rules are
+ * matched in order of appearance, the matched rules which keep their relative
+ * order (the longest increasing subsequence of old positions) are unchanged,
+ * other matched rules are moved. O(n log n) for n rules.
+ */
+class RuleSetDiff {
+public:
+  /// @brief A pair of positions: in the old set and in the new set
+  using Match = std::pair<size_t, size_t>;
+
+  /**
+   * @brief Compare two rule sets
+   * @param old_rules Rules, currently in use
+   * @param new_rules Desired rules
+   */
+  RuleSetDiff(const std::vector<GuardRule> &old_rules,
+              const std::vector<GuardRule> &new_rules);
+
+  /**
+   * @brief Compare two rule sets
+   * @param old_rules Rules, currently in use, canonical strings are cached
+   * @param new_rules Desired rules
+   */
+  RuleSetDiff(const RuleSet &old_rules,
+              const std::vector<GuardRule> &new_rules);
+
+  /**
+   * @brief Compare two rule sets, represented by canonical strings
+   * @param old_keys Canonical strings of the rules, currently in use
+   * @param new_keys Canonical strings of the desired rules
+   */
+  RuleSetDiff(const std::vector<std::string> &old_keys,
+              const std::vector<std::string> &new_keys);
+
+  /// @brief true if the rule sets are equal
+  inline bool Empty() const noexcept {
+    return added_.empty() && removed_.empty() && moved_.empty();
+  }
+
+  /// @brief Positions of new rules, which are absent in the old set
+  inline const std::vector<size_t> &added() const noexcept { return added_; }
+
+  /// @brief Positions of old rules, which are absent in the new set
+  inline const std::vector<size_t> &removed() const noexcept {
+    return removed_;
+  }
+
+  /// @brief Rules, present in both sets, but with a changed order
+  inline const std::vector<Match> &moved() const noexcept { return moved_; }
+
+  /// @brief Rules, present in both sets in the same relative order
+  inline const std::vector<Match> &unchanged() const noexcept {
+    return unchanged_;
+  }
+
+  /**
+   * @brief A compact description of the changes for the web-interface
+   * @param new_rules The same new rules, used for the constructor
+   * @return {"added":[{"pos":N,"rule":"..."}],"removed":[N],
+   * "moved":[{"from":N,"to":N}],"unchanged":N}
+   */
+  boost::json::object
+  BuildJsonObject(const std::vector<GuardRule> &new_rules) const;
+
+private:
+  void Compare(const std::vector<std::string> &old_keys,
+               const std::vector<std::string> &new_keys);
+
+  std::vector<size_t> added_;
+  std::vector<size_t> removed_;
+  std::vector<Match> moved_;
+  std::vector<Match> unchanged_;
+};
+
+} // namespace guard
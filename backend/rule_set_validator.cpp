@@ -0,0 +1,58 @@
+#include "rule_set_validator.hpp"
+#include "log.hpp"
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace guard {
+
+using common_utils::Log;
+
+RuleSetValidator::RuleSetValidator(Target implicit_policy) noexcept
+    : implicit_policy_(implicit_policy) {}
+
+bool RuleSetValidator::Validate(const std::vector<GuardRule> &rules) noexcept {
+  errors_.clear();
+  warnings_.clear();
+  try {
+    // string representation : position in the rule set
+    std::unordered_map<std::string, size_t> seen;
+    seen.reserve(rules.size());
+    for (size_t i = 0; i < rules.size(); ++i) {
+      const std::string pos = std::to_string(i);
+      const std::string str_rule = rules[i].BuildString(true, true);
+      // the daemon will read this string from the rules file,
+      // it must give the same rule
+      try {
+        if (GuardRule(str_rule).BuildString(true, true) != str_rule) {
+          errors_.push_back({pos, "The rule changes after re-reading"});
+        }
+      } catch (const std::logic_error &ex) {
+        errors_.push_back({pos, std::string("Can't parse the rule ") +
+                                    ex.what()});
+      }
+      if (rules[i].target() == implicit_policy_) {
+        errors_.push_back({pos, "The rule target is the same as the "
+                                "implicit policy"});
+      }
+      auto it_seen = seen.find(str_rule);
+      if (it_seen != seen.end()) {
+        warnings_.push_back(
+            {pos, "Duplicate of the rule " + std::to_string(it_seen->second)});
+      } else {
+        seen.emplace(str_rule, i);
+      }
+    }
+  } catch (const std::exception &ex) {
+    Log::Error() << "[RuleSetValidator] " << ex.what();
+    errors_.push_back({"", ex.what()});
+  }
+  if (!errors_.empty()) {
+    Log::Warning() << "[RuleSetValidator] Found " << errors_.size()
+                   << " errors in the rule set";
+  }
+  return errors_.empty();
+}
+
+} // namespace guard
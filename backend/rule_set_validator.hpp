@@ -0,0 +1,50 @@
+#pragma once
+#include "guard_rule.hpp"
+#include <string>
+#include <vector>
+
+namespace guard {
+
+/// @brief A diagnostic message for one rule
+struct RuleDiagnostic {
+  std::string id;      /// tr_id from the web-interface or the rule number
+  std::string message; /// what is wrong with the rule
+};
+
+/**
+ * @class RuleSetValidator
+ * @brief Structural check of a resulting rule set, performed in memory
+ * @details Checks that the rules file built from the rule set will be read
+ * back by USBGuard as the same rules, and that the rules don't conflict
+ * with the implicit policy. Neither files nor the daemon are touched.
+ */
+class RuleSetValidator {
+public:
+  /// @brief Constructor
+  /// @param implicit_policy The implicit policy the rules will be used with
+  explicit RuleSetValidator(Target implicit_policy) noexcept;
+
+  /**
+   * @brief Check the rule set
+   * @param rules Rules in the rules file order
+   * @return true if no errors were found (warnings are allowed)
+   */
+  bool Validate(const std::vector<GuardRule> &rules) noexcept;
+
+  /// @brief Errors, each one makes the rule set unusable
+  inline const std::vector<RuleDiagnostic> &errors() const noexcept {
+    return errors_;
+  }
+
+  /// @brief Warnings, for example duplicated rules
+  inline const std::vector<RuleDiagnostic> &warnings() const noexcept {
+    return warnings_;
+  }
+
+private:
+  Target implicit_policy_;
+  std::vector<RuleDiagnostic> errors_;
+  std::vector<RuleDiagnostic> warnings_;
+};
+
+} // namespace guard
@@ -0,0 +1,114 @@
+#include "sha256.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace guard::utils {
+
+namespace {
+
+constexpr std::array<uint32_t, 64> kRound = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+constexpr uint32_t Rotr(uint32_t val, int bits) noexcept {
+  return (val >> bits) | (val << (32 - bits));
+}
+
+} // namespace
+
+Sha256::Sha256() noexcept
+    : state_{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+             0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19} {}
+
+void Sha256::Update(const void *data, size_t size) noexcept {
+  const auto *ptr = static_cast<const uint8_t *>(data);
+  total_size_ += size;
+  if (buffer_size_ > 0) {
+    size_t chunk = std::min(size, buffer_.size() - buffer_size_);
+    std::memcpy(buffer_.data() + buffer_size_, ptr, chunk);
+    buffer_size_ += chunk;
+    ptr += chunk;
+    size -= chunk;
+    if (buffer_size_ < buffer_.size())
+      return;
+    Transform(buffer_.data());
+    buffer_size_ = 0;
+  }
+  for (; size >= buffer_.size(); size -= buffer_.size(), ptr += buffer_.size())
+    Transform(ptr);
+  std::memcpy(buffer_.data(), ptr, size);
+  buffer_size_ = size;
+}
+
+Sha256::Digest Sha256::Final() noexcept {
+  const uint64_t bits = total_size_ * 8;
+  const uint8_t pad_start = 0x80;
+  const uint8_t zero = 0;
+  Update(&pad_start, 1);
+  while (buffer_size_ != 56)
+    Update(&zero, 1);
+  std::array<uint8_t, 8> length{};
+  for (size_t i = 0; i < length.size(); ++i)
+    length[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+  Update(length.data(), length.size());
+  Digest res{};
+  for (size_t i = 0; i < state_.size(); ++i) {
+    for (size_t j = 0; j < 4; ++j)
+      res[i * 4 + j] = static_cast<uint8_t>(state_[i] >> (24 - 8 * j));
+  }
+  return res;
+}
+
+void Sha256::Transform(const uint8_t *block) noexcept {
+  std::array<uint32_t, 64> words{};
+  for (size_t i = 0; i < 16; ++i) {
+    words[i] = (static_cast<uint32_t>(block[i * 4]) << 24) |
+               (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+               (static_cast<uint32_t>(block[i * 4 + 2]) << 8) |
+               static_cast<uint32_t>(block[i * 4 + 3]);
+  }
+  for (size_t i = 16; i < 64; ++i) {
+    uint32_t s0 = Rotr(words[i - 15], 7) ^ Rotr(words[i - 15], 18) ^
+                  (words[i - 15] >> 3);
+    uint32_t s1 = Rotr(words[i - 2], 17) ^ Rotr(words[i - 2], 19) ^
+                  (words[i - 2] >> 10);
+    words[i] = words[i - 16] + s0 + words[i - 7] + s1;
+  }
+  uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+  uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+  for (size_t i = 0; i < 64; ++i) {
+    uint32_t s1 = Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25);
+    uint32_t choice = (e & f) ^ (~e & g);
+    uint32_t tmp1 = h + s1 + choice + kRound[i] + words[i];
+    uint32_t s0 = Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22);
+    uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t tmp2 = s0 + majority;
+    h = g;
+    g = f;
+    f = e;
+    e = d + tmp1;
+    d = c;
+    c = b;
+    b = a;
+    a = tmp1 + tmp2;
+  }
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+  state_[4] += e;
+  state_[5] += f;
+  state_[6] += g;
+  state_[7] += h;
+}
+
+} // namespace guard::utils
@@ -0,0 +1,38 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace guard::utils {
+
+/**
+ * @class Sha256
+ * @brief SHA-256 (FIPS 180-4), used to compute USBGuard device hashes
+ * without the daemon
+ */
+class Sha256 {
+public:
+  using Digest = std::array<uint8_t, 32>;
+
+  Sha256() noexcept;
+
+  /// @brief Add data to the hash
+  void Update(const void *data, size_t size) noexcept;
+  inline void Update(std::string_view str) noexcept {
+    Update(str.data(), str.size());
+  }
+
+  /// @brief Finish the hash, the object can't be updated after this call
+  Digest Final() noexcept;
+
+private:
+  void Transform(const uint8_t *block) noexcept;
+
+  std::array<uint32_t, 8> state_;
+  std::array<uint8_t, 64> buffer_{};
+  size_t buffer_size_ = 0;
+  uint64_t total_size_ = 0;
+};
+
+} // namespace guard::utils
@@ -0,0 +1,165 @@
+#include "sysfs_usb.hpp"
+#include "base64_rfc4648.hpp"
+#include "log.hpp"
+#include "sha256.hpp"
+#include <boost/algorithm/string/trim.hpp>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+namespace guard {
+
+using common_utils::Log;
+namespace fs = std::filesystem;
+
+namespace {
+
+/// @brief Read a sysfs file, the trailing newline is removed
+std::string ReadAttribute(const fs::path &path, bool trim = true) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return {};
+  std::string res{std::istreambuf_iterator<char>(file),
+                  std::istreambuf_iterator<char>()};
+  if (trim)
+    boost::trim(res);
+  return res;
+}
+
+} // namespace
+
+std::string SysfsUsbDevice::WithInterface() const {
+  std::string res = "with-interface ";
+  if (interfaces.size() == 1) {
+    const UsbType &usb_type = interfaces.front();
+    return res + usb_type.base_str() + ':' + usb_type.sub_str() + ':' +
+           usb_type.protocol_str();
+  }
+  res += "{ ";
+  for (const UsbType &usb_type : interfaces) {
+    res += usb_type.base_str() + ':' + usb_type.sub_str() + ':' +
+           usb_type.protocol_str() + ' ';
+  }
+  res += '}';
+  return res;
+}
+
+SysfsUsbReader::SysfsUsbReader(std::string root) noexcept
+    : root_(std::move(root)) {}
+
+std::vector<SysfsUsbDevice> SysfsUsbReader::ReadAll() const noexcept {
+  std::vector<SysfsUsbDevice> res;
+  try {
+    // real path : device
+    std::map<fs::path, SysfsUsbDevice> devices;
+    for (const auto &entry : fs::directory_iterator(root_)) {
+      // skip interfaces like 1-1:1.0
+      if (entry.path().filename().string().find(':') != std::string::npos)
+        continue;
+      std::optional<SysfsUsbDevice> device = ReadDevice(entry.path());
+      if (device)
+        devices.emplace(fs::canonical(entry.path()), std::move(*device));
+    }
+    // a parent is the nearest usb device up the real path
+    for (auto &[path, device] : devices) {
+      auto it_parent = devices.find(path.parent_path());
+      if (it_parent != devices.end()) {
+        device.parent_name = it_parent->second.sysfs_name;
+        device.parent_hash = it_parent->second.hash;
+      }
+    }
+    // parents go first: a parent path is a prefix of the child path
+    res.reserve(devices.size());
+    for (auto &[path, device] : devices)
+      res.push_back(std::move(device));
+  } catch (const std::exception &ex) {
+    Log::Error() << "[SysfsUsbReader] Can't read " << root_;
+    Log::Error() << ex.what();
+  }
+  return res;
+}
+
+std::optional<SysfsUsbDevice>
+SysfsUsbReader::ReadDevice(const fs::path &dir) noexcept {
+  try {
+    if (!fs::exists(dir / "idVendor") || !fs::exists(dir / "descriptors"))
+      return std::nullopt;
+    SysfsUsbDevice res;
+    res.sysfs_name = dir.filename().string();
+    res.vid = ReadAttribute(dir / "idVendor");
+    res.pid = ReadAttribute(dir / "idProduct");
+    res.name = ReadAttribute(dir / "product");
+    res.serial = ReadAttribute(dir / "serial");
+    res.conn_type = ReadAttribute(dir / "port" / "connect_type");
+    if (res.conn_type != "hotplug" && res.conn_type != "hardwired")
+      res.conn_type.clear();
+    const std::string descriptors = ReadAttribute(dir / "descriptors", false);
+    res.interfaces = ParseInterfaces(descriptors);
+    res.hash = ComputeHash(res, descriptors);
+    return res;
+  } catch (const std::exception &ex) {
+    Log::Error() << "[SysfsUsbReader] Can't read " << dir.string();
+    Log::Error() << ex.what();
+  }
+  return std::nullopt;
+}
+
+std::vector<UsbType>
+SysfsUsbReader::ParseInterfaces(std::string_view descriptors) noexcept {
+  constexpr unsigned char kInterfaceDescriptor = 0x04;
+  std::vector<UsbType> res;
+  size_t pos = 0;
+  while (pos + 2 <= descriptors.size()) {
+    const auto length = static_cast<unsigned char>(descriptors[pos]);
+    const auto type = static_cast<unsigned char>(descriptors[pos + 1]);
+    if (length < 2 || pos + length > descriptors.size())
+      break;
+    // bInterfaceClass, bInterfaceSubClass, bInterfaceProtocol
+    if (type == kInterfaceDescriptor && length >= 9) {
+      uint32_t packed =
+          (static_cast<uint32_t>(
+               static_cast<unsigned char>(descriptors[pos + 5]))
+           << 16) |
+          (static_cast<uint32_t>(
+               static_cast<unsigned char>(descriptors[pos + 6]))
+           << 8) |
+          static_cast<unsigned char>(descriptors[pos + 7]);
+      res.emplace_back(packed);
+    }
+    pos += length;
+  }
+  return res;
+}
+
+std::string SysfsUsbReader::ComputeHash(const SysfsUsbDevice &device,
+                                        std::string_view descriptors) noexcept {
+  utils::Sha256 sha;
+  sha.Update(device.name);
+  sha.Update(device.vid);
+  sha.Update(device.pid);
+  sha.Update(device.serial);
+  sha.Update(descriptors);
+  return cppcodec::base64_rfc4648::encode<std::string>(sha.Final());
+}
+
+UsbDevice SysfsUsbReader::ToUsbDevice(const SysfsUsbDevice &device,
+                                      uint num, const std::string &topology) {
+  UsbDevice::DeviceData dev_data{num,
+                                 "",
+                                 device.name,
+                                 device.vid,
+                                 device.pid,
+                                 device.sysfs_name,
+                                 device.conn_type,
+                                 device.WithInterface(),
+                                 device.serial,
+                                 device.hash,
+                                 device.parent_hash,
+                                 topology};
+  return UsbDevice(dev_data);
+}
+
+} // namespace guard
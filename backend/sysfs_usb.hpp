@@ -0,0 +1,80 @@
+#pragma once
+#include "usb_device.hpp"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace guard {
+
+/// @brief A usb device, read from sysfs
+struct SysfsUsbDevice {
+  std::string sysfs_name;  /// "1-1.2" or "usb1", the same as via-port
+  std::string parent_name; /// sysfs name of the parent, empty for root hubs
+  std::string vid;
+  std::string pid;
+  std::string name; /// the product string
+  std::string serial;
+  std::string conn_type; /// hotplug, hardwired or empty
+  std::vector<UsbType> interfaces;
+  std::string hash;        /// USBGuard-compatible hash
+  std::string parent_hash; /// empty for root hubs
+
+  /// @brief with-interface attribute for a device rule
+  std::string WithInterface() const;
+};
+
+/**
+ * @class SysfsUsbReader
+ * @brief Reads the attached usb devices from sysfs, without USBGuard
+ * @details The device hash is computed as USBGuard does: SHA-256 of
+ * the name, vid, pid, serial and the raw descriptors, encoded to base64.
+ */
+class SysfsUsbReader {
+public:
+  /// @param root /sys/bus/usb/devices or a copy of it
+  explicit SysfsUsbReader(std::string root = kDefaultRoot) noexcept;
+
+  /**
+   * @brief Read all usb devices
+   * @return Devices, parents go before their children
+   */
+  std::vector<SysfsUsbDevice> ReadAll() const noexcept;
+
+  /**
+   * @brief Read one device
+   * @param dir A device directory
+   * @return std::nullopt if it's not a usb device or can't be read
+   */
+  static std::optional<SysfsUsbDevice>
+  ReadDevice(const std::filesystem::path &dir) noexcept;
+
+  /**
+   * @brief Get interface types from the raw descriptors, all interface
+   * descriptors of all configurations are used
+   * @param descriptors The content of sysfs "descriptors" file
+   */
+  static std::vector<UsbType>
+  ParseInterfaces(std::string_view descriptors) noexcept;
+
+  /// @brief USBGuard-compatible device hash
+  static std::string ComputeHash(const SysfsUsbDevice &device,
+                                 std::string_view descriptors) noexcept;
+
+  /**
+   * @brief Convert to UsbDevice for device lists
+   * @param device The device
+   * @param num The order number
+   * @param topology Ports from the root hub, if known
+   */
+  static UsbDevice ToUsbDevice(const SysfsUsbDevice &device, uint num,
+                               const std::string &topology = {});
+
+  static constexpr const char *kDefaultRoot = "/sys/bus/usb/devices";
+
+private:
+  std::string root_;
+};
+
+} // namespace guard
@@ -0,0 +1,43 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace guard {
+
+ThreadPool::ThreadPool(size_t threads) {
+  threads = std::max<size_t>(threads, 1);
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i)
+    workers_.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread &worker : workers_)
+    worker.join();
+}
+
+size_t ThreadPool::DefaultThreads() noexcept {
+  const size_t hardware = std::thread::hardware_concurrency();
+  return std::clamp<size_t>(hardware, 1, kMaxThreads);
+}
+
+void ThreadPool::Work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty())
+        return;
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
+
+} // namespace guard
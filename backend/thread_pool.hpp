@@ -0,0 +1,64 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace guard {
+
+/**
+ * @class ThreadPool
+ * @brief A fixed number of worker threads with a common task queue
+ * @details The destructor waits for all queued tasks.
+ */
+class ThreadPool {
+public:
+  /// @param threads Number of workers, at least one
+  explicit ThreadPool(size_t threads = DefaultThreads());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief Queue a task
+   * @return A future for the task result, exceptions are passed through it
+   */
+  template <typename Func>
+  std::future<std::invoke_result_t<Func>> Submit(Func &&func) {
+    using Result = std::invoke_result_t<Func>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<Func>(func));
+    std::future<Result> res = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace([task]() { (*task)(); });
+    }
+    cv_.notify_one();
+    return res;
+  }
+
+  inline size_t size() const noexcept { return workers_.size(); }
+
+  /// @brief The number of hardware threads, limited by kMaxThreads
+  static size_t DefaultThreads() noexcept;
+
+  static constexpr size_t kMaxThreads = 8;
+
+private:
+  void Work();
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+};
+
+} // namespace guard
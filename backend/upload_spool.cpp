@@ -0,0 +1,305 @@
+#include "upload_spool.hpp"
+#include "base64_stream.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <boost/json/parse.hpp>
+#include <boost/json/serialize.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace guard {
+
+using common_utils::Log;
+using utils::Base64StreamDecoder;
+namespace json = boost::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+/// @brief An exclusive flock on the data file of an upload
+class DataLock {
+public:
+  /// @param wait Wait for another process to release the lock
+  DataLock(const std::string &path, bool wait) noexcept {
+    fd_ = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd_ < 0)
+      return;
+    int res = 0;
+    do {
+      res = flock(fd_, LOCK_EX | (wait ? 0 : LOCK_NB));
+    } while (res != 0 && errno == EINTR);
+    if (res != 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+  ~DataLock() noexcept {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+  DataLock(const DataLock &) = delete;
+  DataLock &operator=(const DataLock &) = delete;
+
+  inline bool locked() const noexcept { return fd_ >= 0; }
+  inline int fd() const noexcept { return fd_; }
+
+private:
+  int fd_ = -1;
+};
+
+} // namespace
+
+UploadSpool::UploadSpool(const std::string &dir) noexcept : dir_(dir) {}
+
+std::optional<std::string> UploadSpool::Begin() const noexcept {
+  try {
+    fs::create_directories(dir_);
+    fs::permissions(dir_, fs::perms::owner_all);
+    RemoveExpired();
+    std::random_device random;
+    const uint64_t number =
+        (static_cast<uint64_t>(random()) << 32) | random();
+    constexpr char kDigits[] = "0123456789abcdef";
+    std::string id(16, '0');
+    for (size_t i = 0; i < id.size(); ++i)
+      id[i] = kDigits[(number >> (60 - 4 * i)) & 0xF];
+    int fd = open(DataPath(id).c_str(),
+                  O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0)
+      throw std::runtime_error("Can't create " + DataPath(id) + " " +
+                               std::strerror(errno));
+    close(fd);
+    if (!WriteState(id, State{})) {
+      Remove(id);
+      return std::nullopt;
+    }
+    Log::Debug() << "[UploadSpool] Begin " << id;
+    return id;
+  } catch (const std::exception &ex) {
+    Log::Error() << "[UploadSpool] " << ex.what();
+  }
+  return std::nullopt;
+}
+
+bool UploadSpool::Append(const std::string &id, size_t offset,
+                         const std::string &chunk) const noexcept {
+  if (!ValidId(id)) {
+    Log::Warning() << "[UploadSpool] Bad upload id";
+    return false;
+  }
+  // the lock serializes a resent chunk with the one still being written
+  const DataLock lock(DataPath(id), true);
+  if (!lock.locked()) {
+    Log::Warning() << "[UploadSpool] Unknown upload " << id;
+    return false;
+  }
+  std::optional<State> state = ReadState(id);
+  if (!state)
+    return false;
+  UploadProgress &progress = state->progress;
+  if (offset > progress.received) {
+    Log::Warning() << "[UploadSpool] Chunk at " << offset << ", expected "
+                   << progress.received;
+    return false;
+  }
+  // a resent chunk, only the new part is appended
+  if (offset + chunk.size() <= progress.received)
+    return true;
+  const std::string_view rest =
+      std::string_view(chunk).substr(progress.received - offset);
+  const int fd = lock.fd();
+  try {
+    // bytes after the recorded size are left by an interrupted chunk
+    if (ftruncate(fd, static_cast<off_t>(progress.size)) != 0 ||
+        lseek(fd, 0, SEEK_END) < 0)
+      throw std::runtime_error("Can't truncate " + DataPath(id));
+    Base64StreamDecoder decoder([fd, &progress](std::string_view block) {
+      if (progress.size + block.size() > kMaxSize)
+        throw std::runtime_error("The upload is too big");
+      while (!block.empty()) {
+        ssize_t written = write(fd, block.data(), block.size());
+        if (written < 0 && errno == EINTR)
+          continue;
+        if (written <= 0)
+          throw std::runtime_error("Can't write the spool file");
+        block.remove_prefix(static_cast<size_t>(written));
+        progress.size += static_cast<size_t>(written);
+      }
+    });
+    decoder.Write(state->pending);
+    if (progress.finished &&
+        rest.find_first_not_of("\r\n") != std::string_view::npos)
+      throw std::runtime_error("Base64: data after the padding");
+    decoder.Write(rest);
+    decoder.Flush();
+    if (fsync(fd) != 0)
+      throw std::runtime_error("Can't fsync the spool file");
+    state->pending = decoder.pending();
+    progress.finished = progress.finished || decoder.finished();
+    progress.received = offset + chunk.size();
+    return WriteState(id, *state);
+  } catch (const std::exception &ex) {
+    Log::Error() << "[UploadSpool] " << id << " " << ex.what();
+  }
+  return false;
+}
+
+std::optional<UploadProgress>
+UploadSpool::Progress(const std::string &id) const noexcept {
+  std::optional<State> state = ReadState(id);
+  if (!state)
+    return std::nullopt;
+  return state->progress;
+}
+
+std::optional<utils::CsvUploadResult>
+UploadSpool::Commit(const std::string &id, size_t size) const noexcept {
+  if (!ValidId(id)) {
+    Log::Warning() << "[UploadSpool] Bad upload id";
+    return std::nullopt;
+  }
+  std::optional<utils::CsvUploadResult> res;
+  {
+    const DataLock lock(DataPath(id), true);
+    if (!lock.locked()) {
+      Log::Warning() << "[UploadSpool] Unknown upload " << id;
+      return std::nullopt;
+    }
+    std::optional<State> state = ReadState(id);
+    if (!state)
+      return std::nullopt;
+    // the upload is kept, the client can resume it
+    if (state->progress.received != size || !state->pending.empty()) {
+      Log::Error() << "[UploadSpool] The upload " << id << " is incomplete, "
+                   << state->progress.received << " of " << size
+                   << " symbols received";
+      return std::nullopt;
+    }
+    try {
+      fs::resize_file(DataPath(id), state->progress.size);
+      std::ifstream file(DataPath(id), std::ios::binary);
+      if (!file.is_open())
+        throw std::runtime_error("Can't open " + DataPath(id));
+      res = utils::UploadRulesCsv(file);
+    } catch (const std::exception &ex) {
+      Log::Error() << "[UploadSpool] " << id << " " << ex.what();
+    }
+  }
+  Remove(id);
+  return res;
+}
+
+bool UploadSpool::Remove(const std::string &id) const noexcept {
+  if (!ValidId(id))
+    return false;
+  bool res = true;
+  for (const std::string &path : {DataPath(id), StatePath(id)}) {
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+      Log::Error() << "[UploadSpool] Can't remove " << path << " "
+                   << std::strerror(errno);
+      res = false;
+    }
+  }
+  return res;
+}
+
+void UploadSpool::RemoveExpired() const noexcept {
+  try {
+    // both files of an upload are expired by the newest of them
+    std::map<std::string, fs::file_time_type> last_change;
+    for (const fs::directory_entry &entry : fs::directory_iterator(dir_)) {
+      const std::string id = entry.path().stem().string();
+      if (!entry.is_regular_file() || !ValidId(id))
+        continue;
+      auto it = last_change.find(id);
+      if (it == last_change.end())
+        last_change.emplace(id, entry.last_write_time());
+      else
+        it->second = std::max(it->second, entry.last_write_time());
+    }
+    const auto now = fs::file_time_type::clock::now();
+    for (const auto &[id, time] : last_change) {
+      if (now - time <= std::chrono::seconds(kMaxAge))
+        continue;
+      // an upload being written is not expired
+      const DataLock lock(DataPath(id), false);
+      if (!lock.locked() && fs::exists(DataPath(id)))
+        continue;
+      Log::Info() << "[UploadSpool] Remove expired " << id;
+      Remove(id);
+    }
+  } catch (const std::exception &ex) {
+    Log::Warning() << "[UploadSpool] " << ex.what();
+  }
+}
+
+bool UploadSpool::ValidId(const std::string &id) noexcept {
+  return id.size() == 16 &&
+         id.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+std::optional<UploadSpool::State>
+UploadSpool::ReadState(const std::string &id) const noexcept {
+  if (!ValidId(id)) {
+    Log::Warning() << "[UploadSpool] Bad upload id";
+    return std::nullopt;
+  }
+  try {
+    std::ifstream file(StatePath(id));
+    if (!file.is_open()) {
+      Log::Warning() << "[UploadSpool] Unknown upload " << id;
+      return std::nullopt;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    json::value value = json::parse(content.str());
+    const json::object &obj = value.as_object();
+    State res;
+    res.progress.received = obj.at("received").to_number<size_t>();
+    res.progress.size = obj.at("size").to_number<size_t>();
+    res.progress.finished = obj.at("finished").as_bool();
+    res.pending = obj.at("pending").as_string().c_str();
+    return res;
+  } catch (const std::exception &ex) {
+    Log::Error() << "[UploadSpool] Can't read " << StatePath(id);
+    Log::Error() << ex.what();
+  }
+  return std::nullopt;
+}
+
+bool UploadSpool::WriteState(const std::string &id,
+                             const State &state) const noexcept {
+  try {
+    json::object obj;
+    obj["received"] = state.progress.received;
+    obj["size"] = state.progress.size;
+    obj["finished"] = state.progress.finished;
+    obj["pending"] = state.pending;
+    return utils::WriteFileAtomic(StatePath(id), json::serialize(obj), false);
+  } catch (const std::exception &ex) {
+    Log::Error() << "[UploadSpool] " << ex.what();
+  }
+  return false;
+}
+
+std::string UploadSpool::DataPath(const std::string &id) const {
+  return dir_ + "/" + id + ".data";
+}
+
+std::string UploadSpool::StatePath(const std::string &id) const {
+  return dir_ + "/" + id + ".state";
+}
+
+} // namespace guard
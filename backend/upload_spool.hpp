@@ -0,0 +1,102 @@
+#pragma once
+#include "guard_utils.hpp"
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#ifdef UNIT_TEST
+#include "test.hpp"
+#endif
+
+namespace guard {
+
+/// @brief The progress of a chunked upload
+struct UploadProgress {
+  size_t received = 0; /// symbols of the encoded file received
+  size_t size = 0;     /// bytes in the spool file
+  bool finished = false; /// the end of the encoded file was received
+};
+
+/**
+ * @class UploadSpool
+ * @brief Chunked upload of a rules file
+ * @details The client sends the double base64 encoded file by chunks. The
+ * outer base64 layer of each chunk is decoded and appended to a spool file,
+ * so the file is never kept in memory as a whole. The progress is written
+ * to a state file after every chunk, an interrupted upload is resumed from
+ * the received position, even by another backend process. An exclusive
+ * lock of the spool file serializes the requests of one upload. The spooled
+ * file is parsed by chunks on commit. Uploads older than kMaxAge are
+ * removed when a new one begins.
+ */
+class UploadSpool {
+public:
+  /// @param dir A directory for the spool files
+  explicit UploadSpool(const std::string &dir = kDefaultDir) noexcept;
+
+  /**
+   * @brief Start a new upload
+   * @return The upload id, std::nullopt on error
+   */
+  std::optional<std::string> Begin() const noexcept;
+
+  /**
+   * @brief Append a chunk of the encoded file
+   * @param id The upload id
+   * @param offset The position of the chunk in the encoded file
+   * @param chunk Symbols of the encoded file, may split a base64 group
+   * @return false if the chunk was not accepted, Progress tells where to
+   * continue
+   * @details A chunk that was already received is accepted again, so a
+   * chunk can be resent after a timeout.
+   */
+  bool Append(const std::string &id, size_t offset,
+              const std::string &chunk) const noexcept;
+
+  /// @brief The progress of the upload, std::nullopt if there is no upload
+  std::optional<UploadProgress> Progress(const std::string &id) const noexcept;
+
+  /**
+   * @brief Parse the spooled file and remove the upload
+   * @param size The length of the encoded file, an upload with less symbols
+   * received is kept and can be resumed
+   * @return std::nullopt if the upload is unknown, incomplete or bad
+   */
+  std::optional<utils::CsvUploadResult>
+  Commit(const std::string &id, size_t size) const noexcept;
+
+  /// @brief Remove the upload files
+  bool Remove(const std::string &id) const noexcept;
+
+  /// @brief Remove uploads, whose files were not changed for kMaxAge seconds
+  void RemoveExpired() const noexcept;
+
+  static constexpr const char *kDefaultDir =
+      "/var/lib/alterator-usbguard/uploads";
+  /// @brief The max size of the spool file
+  static constexpr size_t kMaxSize = 64 * 1024 * 1024;
+  /// @brief Seconds an unfinished upload is kept
+  static constexpr long kMaxAge = 3600;
+
+private:
+  /// @brief The state of an upload, stored in the state file
+  struct State {
+    UploadProgress progress;
+    std::string pending; /// symbols of an incomplete base64 group
+  };
+
+  /// @brief 16 hex digits, nothing else is used in file names
+  static bool ValidId(const std::string &id) noexcept;
+  std::optional<State> ReadState(const std::string &id) const noexcept;
+  bool WriteState(const std::string &id, const State &state) const noexcept;
+  std::string DataPath(const std::string &id) const;
+  std::string StatePath(const std::string &id) const;
+
+  std::string dir_;
+
+#ifdef UNIT_TEST
+  friend class ::Test;
+#endif
+};
+
+} // namespace guard
@@ -1,20 +1,37 @@
 #include "usb_device.hpp"
+#include "log.hpp"
 #include <boost/algorithm/string.hpp>
-#include <limits>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 namespace guard {
 
+using common_utils::Log;
+
 UsbDevice::UsbDevice(const DeviceData &data)
     : number(data.num), status_(data.status), name_(data.name), vid_(data.vid),
       pid_(data.pid), port_(data.port), connection_(data.conn),
-      i_type_(data.i_type), sn_(data.sn), hash_(data.hash) {}
+      interfaces_(data.i_type), sn_(data.sn), hash_(data.hash),
+      parent_hash_(data.parent_hash), topology_(data.topology) {}
 
 vecPairs UsbDevice::SerializeForLisp() const {
+  return SerializeRow(boost::join(interfaces_.Fold(), " "));
+}
+
+std::vector<vecPairs> UsbDevice::SerializeRowsForLisp() const {
+  std::vector<vecPairs> res;
+  for (const std::string &i_type : interfaces_.Fold()) {
+    res.emplace_back(SerializeRow(i_type));
+  }
+  return res;
+}
+
+vecPairs UsbDevice::SerializeRow(const std::string &i_type) const {
   vecPairs res;
   res.emplace_back("label_prsnt_usb_number", std::to_string(number));
   res.emplace_back("label_prsnt_usb_port", port_);
-  res.emplace_back("label_prsnt_usb_class", i_type_);
+  res.emplace_back("label_prsnt_usb_class", i_type);
   res.emplace_back("label_prsnt_usb_vid", vid_);
   res.emplace_back("label_prsnt_usb_pid", pid_);
   res.emplace_back("label_prsnt_usb_status", status_);
@@ -26,43 +43,117 @@ vecPairs UsbDevice::SerializeForLisp() const {
   return res;
 }
 
-UsbType::UsbType(const std::string &str) {
-  std::logic_error ex_common =
-      std::logic_error("Can't parse CC::SS::PP " + str);
-  std::vector<std::string> splitted;
-  boost::split(splitted, str, [](const char symbol) { return symbol == ':'; });
-  if (splitted.size() != 3) {
-    throw ex_common;
+UsbInterfaceSet::UsbInterfaceSet(const std::string &with_interface) {
+  constexpr std::string_view kPrefix = "with-interface";
+  std::string_view view(with_interface);
+  auto trim = [](std::string_view &str) {
+    while (!str.empty() && str.front() == ' ')
+      str.remove_prefix(1);
+    while (!str.empty() && str.back() == ' ')
+      str.remove_suffix(1);
+  };
+  trim(view);
+  if (view.substr(0, kPrefix.size()) == kPrefix)
+    view.remove_prefix(kPrefix.size());
+  trim(view);
+  // a single type
+  if (view.find('{') == std::string_view::npos ||
+      view.find('}') == std::string_view::npos) {
+    std::optional<UsbType> usb_type = UsbType::Parse(view);
+    if (usb_type) {
+      types_.push_back(*usb_type);
+      classes_.set(usb_type->base());
+    } else {
+      Log::Error() << "Can't parse a usb type " << std::string(view);
+      // keep even if parsing failed
+      raw_ = std::string(view);
+    }
+    return;
   }
-
-  for (std::string &element : splitted) {
-    boost::trim(element);
-    if (element.size() > 2) {
-      throw ex_common;
+  // a list, braces and spaces are separators
+  auto is_separator = [](char symbol) {
+    return symbol == ' ' || symbol == '{' || symbol == '}';
+  };
+  size_t pos = 0;
+  while (pos < view.size()) {
+    while (pos < view.size() && is_separator(view[pos]))
+      ++pos;
+    size_t end = pos;
+    while (end < view.size() && !is_separator(view[end]))
+      ++end;
+    if (end == pos)
+      break;
+    std::string_view token = view.substr(pos, end - pos);
+    std::optional<UsbType> usb_type = UsbType::Parse(token);
+    if (usb_type) {
+      types_.push_back(*usb_type);
+      classes_.set(usb_type->base());
+    } else {
+      Log::Error() << "Can't parse a usb type" << std::string(token);
     }
+    pos = end;
+  }
+}
+
+size_t UsbInterfaceSet::Fold(std::array<uint32_t, 256> &out) const noexcept {
+  // if a base class is not unique, create a mask.
+  std::bitset<256> seen;
+  std::bitset<256> multiple;
+  for (const UsbType &usb_type : types_) {
+    if (seen.test(usb_type.base()))
+      multiple.set(usb_type.base());
+    seen.set(usb_type.base());
   }
-  int limit = std::numeric_limits<unsigned char>::max();
-  int val = stoi(splitted[0], nullptr, 16);
-  if (val >= 0 && val <= limit) {
-    base_ = static_cast<unsigned char>(val);
-    base_str_ = std::move(splitted[0]);
-  } else {
-    throw ex_common;
+  // one element per base class, so no more than 256 elements
+  std::bitset<256> folded;
+  size_t size = 0;
+  for (const UsbType &usb_type : types_) {
+    if (folded.test(usb_type.base()))
+      continue;
+    folded.set(usb_type.base());
+    out[size++] = multiple.test(usb_type.base())
+                      ? (static_cast<uint32_t>(usb_type.base()) << 16) |
+                            kWildcard
+                      : usb_type.packed();
   }
-  val = stoi(splitted[1], nullptr, 16);
-  if (val >= 0 && val <= limit) {
-    sub_ = static_cast<unsigned char>(val);
-    sub_str_ = std::move(splitted[1]);
-  } else {
-    throw ex_common;
+  return size;
+}
+
+std::vector<std::string> UsbInterfaceSet::Fold() const {
+  std::vector<std::string> res;
+  if (raw_) {
+    res.push_back(*raw_);
+    return res;
   }
-  val = stoi(splitted[2], nullptr, 16);
-  if (val >= 0 && val <= limit) {
-    protocol_ = static_cast<unsigned char>(val);
-    protocol_str_ = std::move(splitted[2]);
-  } else {
-    throw ex_common;
+  std::array<uint32_t, 256> folded{};
+  size_t size = Fold(folded);
+  res.reserve(size);
+  for (size_t i = 0; i < size; ++i) {
+    UsbType usb_type(folded[i]);
+    std::string tmp = usb_type.base_str();
+    if ((folded[i] & kWildcard) != 0) {
+      tmp += ":*:*";
+    } else {
+      tmp += ':';
+      tmp += usb_type.sub_str();
+      tmp += ':';
+      tmp += usb_type.protocol_str();
+    }
+    res.emplace_back(std::move(tmp));
   }
+  return res;
+}
+
+UsbType::UsbType(const std::string &str) {
+  std::optional<UsbType> parsed = Parse(str);
+  if (!parsed)
+    throw std::logic_error("Can't parse CC::SS::PP " + str);
+  packed_ = parsed->packed_;
+}
+
+std::string UsbType::ByteToHex(unsigned char byte) {
+  constexpr char kDigits[] = "0123456789abcdef";
+  return {kDigits[byte >> 4], kDigits[byte & 0xF]};
 }
 
-} // namespace guard
\ No newline at end of file
+} // namespace guard
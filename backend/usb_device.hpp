@@ -1,10 +1,156 @@
 #pragma once
 #include "serializable_for_lisp.hpp"
 #include "types.hpp"
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace guard {
 
+/**
+ * @class UsbType
+ * @brief Represents USB class code
+ * @details Information that is used to identify a device’s functionality
+ * The information is contained in three bytes
+ * with the names Base Class, SubClass, and Protocol.
+ * The bytes are packed to one uint32_t 0x00BBSSPP.
+ */
+class UsbType {
+public:
+  /// @brief Constructor from string
+  /// @param string Fotmatted string 00:00:00
+  /// @throws std::logical_error
+  explicit UsbType(const std::string &);
+
+  /// @brief Constructor from packed value 0x00BBSSPP
+  constexpr explicit UsbType(uint32_t packed) noexcept
+      : packed_(packed & 0xFFFFFF) {}
+
+  /**
+   * @brief Parse "BB:SS:PP", one or two hex digits in each part, spaces
+   * around parts are ignored
+   * @return std::nullopt if the string is not a valid triple
+   * @details Doesn't allocate and doesn't throw
+   */
+  static constexpr std::optional<UsbType> Parse(std::string_view str) noexcept {
+    uint32_t packed = 0;
+    size_t pos = 0;
+    for (int part = 0; part < 3; ++part) {
+      while (pos < str.size() && str[pos] == ' ')
+        ++pos;
+      int digits = 0;
+      uint32_t val = 0;
+      while (pos < str.size() && digits < 3) {
+        int digit = HexDigit(str[pos]);
+        if (digit < 0)
+          break;
+        val = (val << 4) | static_cast<uint32_t>(digit);
+        ++digits;
+        ++pos;
+      }
+      if (digits == 0 || digits > 2)
+        return std::nullopt;
+      while (pos < str.size() && str[pos] == ' ')
+        ++pos;
+      if (part < 2) {
+        if (pos >= str.size() || str[pos] != ':')
+          return std::nullopt;
+        ++pos;
+      }
+      packed = (packed << 8) | val;
+    }
+    if (pos != str.size())
+      return std::nullopt;
+    return UsbType(packed);
+  }
+
+  constexpr unsigned char base() const noexcept {
+    return static_cast<unsigned char>(packed_ >> 16);
+  }
+  constexpr unsigned char sub() const noexcept {
+    return static_cast<unsigned char>(packed_ >> 8);
+  }
+  constexpr unsigned char protocol() const noexcept {
+    return static_cast<unsigned char>(packed_);
+  }
+  constexpr uint32_t packed() const noexcept { return packed_; }
+
+  inline std::string base_str() const { return ByteToHex(base()); };
+  inline std::string sub_str() const { return ByteToHex(sub()); };
+  inline std::string protocol_str() const { return ByteToHex(protocol()); };
+
+private:
+  static constexpr int HexDigit(char symbol) noexcept {
+    if (symbol >= '0' && symbol <= '9')
+      return symbol - '0';
+    if (symbol >= 'a' && symbol <= 'f')
+      return symbol - 'a' + 10;
+    if (symbol >= 'A' && symbol <= 'F')
+      return symbol - 'A' + 10;
+    return -1;
+  }
+
+  /// @brief Two lowercase hex digits
+  static std::string ByteToHex(unsigned char byte);
+
+  uint32_t packed_ = 0;
+};
+
+/**
+ * @class UsbInterfaceSet
+ * @brief Interface types of a device
+ * @details Stores the parsed types once per device, a bitmap of base classes
+ * gives a fast class lookup. The folded strings are built only for output.
+ */
+class UsbInterfaceSet {
+public:
+  UsbInterfaceSet() = default;
+
+  /**
+   * @brief Parse the with-interface attribute of a device rule
+   * @param with_interface "with-interface { 03:01:01 03:00:00 }" or
+   * "with-interface 09:00:00"
+   * @details Invalid types in a list are skipped, an invalid single type
+   * is kept as is.
+   */
+  explicit UsbInterfaceSet(const std::string &with_interface);
+
+  /**
+   * @brief Fold the types, one string per base class
+   * @details A base class with more than one type becomes "CC:*:*"
+   * @return std::vector<std::string> in order of appearance
+   */
+  std::vector<std::string> Fold() const;
+
+  /**
+   * @brief Fold the types without allocations
+   * @param out An array for the result: packed types, a folded base class
+   * has the kWildcard flag
+   * @return Number of elements written to out
+   */
+  size_t Fold(std::array<uint32_t, 256> &out) const noexcept;
+
+  /// Flag of a folded base class "CC:*:*"
+  static constexpr uint32_t kWildcard = 0x1000000;
+
+  /// @brief true if a type with the base class is present
+  inline bool HasClass(unsigned char base) const noexcept {
+    return classes_.test(base);
+  }
+
+  inline const std::vector<UsbType> &types() const noexcept { return types_; }
+
+private:
+  std::bitset<256> classes_;
+  std::vector<UsbType> types_;
+  /// an unparsed single value
+  std::optional<std::string> raw_;
+};
+
 /**
  * @class UsbDevice
  * @brief Represents a usb device
@@ -15,16 +161,18 @@ public:
    * @brief Basic UsbDevice data set
    */
   struct DeviceData {
-    uint num;           /// order number in rules file
-    std::string status; /// allow or block
-    std::string name;   /// device name
-    std::string vid;    /// vendor id
-    std::string pid;    /// product id
-    std::string port;   /// port
-    std::string conn;   /// connection type
-    std::string i_type; /// interface type
-    std::string sn;     /// serial number
-    std::string hash;   /// hash (UsbGuard)
+    uint num;                /// order number in rules file
+    std::string status;      /// allow or block
+    std::string name;        /// device name
+    std::string vid;         /// vendor id
+    std::string pid;         /// product id
+    std::string port;        /// port
+    std::string conn;        /// connection type
+    std::string i_type;      /// with-interface attribute
+    std::string sn;          /// serial number
+    std::string hash;        /// hash (UsbGuard)
+    std::string parent_hash; /// hash of the parent device (UsbGuard)
+    std::string topology;    /// ports from the root hub, empty if unknown
   };
 
   /**
@@ -41,10 +189,19 @@ public:
    * html_name : value for displaing in frontend
    * @return Vector of string pairs, suitable for alterator
    * frontend
+   * @details All folded interface types are joined with spaces
    */
   vecPairs SerializeForLisp() const;
 
+  /**
+   * @brief Serialize a row per folded interface type, as the frontend table
+   * shows devices
+   * @return std::vector<vecPairs>
+   */
+  std::vector<vecPairs> SerializeRowsForLisp() const;
+
   inline const std::string &vid() const noexcept { return vid_; };
+  inline const std::string &pid() const noexcept { return pid_; };
   inline const std::string &vendor_name() const noexcept {
     return vendor_name_;
   }
@@ -53,8 +210,23 @@ public:
   }
   inline const std::string &name() const noexcept { return name_; }
   inline const std::string &hash() const noexcept { return hash_; }
+  inline const std::string &port() const noexcept { return port_; }
+  inline const std::string &connection() const noexcept {
+    return connection_;
+  }
+  inline const std::string &serial() const noexcept { return sn_; }
+  inline const std::string &parent_hash() const noexcept {
+    return parent_hash_;
+  }
+  inline const std::string &topology() const noexcept { return topology_; }
+  inline const UsbInterfaceSet &interfaces() const noexcept {
+    return interfaces_;
+  }
 
 private:
+  /// @brief Serialize the device with the interface type
+  vecPairs SerializeRow(const std::string &i_type) const;
+
   uint number;
   std::string status_;
   std::string name_;
@@ -62,43 +234,12 @@ private:
   std::string pid_;
   std::string port_;
   std::string connection_;
-  std::string i_type_;
+  UsbInterfaceSet interfaces_;
   std::string sn_;
   std::string hash_;
+  std::string parent_hash_;
+  std::string topology_;
   std::string vendor_name_;
 };
 
-/*-------------------------------------------------------------------------*/
-/**
- * @class UsbType
- * @brief Represents USB class code
- * @details Information that is used to identify a device’s functionality
- * The information is contained in three bytes
- * with the names Base Class, SubClass, and Protocol. (
- */
-class UsbType {
-public:
-  /// @brief Constructor from string
-  /// @param string Fotmatted string 00:00:00
-  /// @throws std::invalid_argument  std::out_of_range std::logical_error
-  explicit UsbType(const std::string &);
-  UsbType(UsbType &&) noexcept = default;
-  UsbType &operator=(UsbType &&) noexcept = default;
-
-  inline const unsigned char &base() const noexcept { return base_; };
-  inline const std::string &base_str() const noexcept { return base_str_; };
-  inline const std::string &sub_str() const noexcept { return sub_str_; };
-  inline const std::string &protocol_str() const noexcept {
-    return protocol_str_;
-  };
-
-private:
-  unsigned char base_ = 0;
-  unsigned char sub_ = 0;
-  unsigned char protocol_ = 0;
-  std::string base_str_;
-  std::string sub_str_;
-  std::string protocol_str_;
-};
-
 } // namespace guard
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "usb_topology.hpp"
+#include "log.hpp"
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/json/object.hpp>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <utility>
+
+namespace guard {
+
+using common_utils::Log;
+
+UsbTopology::Snapshot::Snapshot(std::optional<uint64_t> seqnum,
+                                std::vector<SysfsUsbDevice> devices)
+    : seqnum_(seqnum) {
+  nodes_.reserve(devices.size());
+  for (SysfsUsbDevice &device : devices) {
+    const size_t index = nodes_.size();
+    Node node{std::move(device), std::nullopt, {}, {}};
+    auto it_parent = by_port_.find(node.device.parent_name);
+    if (!node.device.parent_name.empty() && it_parent != by_port_.end()) {
+      node.parent = it_parent->second;
+      nodes_[it_parent->second].children.push_back(index);
+      node.path =
+          nodes_[it_parent->second].path + '/' + node.device.sysfs_name;
+    } else {
+      roots_.push_back(index);
+      node.path = node.device.sysfs_name;
+    }
+    by_port_.emplace(node.device.sysfs_name, index);
+    // identical devices without a serial have the same hash
+    by_hash_.emplace(node.device.hash, index);
+    nodes_.push_back(std::move(node));
+  }
+}
+
+const UsbTopology::Node *
+UsbTopology::Snapshot::FindByHash(const std::string &hash) const noexcept {
+  auto it = by_hash_.find(hash);
+  return it != by_hash_.end() ? &nodes_[it->second] : nullptr;
+}
+
+const UsbTopology::Node *
+UsbTopology::Snapshot::FindByPort(const std::string &port) const noexcept {
+  auto it = by_port_.find(port);
+  return it != by_port_.end() ? &nodes_[it->second] : nullptr;
+}
+
+std::vector<UsbDevice> UsbTopology::Snapshot::Devices() const {
+  std::vector<UsbDevice> res;
+  res.reserve(nodes_.size());
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    res.push_back(SysfsUsbReader::ToUsbDevice(
+        nodes_[i].device, static_cast<uint>(i + 1), nodes_[i].path));
+  }
+  return res;
+}
+
+boost::json::array UsbTopology::Snapshot::BuildJsonArray() const {
+  boost::json::array res;
+  for (size_t index : roots_)
+    res.emplace_back(BuildJsonNode(index));
+  return res;
+}
+
+boost::json::object UsbTopology::Snapshot::BuildJsonNode(size_t index) const {
+  const Node &node = nodes_[index];
+  const SysfsUsbDevice &device = node.device;
+  boost::json::object res;
+  res["port"] = device.sysfs_name;
+  res["path"] = node.path;
+  res["vid"] = device.vid;
+  res["pid"] = device.pid;
+  res["name"] = device.name;
+  res["serial"] = device.serial;
+  res["connection"] = device.conn_type;
+  res["interface"] = device.WithInterface();
+  res["hash"] = device.hash;
+  res["parent_hash"] = device.parent_hash;
+  boost::json::array children;
+  // the depth is limited by the usb spec (7 tiers)
+  for (size_t child : node.children)
+    children.emplace_back(BuildJsonNode(child));
+  res["children"] = std::move(children);
+  return res;
+}
+
+UsbTopology::UsbTopology(std::string root, std::string seqnum_path) noexcept
+    : root_(std::move(root)), seqnum_path_(std::move(seqnum_path)) {}
+
+std::shared_ptr<const UsbTopology::Snapshot> UsbTopology::Get() noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // read the number before the walk, events during the walk will cause
+  // a rebuild next time
+  const std::optional<uint64_t> seqnum = ReadSeqnum();
+  if (cache_ && seqnum && cache_->seqnum() == seqnum)
+    return cache_;
+  try {
+    ++walks_;
+    cache_ = std::make_shared<const Snapshot>(
+        seqnum, SysfsUsbReader(root_).ReadAll());
+  } catch (const std::exception &ex) {
+    Log::Error() << "[UsbTopology] Can't build the device tree";
+    Log::Error() << ex.what();
+    cache_.reset();
+    return std::make_shared<const Snapshot>(std::nullopt,
+                                            std::vector<SysfsUsbDevice>{});
+  }
+  return cache_;
+}
+
+std::optional<uint64_t> UsbTopology::ReadSeqnum() const noexcept {
+  try {
+    std::ifstream file(seqnum_path_);
+    std::string str;
+    if (!file.is_open() || !std::getline(file, str))
+      return std::nullopt;
+    boost::trim(str);
+    size_t pos = 0;
+    const uint64_t res = std::stoull(str, &pos);
+    if (pos == str.size())
+      return res;
+  } catch (const std::exception &ex) {
+    Log::Warning() << "[UsbTopology] Can't read " << seqnum_path_;
+    Log::Warning() << ex.what();
+  }
+  return std::nullopt;
+}
+
+} // namespace guard
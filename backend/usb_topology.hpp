@@ -0,0 +1,109 @@
+#pragma once
+#include "sysfs_usb.hpp"
+#include "usb_device.hpp"
+#include <boost/json/array.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef UNIT_TEST
+#include "test.hpp"
+#endif
+
+namespace guard {
+
+/**
+ * @class UsbTopology
+ * @brief The tree of connected usb devices, read from sysfs
+ * @details The tree is built by one sysfs walk and cached. The cache is
+ * keyed on the kernel uevent sequence number, which grows on every device
+ * event, so the tree is rebuilt only after the hardware has changed.
+ * Methods are thread-safe, a snapshot is immutable.
+ */
+class UsbTopology {
+public:
+  /// @brief A device with links to the parent and the children
+  struct Node {
+    SysfsUsbDevice device;
+    std::optional<size_t> parent; /// index of the parent node
+    std::vector<size_t> children; /// indexes of the child nodes
+    std::string path;             /// ports from the root hub: usb1/1-1/1-1.2
+  };
+
+  /// @brief An immutable tree
+  class Snapshot {
+  public:
+    /// @param seqnum The sequence number read before the walk
+    /// @param devices Devices, parents go first
+    Snapshot(std::optional<uint64_t> seqnum,
+             std::vector<SysfsUsbDevice> devices);
+
+    /// @brief Find a device by its USBGuard hash
+    const Node *FindByHash(const std::string &hash) const noexcept;
+
+    /// @brief Find a device by the port (sysfs name)
+    const Node *FindByPort(const std::string &port) const noexcept;
+
+    /// @brief Devices for the device lists, numbered from 1
+    std::vector<UsbDevice> Devices() const;
+
+    /// @brief Nested json array, each root hub with its children
+    boost::json::array BuildJsonArray() const;
+
+    inline const std::vector<Node> &nodes() const noexcept { return nodes_; }
+    inline const std::vector<size_t> &roots() const noexcept {
+      return roots_;
+    }
+    inline std::optional<uint64_t> seqnum() const noexcept { return seqnum_; }
+
+  private:
+    boost::json::object BuildJsonNode(size_t index) const;
+
+    std::optional<uint64_t> seqnum_;
+    std::vector<Node> nodes_;
+    std::vector<size_t> roots_;
+    std::unordered_map<std::string, size_t> by_hash_;
+    std::unordered_map<std::string, size_t> by_port_;
+  };
+
+  /**
+   * @brief Constructor
+   * @param root /sys/bus/usb/devices or a copy of it
+   * @param seqnum_path The uevent sequence number file
+   */
+  explicit UsbTopology(std::string root = SysfsUsbReader::kDefaultRoot,
+                       std::string seqnum_path = kSeqnumPath) noexcept;
+
+  /**
+   * @brief Get the current tree
+   * @return The cached snapshot if no uevents happened since it was built
+   * @details If the sequence number can't be read, sysfs is walked on each
+   * call.
+   */
+  std::shared_ptr<const Snapshot> Get() noexcept;
+
+  /// @brief Number of sysfs walks performed
+  inline size_t walks() const noexcept { return walks_; }
+
+  static constexpr const char *kSeqnumPath = "/sys/kernel/uevent_seqnum";
+
+private:
+  std::optional<uint64_t> ReadSeqnum() const noexcept;
+
+  std::string root_;
+  std::string seqnum_path_;
+  std::mutex mutex_;
+  std::shared_ptr<const Snapshot> cache_;
+  size_t walks_ = 0;
+
+#ifdef UNIT_TEST
+  friend class ::Test;
+#endif
+};
+
+} // namespace guard
@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace common_utils {
+
+/**
+ * @brief A binary table of vid:pid pairs, written by vid_parser and read by
+ * the backend.
+ * @details Layout, all numbers are little-endian:
+ * - "AVPT" magic, uint32 version
+ * - uint32 number of pairs, uint32 number of vendors with any pid
+ * - (uint16 vid, uint16 pid) pairs, sorted
+ * - uint16 vids of the vendors with any pid, sorted
+ */
+namespace vidpid_table {
+
+constexpr char kMagic[4] = {'A', 'V', 'P', 'T'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 16;
+
+struct Entry {
+  uint16_t vid = 0;
+  uint16_t pid = 0;
+  bool any_pid = false; /// vid:*
+
+  inline bool operator<(const Entry &other) const noexcept {
+    return std::tie(any_pid, vid, pid) <
+           std::tie(other.any_pid, other.vid, other.pid);
+  }
+  inline bool operator==(const Entry &other) const noexcept {
+    return vid == other.vid && pid == other.pid && any_pid == other.any_pid;
+  }
+};
+
+/// @brief Parse 4 hex digits, "*" gives std::nullopt
+inline std::optional<uint16_t> ParseHex(const std::string &str) noexcept {
+  if (str.size() != 4)
+    return std::nullopt;
+  uint16_t res = 0;
+  for (const char symbol : str) {
+    res <<= 4;
+    if (symbol >= '0' && symbol <= '9')
+      res |= symbol - '0';
+    else if (symbol >= 'a' && symbol <= 'f')
+      res |= symbol - 'a' + 10;
+    else if (symbol >= 'A' && symbol <= 'F')
+      res |= symbol - 'A' + 10;
+    else
+      return std::nullopt;
+  }
+  return res;
+}
+
+/// @brief 4 lowercase hex digits, as USBGuard writes ids
+inline std::string ToHex(uint16_t val) {
+  constexpr char kDigits[] = "0123456789abcdef";
+  std::string res(4, '0');
+  for (int i = 3; i >= 0; --i) {
+    res[i] = kDigits[val & 0xF];
+    val >>= 4;
+  }
+  return res;
+}
+
+/// @brief Sort, deduplicate and serialize the entries
+inline std::string Serialize(std::vector<Entry> entries) {
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+  const auto it_any = std::partition_point(
+      entries.cbegin(), entries.cend(),
+      [](const Entry &entry) { return !entry.any_pid; });
+  const uint32_t n_pairs = std::distance(entries.cbegin(), it_any);
+  const uint32_t n_any = entries.size() - n_pairs;
+  std::string res(kMagic, sizeof(kMagic));
+  res.reserve(kHeaderSize + n_any * 2 + n_pairs * 4);
+  auto put16 = [&res](uint16_t val) {
+    res.push_back(static_cast<char>(val & 0xFF));
+    res.push_back(static_cast<char>(val >> 8));
+  };
+  auto put32 = [&put16](uint32_t val) {
+    put16(val & 0xFFFF);
+    put16(val >> 16);
+  };
+  put32(kVersion);
+  put32(n_pairs);
+  put32(n_any);
+  for (auto it = entries.cbegin(); it != it_any; ++it) {
+    put16(it->vid);
+    put16(it->pid);
+  }
+  for (auto it = it_any; it != entries.cend(); ++it)
+    put16(it->vid);
+  return res;
+}
+
+/**
+ * @brief Parse a serialized table
+ * @return std::nullopt if the data is not a valid table
+ */
+inline std::optional<std::vector<Entry>> Parse(const unsigned char *data,
+                                               size_t size) noexcept {
+  if (data == nullptr || size < kHeaderSize ||
+      !std::equal(kMagic, kMagic + sizeof(kMagic), data))
+    return std::nullopt;
+  auto get16 = [data](size_t pos) -> uint16_t {
+    return data[pos] | (data[pos + 1] << 8);
+  };
+  auto get32 = [&get16](size_t pos) -> uint32_t {
+    return get16(pos) | (static_cast<uint32_t>(get16(pos + 2)) << 16);
+  };
+  const uint32_t n_pairs = get32(8);
+  const uint32_t n_any = get32(12);
+  if (get32(4) != kVersion ||
+      size != kHeaderSize + static_cast<size_t>(n_any) * 2 +
+                  static_cast<size_t>(n_pairs) * 4)
+    return std::nullopt;
+  try {
+    std::vector<Entry> res;
+    res.reserve(n_any + n_pairs);
+    size_t pos = kHeaderSize;
+    for (uint32_t i = 0; i < n_pairs; ++i, pos += 4)
+      res.push_back({get16(pos), get16(pos + 2), false});
+    for (uint32_t i = 0; i < n_any; ++i, pos += 2)
+      res.push_back({get16(pos), 0, true});
+    return res;
+  } catch (const std::exception &) {
+    return std::nullopt;
+  }
+}
+
+} // namespace vidpid_table
+} // namespace common_utils
@@ -54,5 +54,65 @@ int main(int argc, char *argv[]) {
   // test Guard Audit reading
   test.Run18();
 
+  // test RuleSetDiff
+  test.Run19();
+
+  // test ChangeJournal
+  test.Run20();
+
+  // test DeviceInventory
+  test.Run21();
+
+  // test IpcConnection
+  test.Run22();
+
+  // test SysfsUsbReader
+  test.Run23();
+
+  // test UsbTopology
+  test.Run24();
+
+  // test RuleEvaluator
+  test.Run25();
+
+  // test RuleSet
+  test.Run26();
+
+  // test RuleAnalyzer
+  test.Run27();
+
+  // test RuleSetCompactor
+  test.Run28();
+
+  // test AndroidVidPid
+  test.Run29();
+
+  // test UdevVidPidParser
+  test.Run30();
+
+  // test GuardRuleBuilder
+  test.Run31();
+
+  // test streaming CSV import
+  test.Run32();
+
+  // test parallel CSV conversion
+  test.Run33();
+
+  // test chunked upload
+  test.Run34();
+
+  // test vector base64 decoding
+  test.Run35();
+
+  // test utf-8 filter
+  test.Run36();
+
+  // test rules export
+  test.Run37();
+
+  // test batch device policy
+  test.Run38();
+
   return 0;
 }
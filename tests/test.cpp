@@ -1,19 +1,45 @@
+#include "android_vidpid.hpp"
+#include "base64_rfc4648.hpp"
+#include "base64_stream.hpp"
+#include "change_journal.hpp"
 #include "common_utils.hpp"
 #include "config_status.hpp"
+#include "csv_row_reader.hpp"
+#include "device_inventory.hpp"
 #include "guard.hpp"
 #include "guard_audit.hpp"
 #include "guard_rule.hpp"
+#include "guard_rule_builder.hpp"
 #include "guard_utils.hpp"
+#include "ipc_connection.hpp"
 #include "json_rule.hpp"
 #include "log.hpp"
+#include "rule_analyzer.hpp"
+#include "rule_evaluator.hpp"
+#include "rule_exporter.hpp"
+#include "rule_set.hpp"
+#include "rule_set_compactor.hpp"
+#include "rule_set_diff.hpp"
+#include "sha256.hpp"
+#include "sysfs_usb.hpp"
+#include "thread_pool.hpp"
+#include "usb_topology.hpp"
 #include "systemd_dbus.hpp"
+#include "udev_vidpid_parser.hpp"
+#include "upload_spool.hpp"
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -1503,4 +1529,1551 @@ void Test::Run18(){
   }
 
   Log::Test() <<"Test18 ... OK";
-}
\ No newline at end of file
+}
+
+void Test::Run19() {
+  Log::Test() << "TEST19 ... RuleSetDiff";
+  auto make_rules = [](const std::vector<std::string> &strs) {
+    std::vector<guard::GuardRule> res;
+    for (const auto &str : strs)
+      res.emplace_back(str);
+    return res;
+  };
+  const std::string r_a = "allow id 1234:5678";
+  const std::string r_b = "block with-interface 08:*:*";
+  const std::string r_c = "allow with-interface one-of { 03:*:* 09:*:* }";
+  const std::string r_c_swap = "allow with-interface one-of { 09:*:* 03:*:* }";
+  const std::string r_d = "reject id 1111:2222";
+
+  Log::Test() << "equal sets, unordered values are compared as sets";
+  {
+    guard::RuleSetDiff diff(make_rules({r_a, r_b, r_c}),
+                            make_rules({r_a, r_b, r_c_swap}));
+    assert(diff.Empty());
+    assert(diff.unchanged().size() == 3);
+  }
+
+  Log::Test() << "added and removed";
+  {
+    guard::RuleSetDiff diff(make_rules({r_a, r_b, r_c}),
+                            make_rules({r_a, r_d, r_c}));
+    assert(!diff.Empty());
+    assert(diff.added() == std::vector<size_t>{1});
+    assert(diff.removed() == std::vector<size_t>{1});
+    assert(diff.moved().empty());
+    assert(diff.unchanged().size() == 2);
+  }
+
+  Log::Test() << "moved";
+  {
+    guard::RuleSetDiff diff(make_rules({r_a, r_b, r_c, r_d}),
+                            make_rules({r_b, r_c, r_d, r_a}));
+    assert(diff.added().empty() && diff.removed().empty());
+    assert(diff.moved().size() == 1);
+    assert(diff.moved()[0] == guard::RuleSetDiff::Match(0, 3));
+    assert(diff.unchanged().size() == 3);
+  }
+
+  Log::Test() << "duplicates";
+  {
+    guard::RuleSetDiff diff(make_rules({r_a, r_a, r_b}),
+                            make_rules({r_b, r_a}));
+    assert(diff.removed().size() == 1);
+    assert(diff.moved().size() + diff.unchanged().size() == 2);
+    assert(diff.added().empty());
+  }
+
+  Log::Test() << "json preview";
+  {
+    std::vector<guard::GuardRule> new_rules = make_rules({r_d});
+    guard::RuleSetDiff diff(make_rules({r_a}), new_rules);
+    boost::json::object obj = diff.BuildJsonObject(new_rules);
+    assert(obj.at("added").as_array().size() == 1);
+    assert(obj.at("removed").as_array().size() == 1);
+    assert(obj.at("unchanged").as_uint64() == 0);
+  }
+
+  Log::Test() << "Test19 ... OK";
+}
+
+void Test::Run20() {
+  Log::Test() << "TEST20 ... ChangeJournal";
+  const std::string dir =
+      (std::filesystem::temp_directory_path() / "usbguard_journal_test")
+          .string();
+  std::filesystem::remove_all(dir);
+  guard::JournalState prev_state;
+  prev_state.policy = guard::Target::allow;
+  prev_state.rules = "block id 1234:5678\n";
+  guard::JournalState target_state;
+  target_state.policy = guard::Target::block;
+  target_state.rules = "allow id 1234:5678\n";
+  target_state.daemon_active = true;
+  target_state.daemon_enabled = true;
+
+  Log::Test() << "no journal - nothing to recover";
+  {
+    guard::ConfigStatus config;
+    guard::ChangeJournal journal(dir);
+    assert(journal.Recover(config));
+  }
+
+  Log::Test() << "begin and commit";
+  {
+    guard::ChangeJournal journal(dir);
+    assert(journal.Begin(prev_state, target_state));
+    assert(std::filesystem::exists(dir + "/journal.json"));
+    auto record = journal.Read();
+    assert(record);
+    assert(record->prev.policy == guard::Target::allow);
+    assert(record->prev.rules == prev_state.rules);
+    assert(!record->prev.daemon_active);
+    assert(record->target.policy == guard::Target::block);
+    assert(record->target.rules == target_state.rules);
+    assert(record->target.daemon_enabled);
+    assert(!record->rolling_back);
+    // the transaction is in progress, another process must not touch it
+    guard::ChangeJournal other(dir);
+    assert(!other.Lock(false));
+    assert(journal.Commit());
+    assert(!std::filesystem::exists(dir + "/journal.json"));
+    assert(other.Lock(false));
+  }
+
+  Log::Test() << "no rules in the state";
+  {
+    guard::ChangeJournal journal(dir);
+    target_state.rules.reset();
+    assert(journal.Begin(prev_state, target_state));
+    assert(!journal.Read()->target.rules);
+    assert(journal.Commit());
+  }
+  Log::Test() << "rolling back";
+  {
+    guard::ChangeJournal journal(dir);
+    assert(journal.Begin(prev_state, target_state));
+    // the record written by Rollback before the previous state is applied
+    assert(journal.Write({prev_state, prev_state, true}));
+    auto record = journal.Read();
+    assert(record && record->rolling_back);
+    assert(record->target.rules == prev_state.rules);
+    assert(record->target.policy == guard::Target::allow);
+    assert(journal.Commit());
+  }
+  std::filesystem::remove_all(dir);
+  Log::Test() << "Test20 ... OK";
+}
+
+void Test::Run21() {
+  Log::Test() << "TEST21 ... DeviceInventory";
+  const usbguard::Rule kbd = usbguard::Rule::fromString(
+      "allow id 046d:c31c serial \"\" name \"USB Keyboard\" hash "
+      "\"6nNEPsP+sm8KBKmYXc8ZNyD5Y2S4D7emwoiYVCnjjP8=\" with-interface { "
+      "03:01:01 03:00:00 }");
+  const usbguard::Rule disk = usbguard::Rule::fromString(
+      "block id 0951:1666 serial \"60A44C413A8\" name \"DataTraveler\" hash "
+      "\"kNHBoR8mtQmZfBlrV7LKt5oY9+ogYRbVh81xCcJjk20=\" with-interface "
+      "08:06:50");
+
+  guard::DeviceInventory inventory;
+  assert(!inventory.valid());
+  inventory.Reset({}, 0);
+  assert(inventory.valid());
+  assert(inventory.Devices().empty());
+  const uint64_t v_empty = inventory.version();
+
+  Log::Test() << "insert, one object per device";
+  inventory.Update(1, kbd);
+  inventory.Update(2, disk);
+  assert(inventory.Devices().size() == 2);
+  {
+    auto delta = inventory.ChangesSince(v_empty);
+    assert(!delta.full);
+    assert(delta.devices.size() == 2);
+    assert(delta.removed.empty());
+    // interfaces are folded only for output
+    const guard::UsbDevice &usb_kbd = delta.devices[0];
+    assert(usb_kbd.interfaces().types().size() == 2);
+    assert(usb_kbd.interfaces().HasClass(0x03));
+    assert(!usb_kbd.interfaces().HasClass(0x08));
+    assert(usb_kbd.SerializeRowsForLisp().size() == 1);
+    assert(usb_kbd.SerializeRowsForLisp()[0][2].second == "03:*:*");
+  }
+
+  Log::Test() << "interface set, a row per base class";
+  {
+    guard::UsbInterfaceSet i_set(
+        "with-interface { 03:01:01 08:06:50 03:00:00 }");
+    std::vector<std::string> exp{"03:*:*", "08:06:50"};
+    assert(i_set.Fold() == exp);
+  }
+
+  Log::Test() << "interface type parsing";
+  {
+    using guard::UsbType;
+    static_assert(UsbType::Parse("0e:01:00")->packed() == 0x0E0100);
+    static_assert(UsbType::Parse(" 3 : a:FF")->packed() == 0x030AFF);
+    static_assert(!UsbType::Parse("ffg:gf:g0"));
+    static_assert(!UsbType::Parse("03:01"));
+    static_assert(!UsbType::Parse("03:01:02:04"));
+    assert(UsbType::Parse("08:06:50")->base_str() == "08");
+  }
+
+  Log::Test() << "policy changed and removed";
+  const uint64_t v_inserted = inventory.version();
+  usbguard::Rule disk_allowed = disk;
+  disk_allowed.setTarget(usbguard::Rule::Target::Allow);
+  inventory.Update(2, disk_allowed);
+  inventory.Remove(1);
+  {
+    auto delta = inventory.ChangesSince(v_inserted);
+    assert(!delta.full);
+    assert(delta.version == inventory.version());
+    assert(delta.devices.size() == 1);
+    assert(delta.devices[0].SerializeForLisp()[5].second == "allow");
+    assert(delta.removed == std::vector<uint32_t>{1});
+  }
+  assert(inventory.ChangesSince(inventory.version()).devices.empty());
+
+  Log::Test() << "unknown version - full list";
+  {
+    auto delta = inventory.ChangesSince(0);
+    assert(delta.full);
+    assert(delta.devices.size() == 1);
+    delta = inventory.ChangesSince(inventory.version() + 1);
+    assert(delta.full);
+  }
+
+  Log::Test() << "invalidate";
+  inventory.Invalidate();
+  assert(!inventory.valid());
+  Log::Test() << "Test21 ... OK";
+}
+
+void Test::Run22() {
+  Log::Test() << "TEST22 ... IpcConnection";
+  guard::DeviceInventory inventory;
+  guard::IpcConnection connection(inventory);
+  assert(!connection.Connected());
+  assert(connection.client() == nullptr);
+
+  Log::Test() << "no attempts before the backoff delay";
+  connection.next_attempt_ =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  assert(!connection.Connect());
+  assert(connection.client() == nullptr);
+  assert(connection.stats().failures == 0);
+
+  Log::Test() << "waiting is bounded by the timeout";
+  auto start = std::chrono::steady_clock::now();
+  assert(!connection.WaitReady(std::chrono::milliseconds(200)));
+  assert(std::chrono::steady_clock::now() - start <
+         std::chrono::milliseconds(1000));
+
+  Log::Test() << "reuse of a connection";
+  connection.next_attempt_ = std::chrono::steady_clock::now();
+  if (connection.Connect()) {
+    guard::InventoryIpcClient *client = connection.client();
+    assert(connection.Connect());
+    assert(connection.client() == client);
+    assert(connection.stats().connects == 1);
+  }
+  Log::Test() << "Test22 ... OK";
+}
+
+void Test::Run23() {
+  Log::Test() << "TEST23 ... SysfsUsbReader";
+  namespace fs = std::filesystem;
+
+  Log::Test() << "sha256 known vectors";
+  auto to_hex = [](const Sha256::Digest &digest) {
+    std::string res;
+    char buf[3];
+    for (uint8_t byte : digest) {
+      std::snprintf(buf, sizeof(buf), "%02x", byte);
+      res += buf;
+    }
+    return res;
+  };
+  Sha256 sha_empty;
+  assert(to_hex(sha_empty.Final()) ==
+         "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  Sha256 sha_abc;
+  sha_abc.Update("a");
+  sha_abc.Update("bc");
+  assert(to_hex(sha_abc.Final()) ==
+         "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+  Log::Test() << "fake sysfs tree";
+  const fs::path root =
+      fs::temp_directory_path() / "usbguard_sysfs_test";
+  fs::remove_all(root);
+  const fs::path hub = root / "devices" / "usb1";
+  const fs::path disk = hub / "1-1";
+  const fs::path bus = root / "bus";
+  fs::create_directories(disk / "1-1:1.0");
+  fs::create_directories(disk / "port");
+  fs::create_directories(bus);
+  auto write = [](const fs::path &path, const std::string &data) {
+    std::ofstream file(path, std::ios::binary);
+    file << data;
+  };
+  // device descriptor, config descriptor, two interfaces, an endpoint
+  std::string disk_descr(18, '\0');
+  disk_descr[0] = 18;
+  disk_descr[1] = 1;
+  const std::string config{9, 2, 39, 0, 2, 1, 0, '\x80', 50};
+  const std::string iface1{9, 4, 0, 0, 2, 8, 6, 0x50, 0};
+  const std::string endpoint{7, 5, '\x81', 2, 0, 2, 0};
+  const std::string iface2{9, 4, 1, 0, 0, 3, 1, 1, 0};
+  disk_descr += config + iface1 + endpoint + iface2;
+  const std::string hub_descr =
+      std::string{18, 1} + std::string(16, '\0') +
+      std::string{9, 2, 25, 0, 1, 1, 0, '\xe0', 0} +
+      std::string{9, 4, 0, 0, 1, 9, 0, 0, 0};
+  write(hub / "idVendor", "1d6b\n");
+  write(hub / "idProduct", "0002\n");
+  write(hub / "product", "xHCI Host Controller\n");
+  write(hub / "serial", "0000:00:14.0\n");
+  write(hub / "descriptors", hub_descr);
+  write(disk / "idVendor", "0781\n");
+  write(disk / "idProduct", "5581\n");
+  write(disk / "product", "Ultra\n");
+  write(disk / "serial", "4C530001\n");
+  write(disk / "descriptors", disk_descr);
+  write(disk / "port" / "connect_type", "hotplug\n");
+  fs::create_directory_symlink(hub, bus / "usb1");
+  fs::create_directory_symlink(disk, bus / "1-1");
+  fs::create_directory_symlink(disk / "1-1:1.0", bus / "1-1:1.0");
+
+  const std::vector<guard::SysfsUsbDevice> devices =
+      guard::SysfsUsbReader(bus.string()).ReadAll();
+  assert(devices.size() == 2);
+  const guard::SysfsUsbDevice &root_hub = devices[0];
+  const guard::SysfsUsbDevice &usb_disk = devices[1];
+  assert(root_hub.sysfs_name == "usb1");
+  assert(root_hub.parent_name.empty());
+  assert(root_hub.parent_hash.empty());
+  assert(root_hub.WithInterface() == "with-interface 09:00:00");
+  assert(usb_disk.sysfs_name == "1-1");
+  assert(usb_disk.vid == "0781" && usb_disk.pid == "5581");
+  assert(usb_disk.name == "Ultra" && usb_disk.serial == "4C530001");
+  assert(usb_disk.conn_type == "hotplug");
+  assert(usb_disk.parent_name == "usb1");
+  assert(usb_disk.parent_hash == root_hub.hash);
+  assert(usb_disk.WithInterface() ==
+         "with-interface { 08:06:50 03:01:01 }");
+
+  Log::Test() << "the hash is built as USBGuard does";
+  Sha256 sha_disk;
+  sha_disk.Update(std::string("Ultra07815581") + "4C530001" + disk_descr);
+  assert(usb_disk.hash ==
+         cppcodec::base64_rfc4648::encode<std::string>(sha_disk.Final()));
+
+  guard::UsbDevice dev = guard::SysfsUsbReader::ToUsbDevice(usb_disk, 2);
+  assert(dev.hash() == usb_disk.hash);
+  assert(dev.name() == "Ultra");
+  fs::remove_all(root);
+  Log::Test() << "Test23 ... OK";
+}
+
+void Test::Run24() {
+  Log::Test() << "TEST24 ... UsbTopology";
+  namespace fs = std::filesystem;
+  const fs::path root = fs::temp_directory_path() / "usbguard_topology_test";
+  fs::remove_all(root);
+  const fs::path bus = root / "bus";
+  const fs::path seqnum = root / "uevent_seqnum";
+  fs::create_directories(bus);
+  auto write = [](const fs::path &path, const std::string &data) {
+    std::ofstream file(path, std::ios::binary);
+    file << data;
+  };
+  // root hub -> hub -> keyboard, and one more root hub
+  auto add_device = [&](const fs::path &dir, const std::string &pid,
+                        const std::string &serial) {
+    fs::create_directories(dir);
+    write(dir / "idVendor", "1d6b\n");
+    write(dir / "idProduct", pid + "\n");
+    write(dir / "serial", serial + "\n");
+    write(dir / "descriptors",
+          std::string{18, 1} + std::string(16, '\0') +
+              std::string{9, 4, 0, 0, 1, 3, 1, 1, 0});
+    fs::create_directory_symlink(dir, bus / dir.filename());
+  };
+  const fs::path usb1 = root / "devices" / "usb1";
+  add_device(usb1, "0002", "hub1");
+  add_device(usb1 / "1-1", "0101", "hub");
+  add_device(usb1 / "1-1" / "1-1.2", "0102", "kbd");
+  add_device(root / "devices" / "usb2", "0003", "hub2");
+  write(seqnum, "100\n");
+
+  guard::UsbTopology topology(bus.string(), seqnum.string());
+  auto snapshot = topology.Get();
+  assert(topology.walks() == 1);
+  assert(snapshot->seqnum() == 100);
+  assert(snapshot->nodes().size() == 4);
+  assert(snapshot->roots().size() == 2);
+  const guard::UsbTopology::Node *kbd = snapshot->FindByPort("1-1.2");
+  const guard::UsbTopology::Node *hub = snapshot->FindByPort("1-1");
+  assert(kbd != nullptr && hub != nullptr);
+  assert(kbd->path == "usb1/1-1/1-1.2");
+  assert(kbd->device.parent_hash == hub->device.hash);
+  assert(snapshot->FindByHash(kbd->device.hash) == kbd);
+  assert(hub->children.size() == 1);
+  assert(&snapshot->nodes()[hub->children.front()] == kbd);
+  assert(snapshot->nodes()[*kbd->parent].device.sysfs_name == "1-1");
+
+  Log::Test() << "devices carry the parent hash and the topology";
+  for (const guard::UsbDevice &dev : snapshot->Devices()) {
+    if (dev.port() == "1-1.2") {
+      assert(dev.topology() == "usb1/1-1/1-1.2");
+      assert(dev.parent_hash() == hub->device.hash);
+    }
+  }
+  boost::json::array js_tree = snapshot->BuildJsonArray();
+  assert(js_tree.size() == 2);
+  assert(js_tree[0].as_object().at("children").as_array().size() == 1);
+
+  Log::Test() << "the snapshot is cached until the next uevent";
+  assert(topology.Get() == snapshot);
+  assert(topology.walks() == 1);
+  write(seqnum, "101\n");
+  auto updated = topology.Get();
+  assert(updated != snapshot);
+  assert(topology.walks() == 2);
+  assert(updated->seqnum() == 101);
+
+  Log::Test() << "no cache without the sequence number";
+  fs::remove(seqnum);
+  topology.Get();
+  topology.Get();
+  assert(topology.walks() == 4);
+  fs::remove_all(root);
+  Log::Test() << "Test24 ... OK";
+}
+
+void Test::Run25() {
+  Log::Test() << "TEST25 ... RuleEvaluator";
+  using guard::GuardRule;
+  using guard::RuleEvaluator;
+  using guard::RuleVerdict;
+  using guard::Target;
+  using guard::UsbDevice;
+  auto make_device = [](const std::string &vid, const std::string &pid,
+                        const std::string &port, const std::string &i_type,
+                        const std::string &hash) {
+    return UsbDevice({1, "block", "Ultra", vid, pid, port, "hotplug", i_type,
+                      "4C530001", hash, "parent_hash_value", "usb1/" + port});
+  };
+  const UsbDevice disk = make_device("0781", "5581", "1-1",
+                                     "with-interface 08:06:50",
+                                     "disk_hash_value");
+  const UsbDevice kbd = make_device("046d", "c31c", "1-2",
+                                    "with-interface { 03:01:01 03:00:00 }",
+                                    "kbd_hash_value");
+  const UsbDevice other = make_device("1234", "0001", "2-1",
+                                      "with-interface { 08:06:50 03:01:01 }",
+                                      "other_hash_value");
+
+  Log::Test() << "attributes and operators";
+  assert(RuleEvaluator::Matches(GuardRule("allow id 0781:5581"), disk));
+  assert(RuleEvaluator::Matches(GuardRule("allow id 0781:*"), disk));
+  assert(!RuleEvaluator::Matches(GuardRule("allow id 0781:5582"), disk));
+  assert(RuleEvaluator::Matches(
+      GuardRule("allow hash \"disk_hash_value\""), disk));
+  assert(RuleEvaluator::Matches(
+      GuardRule("allow parent-hash \"parent_hash_value\""), disk));
+  assert(RuleEvaluator::Matches(
+      GuardRule("allow name \"Ultra\" serial \"4C530001\""), disk));
+  assert(!RuleEvaluator::Matches(GuardRule("allow serial \"XX\""), disk));
+  assert(RuleEvaluator::Matches(GuardRule("allow via-port \"1-1\""), disk));
+  assert(RuleEvaluator::Matches(
+      GuardRule("allow via-port one-of { \"2-1\" \"1-1\" }"), disk));
+  assert(!RuleEvaluator::Matches(
+      GuardRule("allow via-port none-of { \"1-1\" }"), disk));
+  assert(RuleEvaluator::Matches(
+      GuardRule("allow with-connect-type \"hotplug\""), disk));
+  assert(RuleEvaluator::Matches(GuardRule("allow with-interface 08:*:*"),
+                                disk));
+  // without an operator all device interfaces must match
+  assert(!RuleEvaluator::Matches(GuardRule("allow with-interface 03:*:*"),
+                                 other));
+  assert(RuleEvaluator::Matches(GuardRule("allow with-interface 03:*:*"),
+                                kbd));
+  assert(RuleEvaluator::Matches(
+      GuardRule("allow with-interface one-of { 03:*:* 09:00:00 }"), other));
+  assert(RuleEvaluator::Matches(
+      GuardRule("allow with-interface all-of { 08:06:50 03:01:01 }"),
+      other));
+  assert(!RuleEvaluator::Matches(
+      GuardRule("allow with-interface all-of { 08:06:50 09:00:00 }"),
+      other));
+  assert(RuleEvaluator::Matches(
+      GuardRule("allow with-interface none-of { 09:*:* }"), other));
+  assert(RuleEvaluator::Matches(
+      GuardRule("allow with-interface { 03:00:00 03:01:01 }"), kbd));
+  assert(!RuleEvaluator::Matches(
+      GuardRule("allow with-interface equals-ordered { 03:00:00 03:01:01 }"),
+      kbd));
+
+  Log::Test() << "the first matching rule wins";
+  std::vector<GuardRule> rules{
+      GuardRule("block with-interface 03:*:*"),
+      GuardRule("allow id 046d:c31c"),
+      GuardRule("allow id 0781:*"),
+      GuardRule("block hash \"disk_hash_value\""),
+      GuardRule("allow with-interface one-of { 08:*:* }"),
+      GuardRule("reject id 1234:0001 if localtime(00:00-12:00)")};
+  RuleEvaluator evaluator(rules, Target::block);
+  std::vector<RuleVerdict> verdicts = evaluator.Evaluate({disk, kbd, other});
+  assert(verdicts.size() == 3);
+  assert(verdicts[0].rule == 2 && verdicts[0].target == Target::allow);
+  assert(verdicts[1].rule == 0 && verdicts[1].target == Target::block);
+  assert(verdicts[2].rule == 4 && verdicts[2].certain);
+  const UsbDevice unknown = make_device("ffff", "0001", "3-1",
+                                        "with-interface 09:00:00", "hash");
+  RuleVerdict verdict = evaluator.Evaluate(unknown);
+  assert(!verdict.rule && verdict.target == Target::block);
+
+  Log::Test() << "a runtime condition gives an uncertain result";
+  std::vector<GuardRule> cond_rules{
+      GuardRule("block id 1234:0001 if !allowed-matches(id 1234:*)"),
+      GuardRule("allow id 1234:0001 if false"),
+      GuardRule("allow id 1234:0001")};
+  RuleEvaluator cond_evaluator(cond_rules, Target::block);
+  verdict = cond_evaluator.Evaluate(other);
+  assert(verdict.rule == 0 && !verdict.certain);
+  cond_rules.erase(cond_rules.begin());
+  RuleEvaluator false_evaluator(cond_rules, Target::block);
+  verdict = false_evaluator.Evaluate(other);
+  assert(verdict.rule == 1 && verdict.certain);
+
+  Log::Test() << "the index is used for large rule sets";
+  std::vector<GuardRule> many;
+  many.reserve(20000);
+  for (int i = 0; i < 20000; ++i) {
+    many.emplace_back("allow hash \"hash_number_" + std::to_string(i) +
+                      "\"");
+  }
+  many.emplace_back("block id 0781:5581");
+  RuleEvaluator big_evaluator(many, Target::allow);
+  std::vector<UsbDevice> devices;
+  for (int i = 0; i < 100; ++i) {
+    devices.push_back(make_device("0781", "5581", "1-1",
+                                  "with-interface 08:06:50",
+                                  "hash_number_" + std::to_string(i * 7)));
+  }
+  devices.push_back(disk);
+  auto start = std::chrono::steady_clock::now();
+  verdicts = big_evaluator.Evaluate(devices);
+  auto duration = std::chrono::steady_clock::now() - start;
+  Log::Test() << "evaluated in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(
+                     duration)
+                     .count()
+              << " us";
+  assert(verdicts[10].rule == 70);
+  assert(verdicts.back().rule == 20000);
+  assert(verdicts.back().target == Target::block);
+  Log::Test() << "Test25 ... OK";
+}
+
+void Test::Run26() {
+  Log::Test() << "TEST26 ... RuleSet";
+  using guard::GuardRule;
+  std::vector<GuardRule> rules{
+      GuardRule("allow id 0781:5581 hash \"disk_hash_value\""),
+      GuardRule("block id 046d:c31c"),
+      GuardRule("allow with-interface one-of { 08:*:* 03:*:* }"),
+      GuardRule("block id 046d:c31c")};
+  for (uint i = 0; i < rules.size(); ++i)
+    rules[i].number(i * 2);
+  guard::RuleSet rule_set(std::move(rules));
+  assert(rule_set.size() == 4);
+
+  Log::Test() << "lookups";
+  assert(rule_set.FindByNumber(2)->vid() == "046d");
+  assert(rule_set.FindByNumber(3) == nullptr);
+  assert(rule_set.FindByHash("disk_hash_value").size() == 1);
+  assert(rule_set.FindByHash("\"disk_hash_value\"").size() == 1);
+  assert(rule_set.FindByVidPid("046d", "c31c").size() == 2);
+  assert(rule_set.FindByVidPid("0781", "5581").front()->number() == 0);
+  // the same rule with another order of values
+  const GuardRule *equal =
+      rule_set.FindEqual(GuardRule("allow with-interface one-of { 03:*:* "
+                                   "08:*:* }"));
+  assert(equal != nullptr && equal->number() == 4);
+
+  Log::Test() << "numbers are stable after removal";
+  assert(rule_set.Remove(2));
+  assert(!rule_set.Remove(2));
+  assert(rule_set.size() == 3);
+  assert(rule_set.FindByNumber(2) == nullptr);
+  assert(rule_set.FindByNumber(6)->vid() == "046d");
+  assert(rule_set.FindByVidPid("046d", "c31c").size() == 1);
+  assert(rule_set.Add(GuardRule("block id 1234:5678")) == 7);
+  assert(!rule_set.AddUnique(GuardRule("block id 1234:5678")));
+  assert(rule_set.AddUnique(GuardRule("block id 1234:5679")));
+
+  Log::Test() << "the rules order is kept";
+  std::vector<uint> numbers;
+  for (const GuardRule &rule : rule_set)
+    numbers.push_back(rule.number());
+  assert((numbers == std::vector<uint>{0, 4, 6, 7, 8}));
+  assert(rule_set.ToVector().size() == 5);
+  assert(rule_set.CanonicalStrings()[3] == "block id 1234:5678");
+  Log::Test() << "Test26 ... OK";
+}
+
+void Test::Run27() {
+  Log::Test() << "TEST27 ... RuleAnalyzer";
+  using guard::GuardRule;
+  using guard::RuleAnalyzer;
+  using Kind = guard::RuleFinding::Kind;
+
+  Log::Test() << "covering rules";
+  assert(RuleAnalyzer::Covers(GuardRule("allow id 046d:*"),
+                              GuardRule("block id 046d:c31c")));
+  assert(!RuleAnalyzer::Covers(GuardRule("allow id 046d:c31c"),
+                               GuardRule("block id 046d:*")));
+  assert(RuleAnalyzer::Covers(GuardRule("allow with-interface 03:*:*"),
+                              GuardRule("allow with-interface 03:01:01")));
+  // a device with other interfaces matches the second rule only
+  assert(!RuleAnalyzer::Covers(GuardRule("allow with-interface 03:*:*"),
+                               GuardRule("block id 046d:c31c")));
+  assert(RuleAnalyzer::Covers(
+      GuardRule("allow with-interface one-of { 03:*:* 08:*:* }"),
+      GuardRule("block id 046d:c31c with-interface 08:06:50")));
+  assert(RuleAnalyzer::Covers(
+      GuardRule("allow with-interface none-of { 08:*:* }"),
+      GuardRule("block with-interface { 03:01:01 03:00:00 }")));
+  assert(RuleAnalyzer::Covers(
+      GuardRule("allow via-port one-of { \"1-1\" \"1-2\" }"),
+      GuardRule("block id 046d:c31c via-port \"1-2\"")));
+  assert(!RuleAnalyzer::Covers(
+      GuardRule("allow via-port none-of { \"1-2\" }"),
+      GuardRule("block via-port \"1-2\"")));
+  assert(!RuleAnalyzer::Covers(
+      GuardRule("allow id 046d:* if localtime(00:00-12:00)"),
+      GuardRule("block id 046d:c31c")));
+
+  Log::Test() << "findings";
+  std::vector<GuardRule> rules{
+      GuardRule("allow id 046d:*"),
+      GuardRule("block id 046d:c31c"),
+      GuardRule("allow hash \"disk_hash_value\""),
+      GuardRule("allow hash \"disk_hash_value\""),
+      GuardRule("allow id 0781:5581 hash \"disk_hash_value\" name \"U\""),
+      GuardRule("block with-interface 08:*:*"),
+      GuardRule("allow id 0781:5581 with-interface 08:06:50")};
+  for (uint i = 0; i < rules.size(); ++i)
+    rules[i].number(i);
+  RuleAnalyzer analyzer(rules);
+  const std::vector<guard::RuleFinding> &findings = analyzer.findings();
+  assert(findings.size() == 4);
+  assert(findings[0].kind == Kind::contradiction && findings[0].pos == 1 &&
+         findings[0].by == 0);
+  assert(findings[1].kind == Kind::duplicate && findings[1].pos == 3 &&
+         findings[1].by == 2);
+  assert(findings[2].kind == Kind::shadowed && findings[2].pos == 4 &&
+         findings[2].by == 2);
+  assert(findings[3].kind == Kind::contradiction && findings[3].pos == 6 &&
+         findings[3].by == 5);
+  boost::json::object obj = analyzer.BuildJsonObject(rules);
+  assert(obj.at("duplicates").as_array().size() == 1);
+  assert(obj.at("contradictions").as_array().size() == 2);
+
+  Log::Test() << "a large set without findings";
+  std::vector<GuardRule> many;
+  for (int i = 0; i < 5000; ++i) {
+    many.emplace_back("allow hash \"hash_number_" + std::to_string(i) +
+                      "\"");
+  }
+  assert(RuleAnalyzer(many).findings().empty());
+  Log::Test() << "Test27 ... OK";
+}
+
+void Test::Run28() {
+  Log::Test() << "TEST28 ... RuleSetCompactor";
+  using guard::GuardRule;
+  using guard::RuleEvaluator;
+  using guard::RuleSetCompactor;
+  using guard::Target;
+  using guard::UsbDevice;
+
+  Log::Test() << "id rules";
+  std::vector<GuardRule> rules;
+  for (int i = 0; i < 10; ++i) {
+    rules.emplace_back("block id 18d1:4e" + std::to_string(10 + i));
+  }
+  rules.emplace_back("block id 18d1:4e10"); // duplicate
+  rules.emplace_back("block id 22b8:*");    // a wildcard is not merged
+  RuleSetCompactor compactor;
+  std::vector<GuardRule> res = compactor.Compact(rules);
+  assert(res.size() == 2);
+  assert(res[0].ids() && res[0].ids()->second.size() == 10);
+  assert(res[1].BuildString() == rules.back().BuildString());
+  assert(compactor.report().rules_before == 12);
+  assert(compactor.report().rules_after == 2);
+  assert(compactor.report().merged_rules == 11);
+  assert(compactor.report().groups == 1);
+  // the merged rule is read back the same
+  assert(GuardRule(res[0].BuildString()).BuildString() ==
+         res[0].BuildString());
+
+  Log::Test() << "hash rules and runs";
+  rules = {GuardRule("allow hash \"disk_hash_value\" name \"Ultra\""),
+           GuardRule("allow id 046d:c31c"),
+           GuardRule("allow hash \"kbd_hash_value\""),
+           GuardRule("block id 1234:0001"),
+           GuardRule("allow hash \"other_hash_value\""),
+           GuardRule("allow id 0781:5581 with-interface 08:06:50")};
+  res = compactor.Compact(rules);
+  // the "block" rule splits rules to two runs
+  assert(res.size() == 5);
+  assert(res[0].hashes() && res[0].hashes()->second.size() == 2);
+  assert(res[1].BuildString() == rules[1].BuildString());
+  assert(res[2].BuildString() == rules[3].BuildString());
+  assert(res[3].BuildString() == rules[4].BuildString());
+  assert(res[4].BuildString() == rules[5].BuildString());
+
+  Log::Test() << "chunks";
+  rules.clear();
+  for (int i = 0; i < 5; ++i) {
+    rules.emplace_back("allow hash \"hash_number_" + std::to_string(i) +
+                       "\"");
+  }
+  res = RuleSetCompactor(2).Compact(rules);
+  assert(res.size() == 3);
+  assert(res[0].hashes() && res[1].hashes());
+  assert(res[2].BuildString() == rules[4].BuildString());
+
+  Log::Test() << "the same verdicts";
+  auto make_device = [](const std::string &vid, const std::string &pid,
+                        const std::string &hash) {
+    return UsbDevice({1, "block", "Ultra", vid, pid, "1-1", "hotplug",
+                      "with-interface 08:06:50", "", hash, "", "usb1/1-1"});
+  };
+  const std::vector<UsbDevice> devices{
+      make_device("18d1", "4e12", "a_hash_value"),
+      make_device("046d", "c31c", "kbd_hash_value"),
+      make_device("1234", "0001", "other_hash_value"),
+      make_device("0781", "5581", "disk_hash_value"),
+      make_device("ffff", "0000", "none_hash_value")};
+  rules = {GuardRule("allow hash \"disk_hash_value\""),
+           GuardRule("block id 18d1:4e12"),
+           GuardRule("block id 1234:0001"),
+           GuardRule("block hash \"other_hash_value\""),
+           GuardRule("allow id 046d:c31c"),
+           GuardRule("allow id 1234:0001"),
+           GuardRule("allow with-interface 08:*:*")};
+  res = compactor.Compact(rules);
+  assert(res.size() < rules.size());
+  const RuleEvaluator before(rules, Target::block);
+  const RuleEvaluator after(res, Target::block);
+  for (const UsbDevice &device : devices) {
+    assert(before.Evaluate(device).target == after.Evaluate(device).target);
+  }
+  Log::Test() << "Test28 ... OK";
+}
+
+void Test::Run29() {
+  Log::Test() << "TEST29 ... AndroidVidPid";
+  namespace fs = std::filesystem;
+  namespace vidpid_table = common_utils::vidpid_table;
+  using guard::AndroidVidPid;
+  using guard::GuardRule;
+  using Entry = vidpid_table::Entry;
+
+  Log::Test() << "serialize and parse";
+  const std::vector<Entry> entries{
+      {0x18d1, 0x4ee7, false}, {0x0502, 0x3604, false},
+      {0x22b8, 0, true},       {0x18d1, 0x4ee7, false}};
+  const std::string table = vidpid_table::Serialize(entries);
+  assert(table.size() == vidpid_table::kHeaderSize + 2 * 4 + 2);
+  auto parsed = vidpid_table::Parse(
+      reinterpret_cast<const unsigned char *>(table.data()), table.size());
+  assert(parsed && parsed->size() == 3);
+  assert(parsed->at(0) == (Entry{0x0502, 0x3604, false}));
+  assert(parsed->at(1) == (Entry{0x18d1, 0x4ee7, false}));
+  assert(parsed->at(2) == (Entry{0x22b8, 0, true}));
+  assert(!vidpid_table::Parse(
+      reinterpret_cast<const unsigned char *>(table.data()),
+      table.size() - 1));
+  assert(vidpid_table::ToHex(0x0a5c) == "0a5c");
+  assert(vidpid_table::ParseHex("0A5c") == 0x0a5c);
+  assert(!vidpid_table::ParseHex("*"));
+
+  Log::Test() << "files";
+  const fs::path dir = fs::temp_directory_path() / "usbguard_android_test";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  const std::string bin_path = dir / "android_vidpid.bin";
+  const std::string json_path = dir / "android_vidpid.json";
+  {
+    std::ofstream json_file(json_path);
+    json_file << R"([{"vid":"0502","pid":"3604"},{"vid":"22b8","pid":"*"},)"
+              << R"({"vid":"18d1","pid":"4ee7"}])";
+  }
+  // no binary table - JSON is used
+  std::vector<Entry> loaded = AndroidVidPid(bin_path, json_path).Load();
+  assert(loaded.size() == 3);
+  {
+    std::ofstream bin_file(bin_path, std::ios::binary);
+    bin_file.write(table.data(), table.size());
+  }
+  assert(AndroidVidPid::LoadBinary(bin_path) == parsed);
+  fs::remove(json_path);
+  loaded = AndroidVidPid(bin_path, json_path).Load();
+  assert(loaded == *parsed);
+  // a broken table
+  {
+    std::ofstream bin_file(bin_path, std::ios::binary);
+    bin_file << "AVPT";
+  }
+  bool thrown = false;
+  try {
+    AndroidVidPid(bin_path, json_path).Load();
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  fs::remove_all(dir);
+
+#ifdef ANDROID_VIDPID_DIR
+  Log::Test() << "the shipped table matches the JSON list";
+  {
+    const std::string shipped_dir = ANDROID_VIDPID_DIR;
+    auto shipped_json =
+        AndroidVidPid::LoadJson(shipped_dir + "/android_vidpid.json");
+    auto shipped_bin =
+        AndroidVidPid::LoadBinary(shipped_dir + "/android_vidpid.bin");
+    assert(shipped_json && shipped_bin && !shipped_bin->empty());
+    // the table is sorted and has no duplicates
+    const std::string shipped_table = vidpid_table::Serialize(*shipped_json);
+    assert(vidpid_table::Parse(reinterpret_cast<const unsigned char *>(
+                                   shipped_table.data()),
+                               shipped_table.size()) == shipped_bin);
+  }
+#endif
+
+  Log::Test() << "rules from the table";
+  assert(GuardRule(guard::Target::block, "18d1", "4ee7").BuildString() ==
+         GuardRule("block id 18d1:4ee7").BuildString());
+  assert(GuardRule(guard::Target::block, "22b8", "*").level() ==
+         guard::StrictnessLevel::vid_pid);
+  thrown = false;
+  try {
+    GuardRule(guard::Target::block, "18d1", "4ee");
+  } catch (const std::logic_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+  Log::Test() << "Test29 ... OK";
+}
+
+void Test::Run30() {
+  Log::Test() << "TEST30 ... UdevVidPidParser";
+  using Entry = common_utils::vidpid_table::Entry;
+
+  Log::Test() << "tokenizer";
+  std::vector<UdevToken> tokens;
+  assert(UdevVidPidParser::Tokenize(
+      R"(ATTR{idVendor}!="0502", GOTO="not_Acer" # comment)", tokens));
+  assert(tokens.size() == 2);
+  assert(tokens[0].key == "ATTR" && tokens[0].attr == "idVendor" &&
+         tokens[0].op == "!=" && tokens[0].value == "0502");
+  assert(tokens[1].key == "GOTO" && tokens[1].attr.empty() &&
+         tokens[1].op == "=" && tokens[1].value == "not_Acer");
+  assert(UdevVidPidParser::Tokenize(R"(SYMLINK+="a\"b")", tokens));
+  assert(tokens.size() == 1 && tokens[0].value == "a\"b");
+  assert(!UdevVidPidParser::Tokenize(R"(ATTR{idVendor}=="0502)", tokens));
+  assert(!UdevVidPidParser::Tokenize(R"(ATTR{idVendor} "0502")", tokens));
+
+  Log::Test() << "rules file";
+  std::istringstream rules(R"(# Acer
+ATTR{idVendor}!="0502", GOTO="not_Acer"
+ENV{adb_user}="yes"
+#   Iconia Tab A1-830
+ATTR{idProduct}=="3604", SYMLINK+="android_adb"
+ATTR{idProduct}=="3325", \
+  SYMLINK+="android_fastboot"
+ATTR{idProduct}=="3604"
+ATTR{idProduct}=="33c?"
+GOTO="android_usb_rule_match"
+LABEL="not_Acer"
+ATTR{idProduct}=="ffff"
+
+# Fairphone 2
+ATTR{idVendor}!="2ae5", GOTO="not_Fairphone"
+GOTO="android_usb_rule_match"
+LABEL="not_Fairphone"
+
+# Google
+ATTR{idVendor}=="18d1", ATTR{idProduct}=="4ee7", SYMLINK+="android_adb"
+ATTR{idVendor}=="18d1", ATTR{idProduct}=="4EE0"
+ATTR{idVendor}=="0502", ATTR{idProduct}=="3604"
+broken line
+)");
+  UdevVidPidParser parser;
+  parser.Parse(rules);
+  const std::vector<Entry> expected{{0x0502, 0x3604, false},
+                                    {0x0502, 0x3325, false},
+                                    {0x2ae5, 0, true},
+                                    {0x18d1, 0x4ee7, false},
+                                    {0x18d1, 0x4ee0, false}};
+  assert(parser.entries() == expected);
+  const UdevParseStats &stats = parser.stats();
+  assert(stats.vendors == 3);
+  assert(stats.pairs == 4);
+  assert(stats.any_pid == 1);
+  assert(stats.duplicates == 2);
+  assert(stats.skipped == 1);
+  assert(stats.malformed == 1);
+  Log::Test() << "Test30 ... OK";
+}
+
+void Test::Run31() {
+  Log::Test() << "TEST31 ... GuardRuleBuilder";
+  using guard::GuardRule;
+  using guard::GuardRuleBuilder;
+  using guard::RuleOperator;
+  using guard::Target;
+  auto same = [](const GuardRule &built, const std::string &str) {
+    const GuardRule parsed(str);
+    return built.BuildString() == parsed.BuildString() &&
+           built.level() == parsed.level() && built.target() == parsed.target();
+  };
+
+  Log::Test() << "the same rules as parsed";
+  assert(same(GuardRuleBuilder(Target::block).Id("046d", "c31c").Build(),
+              "block id 046d:c31c"));
+  assert(same(GuardRuleBuilder("allow").Id("046d:*").Build(),
+              "allow id 046d:*"));
+  assert(same(GuardRuleBuilder(Target::allow)
+                  .Name("USB Disk")
+                  .Hash("disk_hash_value")
+                  .Build(),
+              "allow name \"USB Disk\" hash \"disk_hash_value\""));
+  assert(same(GuardRuleBuilder(Target::reject)
+                  .Id("0781", "5581")
+                  .Serial("4C530001")
+                  .ParentHash("\"parent_hash_value\"")
+                  .Port("one-of { \"1-1\" \"1-2\" }")
+                  .ConnectType("hotplug")
+                  .Build(),
+              "reject id 0781:5581 serial \"4C530001\" parent-hash "
+              "\"parent_hash_value\" via-port one-of { \"1-1\" \"1-2\" } "
+              "with-connect-type \"hotplug\""));
+  assert(same(GuardRuleBuilder(Target::block)
+                  .Interfaces(RuleOperator::no_operator, {"08:*:*"})
+                  .Build(),
+              "block with-interface 08:*:*"));
+  assert(same(GuardRuleBuilder(Target::block)
+                  .Interfaces(RuleOperator::one_of, {"06:*:*", "08:*:*"})
+                  .Build(),
+              "block with-interface one-of { 06:*:* 08:*:* }"));
+  assert(same(GuardRuleBuilder(Target::allow)
+                  .Interfaces("{ 03:01:01 03:00:00 }")
+                  .Build(),
+              "allow with-interface { 03:01:01 03:00:00 }"));
+  assert(same(GuardRuleBuilder(Target::allow)
+                  .Id("046d:c31c")
+                  .Conditions("localtime(00:00-12:00)")
+                  .Build(),
+              "allow id 046d:c31c if localtime(00:00-12:00)"));
+  assert(same(GuardRuleBuilder(Target::allow)
+                  .Id("046d:c31c")
+                  .Conditions("if one-of { true rule-applied }")
+                  .Build(),
+              "allow id 046d:c31c if one-of { true rule-applied }"));
+  assert(same(GuardRuleBuilder(Target::block)
+                  .Ids(RuleOperator::one_of, {"046d:c31c", "0781:5581"})
+                  .Build(),
+              "block id one-of { 046d:c31c 0781:5581 }"));
+  assert(same(GuardRuleBuilder(Target::block)
+                  .Hashes(RuleOperator::one_of,
+                          {"disk_hash_value", "\"mtp_hash_value\""})
+                  .Build(),
+              "block hash one-of { \"disk_hash_value\" \"mtp_hash_value\" }"));
+
+  Log::Test() << "bad values";
+  auto throws = [](const std::function<void()> &func) {
+    try {
+      func();
+    } catch (const std::logic_error &) {
+      return true;
+    }
+    return false;
+  };
+  assert(throws([] { GuardRuleBuilder("permit"); }));
+  assert(throws([] { GuardRuleBuilder(Target::allow).Build(); }));
+  assert(throws([] { GuardRuleBuilder(Target::allow).Id("046d", "c3"); }));
+  assert(throws([] { GuardRuleBuilder(Target::allow).Id("*", "c31c"); }));
+  assert(throws([] { GuardRuleBuilder(Target::allow).Hash("short"); }));
+  assert(throws([] { GuardRuleBuilder(Target::allow).Name("a\"b"); }));
+  assert(throws([] { GuardRuleBuilder(Target::allow).Interfaces("03:*"); }));
+  assert(throws(
+      [] { GuardRuleBuilder(Target::allow).Interfaces("03:*:* id"); }));
+  assert(throws([] {
+    GuardRuleBuilder(Target::allow)
+        .Interfaces(RuleOperator::no_operator, {"03:*:*", "08:*:*"});
+  }));
+  assert(throws(
+      [] { GuardRuleBuilder(Target::allow).Conditions("localtime("); }));
+  assert(throws([] {
+    GuardRuleBuilder(Target::allow)
+        .Ids(RuleOperator::one_of, {"046d:c31c", "046d"});
+  }));
+  assert(throws([] {
+    GuardRuleBuilder(Target::allow)
+        .Ids(RuleOperator::no_operator, {"046d:c31c"});
+  }));
+  assert(throws([] {
+    GuardRuleBuilder(Target::allow)
+        .Hashes(RuleOperator::one_of, {"disk_hash_value", "short"});
+  }));
+
+  Log::Test() << "bulk";
+  constexpr int kRules = 10000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRules; ++i) {
+    GuardRule rule("allow name \"Device\" hash \"hash_number_" +
+                   std::to_string(i) + "\"");
+  }
+  auto parse_time = std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRules; ++i) {
+    GuardRule rule = GuardRuleBuilder(Target::allow)
+                         .Name("Device")
+                         .Hash("hash_number_" + std::to_string(i))
+                         .Build();
+  }
+  auto build_time = std::chrono::steady_clock::now() - start;
+  Log::Test() << kRules << " rules parsed in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(
+                     parse_time)
+                     .count()
+              << " us, built in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(
+                     build_time)
+                     .count()
+              << " us";
+  Log::Test() << "Test31 ... OK";
+}
+
+void Test::Run32() {
+  Log::Test() << "TEST32 ... Streaming CSV import";
+  using guard::utils::Base64StreamDecoder;
+  using guard::utils::csv::CsvRowReader;
+  using cppcodec::base64_rfc4648;
+
+  Log::Test() << "base64 in chunks";
+  std::string data;
+  for (int i = 0; i < 50000; ++i)
+    data.push_back(static_cast<char>((i * 7919) % 251));
+  for (size_t size : {size_t(0), size_t(1), size_t(2), size_t(3),
+                      size_t(100), data.size()}) {
+    const std::string source = data.substr(0, size);
+    const std::string encoded = base64_rfc4648::encode<std::string>(source);
+    for (size_t chunk : {size_t(1), size_t(3), size_t(1000)}) {
+      std::string decoded;
+      Base64StreamDecoder decoder(
+          [&decoded](std::string_view block) { decoded.append(block); });
+      for (size_t pos = 0; pos < encoded.size(); pos += chunk)
+        decoder.Write(std::string_view(encoded).substr(pos, chunk));
+      decoder.Finish();
+      assert(decoded == source);
+    }
+  }
+  auto bad_base64 = [](const std::string &str) {
+    Base64StreamDecoder decoder([](std::string_view) {});
+    try {
+      decoder.Write(str);
+      decoder.Finish();
+    } catch (const std::runtime_error &) {
+      return true;
+    }
+    return false;
+  };
+  assert(bad_base64("QUJD!"));
+  assert(bad_base64("QUI"));
+  assert(bad_base64("QQ==QUJD"));
+  assert(bad_base64("Q==="));
+  assert(!bad_base64("QUJD\nQUI=\r\n"));
+
+  Log::Test() << "utf-8 filter";
+  const std::string text = "allow,\"03:*:*\",'046d:c31c',"
+                           "\xd0\x9f\xd1\x80\xd0\xb8\xe2\x82\xac"
+                           "\xf0\x9f\x98\x80"
+                           "end";
+  for (size_t chunk = 1; chunk <= text.size(); ++chunk) {
+    std::string filtered;
+    common_utils::Utf8Filter filter(
+        [&filtered](std::string_view part) { filtered.append(part); });
+    for (size_t pos = 0; pos < text.size(); pos += chunk)
+      assert(filter.Write(std::string_view(text).substr(pos, chunk)));
+    assert(filter.Finish());
+    assert(filtered == common_utils::UnUtf8(text));
+    assert(filtered == "allow,03:*:*,046d:c31c,end");
+  }
+  common_utils::Utf8Filter bad_filter([](std::string_view) {});
+  assert(!bad_filter.Write("ab\x80" "cd"));
+  common_utils::Utf8Filter cut_filter([](std::string_view) {});
+  assert(cut_filter.Write("ab\xe2\x82") && !cut_filter.Finish());
+
+  Log::Test() << "csv rows";
+  std::vector<std::vector<std::string>> rows;
+  std::vector<size_t> lines;
+  CsvRowReader reader(
+      [&rows, &lines](std::vector<std::string> &row, size_t index,
+                      size_t line) {
+        assert(index == rows.size());
+        rows.push_back(row);
+        lines.push_back(line);
+      });
+  reader.Write("allow,03:*:*,,\r\n\nblock,,046d:");
+  reader.Write("c31c,\nreject,08:06:50");
+  reader.Finish();
+  assert(reader.rows() == 3);
+  assert((rows[0] == std::vector<std::string>{"allow", "03:*:*", "", ""}));
+  assert((rows[1] == std::vector<std::string>{"block", "", "046d:c31c", ""}));
+  assert((rows[2] == std::vector<std::string>{"reject", "08:06:50"}));
+  // empty lines are counted
+  assert((lines == std::vector<size_t>{0, 2, 3}));
+
+  Log::Test() << "rules from a file";
+  std::string csv = "\"allow\",\"\",\"046d:c31c\",\"\"\r\n"
+                    "allow,\"{ 03:01:01 03:00:00 }\",,\n"
+                    "allow,,,\"disk_hash_value\"\n";
+  for (int i = 0; i < 2000; ++i) {
+    csv += "allow,,,hash_number_" + std::to_string(i) + "\n";
+  }
+  const std::string upload = base64_rfc4648::encode<std::string>(
+      base64_rfc4648::encode<std::string>(csv));
+  std::optional<guard::utils::CsvUploadResult> res =
+      guard::utils::UploadRulesCsv(upload);
+  assert(res && res->rules.size() == 2003 && res->rows == 2003);
+  assert(res->failed_rows == 0 && res->errors.empty());
+  const std::vector<guard::GuardRule> &rules = res->rules;
+  assert(rules.at(0).BuildString() == "allow id 046d:c31c");
+  assert(rules.at(1).BuildString() ==
+         guard::GuardRule("allow with-interface { 03:01:01 03:00:00 }")
+             .BuildString());
+  assert(rules.at(2).BuildString() == "allow hash \"disk_hash_value\"");
+  assert(rules.back().number() == 2002);
+  assert(!guard::utils::UploadRulesCsv(upload.substr(1)));
+  res = guard::utils::UploadRulesCsv(base64_rfc4648::encode<std::string>(
+      base64_rfc4648::encode<std::string>(std::string("allow,,,short\n"))));
+  assert(res && res->rules.empty() && res->failed_rows == 1);
+  assert(res->errors.size() == 1 && res->errors[0].line == 0);
+  assert(res->errors[0].column == 3);
+  Log::Test() << "Test32 ... OK";
+}
+
+void Test::Run33() {
+  Log::Test() << "TEST33 ... Parallel CSV conversion";
+  using cppcodec::base64_rfc4648;
+
+  Log::Test() << "thread pool";
+  {
+    guard::ThreadPool pool(4);
+    assert(pool.size() == 4);
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 100; ++i)
+      futures.push_back(pool.Submit([i] { return i * i; }));
+    for (int i = 0; i < 100; ++i)
+      assert(futures[i].get() == i * i);
+    std::future<void> failed =
+        pool.Submit([] { throw std::runtime_error("task failed"); });
+    bool thrown = false;
+    try {
+      failed.get();
+    } catch (const std::runtime_error &) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  assert(guard::ThreadPool(0).size() == 1);
+  assert(guard::ThreadPool::DefaultThreads() >= 1 &&
+         guard::ThreadPool::DefaultThreads() <= guard::ThreadPool::kMaxThreads);
+
+  Log::Test() << "rows errors";
+  constexpr size_t kRows = 10000;
+  std::string csv;
+  std::vector<guard::utils::CsvRowError> expected;
+  for (size_t i = 0; i < kRows; ++i) {
+    if (i % 997 == 5) {
+      csv += "permit,,,hash_number_" + std::to_string(i) + "\n";
+      expected.push_back({i, 0, ""});
+    } else if (i % 997 == 500) {
+      csv += "block,,zzzz:0001,\n";
+      expected.push_back({i, 2, ""});
+    } else if (i % 997 == 900) {
+      csv += "allow,,,short\n";
+      expected.push_back({i, 3, ""});
+    } else {
+      csv += "allow,,,hash_number_" + std::to_string(i) + "\n";
+    }
+  }
+  std::optional<guard::utils::CsvUploadResult> res =
+      guard::utils::UploadRulesCsv(base64_rfc4648::encode<std::string>(
+          base64_rfc4648::encode<std::string>(csv)));
+  assert(res && res->rows == kRows);
+  assert(res->failed_rows == expected.size());
+  assert(res->rules.size() == kRows - expected.size());
+  assert(res->errors.size() == expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    assert(res->errors[i].line == expected[i].line);
+    assert(res->errors[i].column == expected[i].column);
+    assert(!res->errors[i].message.empty());
+  }
+  // the rules keep the order of the rows
+  for (size_t i = 1; i < res->rules.size(); ++i)
+    assert(res->rules[i - 1].number() < res->rules[i].number());
+  const guard::GuardRule &last = res->rules.back();
+  assert(last.number() == kRows - 1);
+  assert(last.hash() == "\"hash_number_" + std::to_string(kRows - 1) + "\"" ||
+         last.hash() == "hash_number_" + std::to_string(kRows - 1));
+
+  Log::Test() << "errors point to the lines of the file";
+  res = guard::utils::UploadRulesCsv(base64_rfc4648::encode<std::string>(
+      base64_rfc4648::encode<std::string>(
+          std::string("allow,,,hash_number_1\n\n\r\nallow,,,short\n"))));
+  assert(res && res->rows == 2 && res->failed_rows == 1);
+  assert(res->errors.size() == 1 && res->errors[0].line == 3);
+  Log::Test() << "Test33 ... OK";
+}
+
+void Test::Run34() {
+  Log::Test() << "TEST34 ... Chunked upload";
+  namespace fs = std::filesystem;
+  using cppcodec::base64_rfc4648;
+  using guard::UploadSpool;
+
+  const fs::path dir = fs::temp_directory_path() / "usbguard_upload_test";
+  fs::remove_all(dir);
+  const UploadSpool spool(dir.string());
+  std::string csv;
+  for (int i = 0; i < 5000; ++i)
+    csv += "allow,,,hash_number_" + std::to_string(i) + "\n";
+  const std::string upload = base64_rfc4648::encode<std::string>(
+      base64_rfc4648::encode<std::string>(csv));
+
+  Log::Test() << "chunks";
+  std::optional<std::string> id = spool.Begin();
+  assert(id && id->size() == 16);
+  assert(spool.Progress(*id)->received == 0);
+  // chunks split base64 groups
+  constexpr size_t kChunk = 10001;
+  size_t offset = 0;
+  for (; offset < upload.size() / 2; offset += kChunk)
+    assert(spool.Append(*id, offset, upload.substr(offset, kChunk)));
+  assert(spool.Progress(*id)->received == offset);
+  // a chunk after a gap is not accepted
+  assert(!spool.Append(*id, offset + 1, upload.substr(offset + 1, kChunk)));
+  // a resent chunk is accepted once
+  assert(spool.Append(*id, offset - kChunk, upload.substr(offset - kChunk)));
+  assert(spool.Progress(*id)->received == upload.size());
+  assert(spool.Progress(*id)->finished == (upload.back() == '='));
+  // an interrupted chunk left garbage in the spool file
+  {
+    std::ofstream data(dir / (*id + ".data"), std::ios::app);
+    data << "garbage";
+  }
+  // a commit before the whole file arrived keeps the upload
+  assert(!spool.Commit(*id, upload.size() + 4));
+  assert(spool.Progress(*id)->received == upload.size());
+  std::optional<guard::utils::CsvUploadResult> res =
+      spool.Commit(*id, upload.size());
+  assert(res && res->rows == 5000 && res->failed_rows == 0);
+  assert(res->rules.size() == 5000);
+  assert(res->rules.back().hash() ==
+         guard::utils::UploadRulesCsv(upload)->rules.back().hash());
+  // the upload is removed on commit
+  assert(!spool.Progress(*id));
+  assert(!spool.Commit(*id, upload.size()));
+
+  Log::Test() << "bad uploads";
+  assert(!spool.Progress("../../etc/passwd"));
+  assert(!spool.Append("0123456789abcdeg", 0, "QUJD"));
+  id = spool.Begin();
+  assert(id && spool.Append(*id, 0, upload.substr(0, 7)));
+  // an incomplete base64 group
+  assert(!spool.Commit(*id, 7));
+  // a truncated file at a group boundary
+  assert(spool.Append(*id, 7, upload.substr(7, 1)));
+  assert(!spool.Commit(*id, upload.size()));
+  id = spool.Begin();
+  assert(id && !spool.Append(*id, 0, "QU!D"));
+  assert(spool.Progress(*id)->received == 0);
+  assert(spool.Append(*id, 0, "QQ=="));
+  assert(!spool.Append(*id, 4, "QUJD"));
+
+  Log::Test() << "expired uploads";
+  auto make_old = [](const fs::path &path) {
+    fs::last_write_time(path, fs::last_write_time(path) -
+                                  std::chrono::seconds(
+                                      UploadSpool::kMaxAge + 10));
+  };
+  // the files of an upload expire together
+  make_old(dir / (*id + ".state"));
+  spool.RemoveExpired();
+  assert(spool.Progress(*id));
+  assert(fs::exists(dir / (*id + ".data")));
+  make_old(dir / (*id + ".data"));
+  spool.RemoveExpired();
+  assert(!spool.Progress(*id));
+  assert(!fs::exists(dir / (*id + ".data")));
+  fs::remove_all(dir);
+  Log::Test() << "Test34 ... OK";
+}
+
+void Test::Run35() {
+  Log::Test() << "TEST35 ... Vector base64 decoding";
+  using guard::utils::Base64StreamDecoder;
+  using cppcodec::base64_rfc4648;
+
+  const std::string impl = Base64StreamDecoder::implementation();
+  Log::Test() << "implementation " << impl;
+  assert(impl == "avx2" || impl == "ssse3" || impl == "scalar");
+  auto decode = [](const std::string &encoded, size_t chunk) {
+    std::string res;
+    Base64StreamDecoder decoder(
+        [&res](std::string_view block) { res.append(block); });
+    for (size_t pos = 0; pos < encoded.size(); pos += chunk)
+      decoder.Write(std::string_view(encoded).substr(pos, chunk));
+    decoder.Finish();
+    return res;
+  };
+  std::string data;
+  for (size_t i = 0; i < 100000; ++i)
+    data.push_back(static_cast<char>((i * 7919 + i / 251) % 256));
+  for (size_t size : {size_t(31), size_t(47), size_t(1000), data.size()}) {
+    const std::string source = data.substr(0, size);
+    const std::string encoded = base64_rfc4648::encode<std::string>(source);
+    // line breaks split the runs of groups
+    std::string wrapped;
+    for (size_t pos = 0; pos < encoded.size(); pos += 76)
+      wrapped += encoded.substr(pos, 76) + "\r\n";
+    for (size_t chunk : {size_t(5), size_t(33), size_t(4096), encoded.size()}) {
+      assert(decode(encoded, chunk) == source);
+      assert(decode(wrapped, chunk) == source);
+    }
+  }
+
+  Log::Test() << "large wrapped input";
+  {
+    std::string source;
+    while (source.size() < 4 * 1024 * 1024)
+      source += data;
+    const std::string encoded = base64_rfc4648::encode<std::string>(source);
+    std::string wrapped;
+    for (size_t pos = 0; pos < encoded.size(); pos += 76)
+      wrapped += encoded.substr(pos, 76) + '\n';
+    std::string res;
+    size_t blocks = 0;
+    Base64StreamDecoder decoder([&res, &blocks](std::string_view block) {
+      ++blocks;
+      res.append(block);
+    });
+    for (size_t pos = 0; pos < wrapped.size(); pos += 1024 * 1024)
+      decoder.Write(std::string_view(wrapped).substr(pos, 1024 * 1024));
+    decoder.Finish();
+    assert(res == source);
+    // the lines are gathered into blocks, not passed one by one
+    assert(blocks <= source.size() / Base64StreamDecoder::kBlockSize + 1);
+  }
+
+  Log::Test() << "bad symbols in long runs";
+  const std::string encoded =
+      base64_rfc4648::encode<std::string>(data.substr(0, 3000));
+  for (size_t pos : {size_t(0), size_t(17), size_t(31), size_t(32),
+                     size_t(1234), encoded.size() - 5}) {
+    for (const char symbol : {'!', '-', '.', '=', '\x80', ' '}) {
+      std::string bad = encoded;
+      bad[pos] = symbol;
+      bool thrown = false;
+      try {
+        decode(bad, 4096);
+      } catch (const std::runtime_error &) {
+        thrown = true;
+      }
+      assert(thrown);
+    }
+  }
+  Log::Test() << "Test35 ... OK";
+}
+
+void Test::Run36() {
+  Log::Test() << "TEST36 ... UTF-8 filter";
+  using common_utils::Utf8Filter;
+
+  auto filter_all = [](const std::string &str, size_t chunk) {
+    std::string res;
+    Utf8Filter filter(
+        [&res](std::string_view part) { res.append(part); });
+    bool good = true;
+    for (size_t pos = 0; pos < str.size() && good; pos += chunk)
+      good = filter.Write(std::string_view(str).substr(pos, chunk));
+    good = good && filter.Finish();
+    return std::make_pair(good, res);
+  };
+
+  Log::Test() << "validation";
+  const std::vector<std::pair<std::string, bool>> cases{
+      {"plain ascii", true},
+      {"\xd0\x9f\xd1\x80\xd0\xb8", true},      // 2 bytes
+      {"\xe2\x82\xac", true},                  // 3 bytes
+      {"\xf0\x9f\x98\x80", true},              // 4 bytes
+      {"\xf4\x8f\xbf\xbf", true},              // U+10FFFF
+      {"\xc0\xaf", false},                      // overlong
+      {"\xe0\x80\xaf", false},                  // overlong
+      {"\xf0\x80\x80\xaf", false},              // overlong
+      {"\xed\xa0\x80", false},                  // surrogate
+      {"\xf4\x90\x80\x80", false},              // > U+10FFFF
+      {"\xf8\x88\x80\x80\x80", false},          // 5 bytes
+      {"\xd0" "a", false},                      // no continuation
+      {"\x80", false},                          // continuation only
+      {"\xe2\x82", false}};                     // cut
+  for (const auto &[str, valid] : cases) {
+    for (size_t chunk = 1; chunk <= str.size(); ++chunk)
+      assert(filter_all(str, chunk).first == valid);
+  }
+
+  Log::Test() << "ASCII runs";
+  std::string text;
+  for (int i = 0; i < 30000; ++i) {
+    text += "allow,\"03:*:*\",'046d:c31c',";
+    text += i % 7 == 0 ? "\xd0\x9f\xe2\x82\xac" : "0123456789abcdef";
+    text += "\n";
+  }
+  std::string expected;
+  for (const char symbol : text) {
+    if (symbol != '"' && symbol != '\'' && (symbol & 0x80) == 0)
+      expected.push_back(symbol);
+  }
+  // larger than the old limit of 1000000 iterations
+  assert(text.size() > 1'000'000);
+  assert(common_utils::UnUtf8(text) == expected);
+  for (size_t chunk : {size_t(1), size_t(15), size_t(17), size_t(4096)}) {
+    const auto res = filter_all(text, chunk);
+    assert(res.first && res.second == expected);
+  }
+  // the part before an error
+  assert(common_utils::UnUtf8("ab\"c\xc0\xaf" "def") == "abc");
+  Log::Test() << "Test36 ... OK";
+}
+
+void Test::Run37() {
+  Log::Test() << "TEST37 ... Rules export";
+  using guard::ExportFormat;
+  using guard::GuardRule;
+  using guard::RuleExporter;
+  using cppcodec::base64_rfc4648;
+
+  Log::Test() << "csv rows";
+  assert(RuleExporter::CsvRow(GuardRule("allow id 046d:c31c")) ==
+         "allow,,046d:c31c,");
+  assert(RuleExporter::CsvRow(GuardRule("block hash \"disk_hash_value\"")) ==
+         "block,,,disk_hash_value");
+  assert(RuleExporter::CsvRow(
+             GuardRule("reject with-interface { 03:01:01 03:00:00 }")) ==
+         "reject,{ 03:01:01 03:00:00 },,");
+  GuardRule with_vendor("allow id 046d:c31c");
+  with_vendor.vendor_name("Logitech, \"Inc.\"");
+  assert(RuleExporter::CsvRow(with_vendor) ==
+         "allow,,046d:c31c,,\"Logitech, \"\"Inc.\"\"\"");
+  // the hash covers the name
+  assert(RuleExporter::CsvRow(GuardRule(
+             "allow name \"USB Mouse\" hash \"disk_hash_value\"")) ==
+         "allow,,,disk_hash_value");
+  assert(!RuleExporter::CsvRow(GuardRule("allow id 046d:c31c name \"mouse\"")));
+  assert(!RuleExporter::CsvRow(GuardRule("allow via-port \"1-2\"")));
+  assert(!RuleExporter::CsvRow(GuardRule("allow serial \"0123456789\"")));
+
+  Log::Test() << "streaming";
+  const std::vector<std::string> sources{
+      "allow id 046d:c31c",
+      "block hash \"disk_hash_value\"",
+      "allow name \"USB Mouse\" hash \"mouse_hash_value\"",
+      "allow with-interface { 03:01:01 03:00:00 }",
+      "allow id 046d:c31c via-port \"1-2\"",
+      "reject with-interface 08:06:50"};
+  std::vector<GuardRule> rules;
+  for (const std::string &source : sources)
+    rules.emplace_back(source);
+  std::string csv;
+  size_t lines = 0;
+  RuleExporter csv_exporter(ExportFormat::csv,
+                            [&csv, &lines](std::string_view line) {
+                              csv.append(line);
+                              ++lines;
+                            });
+  for (const GuardRule &rule : rules)
+    csv_exporter.Write(rule);
+  assert(csv_exporter.exported() == 5 && csv_exporter.skipped() == 1);
+  assert(lines == 5 && std::count(csv.cbegin(), csv.cend(), '\n') == 5);
+
+  Log::Test() << "csv round trip";
+  std::optional<guard::utils::CsvUploadResult> res =
+      guard::utils::UploadRulesCsv(base64_rfc4648::encode<std::string>(
+          base64_rfc4648::encode<std::string>(csv)));
+  assert(res && res->failed_rows == 0 && res->rules.size() == 5);
+  // the name is dropped, the via-port rule is skipped
+  const std::vector<std::string> expected{
+      rules[0].BuildString(), rules[1].BuildString(),
+      "allow hash \"mouse_hash_value\"", rules[3].BuildString(),
+      rules[5].BuildString()};
+  for (size_t i = 0; i < expected.size(); ++i)
+    assert(res->rules[i].BuildString() == expected[i]);
+
+  Log::Test() << "ndjson";
+  std::string ndjson;
+  RuleExporter json_exporter(
+      ExportFormat::ndjson,
+      [&ndjson](std::string_view line) { ndjson.append(line); });
+  for (const GuardRule &rule : rules)
+    assert(json_exporter.Write(rule));
+  assert(json_exporter.exported() == rules.size());
+  assert(json_exporter.skipped() == 0);
+  std::istringstream stream(ndjson);
+  std::string line;
+  size_t index = 0;
+  while (std::getline(stream, line)) {
+    boost::json::value value = boost::json::parse(line);
+    assert(value.as_object().at("rule").as_string() ==
+           rules.at(index).BuildString(true, true));
+    ++index;
+  }
+  assert(index == rules.size());
+
+  assert(RuleExporter::StrToFormat("ndjson") == ExportFormat::ndjson);
+  assert(!RuleExporter::StrToFormat("xml"));
+  Log::Test() << "Test37 ... OK";
+}
+
+void Test::Run38() {
+  Log::Test() << "TEST38 ... Allow or block many devices";
+  guard::Guard guard;
+  // no device has the largest id, the daemon refuses it
+  const std::string missing = "4294967295";
+  std::map<std::string, std::string> res = guard.AllowOrBlockDevices(
+      {"abc", missing, "", "abc", missing, '0' + missing}, false);
+  // duplicates are reported once, other spellings of an id get its result
+  assert(res.size() == 4);
+  assert(res.at("abc") == "BAD_ID");
+  assert(res.at("") == "BAD_ID");
+  assert(res.at('0' + missing) == res.at(missing));
+  // a failed device doesn't stop the batch and isn't reported as OK
+  if (guard.HealthStatus()) {
+    Log::Test() << "daemon is running";
+    assert(res.at(missing) == "FAILED");
+  } else {
+    Log::Test() << "daemon is not running";
+    assert(res.at(missing) == "NO_DAEMON");
+  }
+  assert(guard.AllowOrBlockDevices({}, true).empty());
+  Log::Test() << "Test38 ... OK";
+}
@@ -105,4 +105,124 @@ public:
    */
   
   void Run18();
-};
\ No newline at end of file
+
+  /**
+   * @brief RuleSetDiff - added, removed and moved rules
+   *
+   */
+  void Run19();
+
+  /**
+   * @brief ChangeJournal - record, lock and commit
+   *
+   */
+  void Run20();
+
+  /**
+   * @brief DeviceInventory - updates and changes since a version
+   *
+   */
+  void Run21();
+
+  /**
+   * @brief IpcConnection - backoff between failed attempts
+   *
+   */
+  void Run22();
+
+  /**
+   * @brief SysfsUsbReader - devices and hashes from a fake sysfs tree
+   *
+   */
+  void Run23();
+
+  /**
+   * @brief UsbTopology - the device tree and its cache
+   *
+   */
+  void Run24();
+
+  /**
+   * @brief RuleEvaluator - the first matching rule for devices
+   *
+   */
+  void Run25();
+
+  /**
+   * @brief RuleSet - lookups and stable numbers
+   *
+   */
+  void Run26();
+
+  /**
+   * @brief RuleAnalyzer - duplicates, shadowed rules and contradictions
+   *
+   */
+  void Run27();
+
+  /**
+   * @brief RuleSetCompactor - merging per-device rules to one-of rules
+   *
+   */
+  void Run28();
+
+  /**
+   * @brief AndroidVidPid - the binary vid:pid table and the JSON fallback
+   *
+   */
+  void Run29();
+
+  /**
+   * @brief UdevVidPidParser - offline parsing of 51-android.rules
+   *
+   */
+  void Run30();
+
+  /**
+   * @brief GuardRuleBuilder - rules from fields, without parsing strings
+   *
+   */
+  void Run31();
+
+  /**
+   * @brief Streaming CSV import - base64, utf-8 filter and csv rows
+   *
+   */
+  void Run32();
+
+  /**
+   * @brief ThreadPool and parallel CSV conversion with row errors
+   *
+   */
+  void Run33();
+
+  /**
+   * @brief UploadSpool - chunked and resumed upload of a rules file
+   *
+   */
+  void Run34();
+
+  /**
+   * @brief Base64StreamDecoder - vector decoding of long inputs
+   *
+   */
+  void Run35();
+
+  /**
+   * @brief Utf8Filter - validation, ASCII runs and no size limit
+   *
+   */
+  void Run36();
+
+  /**
+   * @brief RuleExporter - CSV rows, streaming and the import round trip
+   *
+   */
+  void Run37();
+
+  /**
+   * @brief Guard::AllowOrBlockDevices - results of a partly failed batch
+   *
+   */
+  void Run38();
+};